@@ -16,6 +16,7 @@
 
 using namespace llvm;
 
+bool StripTypeSuffixes;
 
 static inline bool needAnnotation(Value *V) {
 	if (PointerType *PTy = dyn_cast<PointerType>(V->getType())) {
@@ -44,6 +44,26 @@ static inline std::string getScopeName(llvm::GlobalValue *GV) {
 	}
 }
 
+// set by intglobal -shared-context, where types from many modules meet
+// in one LLVMContext
+extern bool StripTypeSuffixes;
+
+// strip .NNN suffixes that LLVM appends when a type name is already
+// taken in the LLVMContext, e.g., struct.foo.42 -> struct.foo
+static inline llvm::StringRef stripRenameSuffix(llvm::StringRef Name) {
+	for (;;) {
+		size_t i = Name.rfind('.');
+		if (i == llvm::StringRef::npos || i == Name.find('.'))
+			break;
+		llvm::StringRef Suffix = Name.substr(i + 1);
+		if (Suffix.empty() || Suffix.find_first_not_of("0123456789")
+				!= llvm::StringRef::npos)
+			break;
+		Name = Name.substr(0, i);
+	}
+	return Name;
+}
+
 // prefix anonymous struct name with module name
 static inline std::string getScopeName(llvm::StructType *Ty, llvm::Module *M) {
 	if (Ty->getStructName().startswith("struct.anon")) {
@@ -52,6 +72,11 @@ static inline std::string getScopeName(llvm::StructType *Ty, llvm::Module *M) {
 			M->getModuleIdentifier());
 		return "struct._" + moduleName.str() + rest.str();
 	}
+	// the same type may be loaded from many modules; otherwise the
+	// suffix is clang's, e.g., for a struct of a nested scope, as it is
+	// for every anonymous union
+	if (StripTypeSuffixes && !Ty->getStructName().startswith("union.anon"))
+		return stripRenameSuffix(Ty->getStructName()).str();
 	return Ty->getStructName().str();
 }
 
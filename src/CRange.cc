@@ -0,0 +1,55 @@
+#include "CRange.h"
+
+using namespace llvm;
+
+CRange CRange::slowUnionWith(const CRange &R) const {
+	return toConstantRange().unionWith(R.toConstantRange());
+}
+
+CRange CRange::slowIntersectWith(const CRange &R) const {
+	return toConstantRange().intersectWith(R.toConstantRange());
+}
+
+CRange CRange::slowAdd(const CRange &R) const {
+	return toConstantRange().add(R.toConstantRange());
+}
+
+CRange CRange::slowSub(const CRange &R) const {
+	return toConstantRange().sub(R.toConstantRange());
+}
+
+CRange CRange::slowMultiply(const CRange &R) const {
+	return toConstantRange().multiply(R.toConstantRange());
+}
+
+CRange CRange::slowZextOrTrunc(uint32_t BitWidth) const {
+	return toConstantRange().zextOrTrunc(BitWidth);
+}
+
+CRange CRange::udiv(const CRange &R) const {
+	return toConstantRange().udiv(R.toConstantRange());
+}
+
+CRange CRange::shl(const CRange &R) const {
+	return toConstantRange().shl(R.toConstantRange());
+}
+
+CRange CRange::lshr(const CRange &R) const {
+	return toConstantRange().lshr(R.toConstantRange());
+}
+
+CRange CRange::binaryAnd(const CRange &R) const {
+	return toConstantRange().binaryAnd(R.toConstantRange());
+}
+
+CRange CRange::binaryOr(const CRange &R) const {
+	return toConstantRange().binaryOr(R.toConstantRange());
+}
+
+CRange CRange::signExtend(uint32_t BitWidth) const {
+	return toConstantRange().signExtend(BitWidth);
+}
+
+CRange CRange::inverse() const {
+	return toConstantRange().inverse();
+}
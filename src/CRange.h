@@ -2,19 +2,60 @@
 
 #include <llvm/Support/Debug.h>
 #include <llvm/Support/ConstantRange.h>
+#include <llvm/Support/raw_ostream.h>
+#include <algorithm>
 
 // llvm::ConstantRange fixup.
-class CRange : public llvm::ConstantRange {
+//
+// Same encoding and results as llvm::ConstantRange, but ranges of up to
+// 64 bits are kept in two uint64_t.  The operations RangePass uses most
+// take an inline fast path on them, and fall back to ConstantRange (APInt)
+// for the harder cases.  Wider ranges always use ConstantRange.
+class CRange {
 	typedef llvm::APInt APInt;
 	typedef llvm::ConstantRange super;
 public:
-	CRange(uint32_t BitWidth, bool isFullSet) : super(BitWidth, isFullSet) {}
+	CRange(uint32_t BitWidth, bool isFullSet)
+		: Width(BitWidth), Lo(0), Hi(0), Wide(NULL) {
+		if (BitWidth > 64)
+			Wide = new super(BitWidth, isFullSet);
+		else if (isFullSet)
+			Lo = Hi = mask();
+	}
 	// Constructors.
-	CRange(const super &CR) : super(CR) {}
+	CRange(const super &CR)
+		: Width(CR.getBitWidth()), Lo(0), Hi(0), Wide(NULL) {
+		setRange(CR);
+	}
 	CRange(const APInt &Value)
-		: super(Value) {}
+		: Width(Value.getBitWidth()), Lo(0), Hi(0), Wide(NULL) {
+		if (Width > 64)
+			Wide = new super(Value);
+		else {
+			Lo = Value.getZExtValue();
+			Hi = (Lo + 1) & mask();
+		}
+	}
 	CRange(const APInt &Lower, const APInt &Upper)
-		: super(Lower, Upper) {}
+		: Width(Lower.getBitWidth()), Lo(0), Hi(0), Wide(NULL) {
+		setRange(super(Lower, Upper));
+	}
+	CRange(const CRange &R)
+		: Width(R.Width), Lo(R.Lo), Hi(R.Hi),
+		  Wide(R.Wide ? new super(*R.Wide) : NULL) {}
+	~CRange() { delete Wide; }
+
+	CRange &operator=(const CRange &R) {
+		if (this != &R) {
+			delete Wide;
+			Width = R.Width;
+			Lo = R.Lo;
+			Hi = R.Hi;
+			Wide = R.Wide ? new super(*R.Wide) : NULL;
+		}
+		return *this;
+	}
+
 	static CRange makeFullSet(uint32_t BitWidth) {
 		return CRange(BitWidth, true);
 	}
@@ -22,12 +63,157 @@ public:
 		return CRange(BitWidth, false);
 	}
 	static CRange makeICmpRegion(unsigned Pred, const CRange &other) {
-		return super::makeICmpRegion(Pred, other);
+		return super::makeICmpRegion(Pred, other.toConstantRange());
+	}
+
+	super toConstantRange() const {
+		if (Wide)
+			return *Wide;
+		if (Lo == Hi)
+			return super(Width, Lo != 0);
+		return super(APInt(Width, Lo), APInt(Width, Hi));
+	}
+
+	uint32_t getBitWidth() const { return Width; }
+	APInt getLower() const { return Wide ? Wide->getLower() : APInt(Width, Lo); }
+	APInt getUpper() const { return Wide ? Wide->getUpper() : APInt(Width, Hi); }
+
+	bool isEmptySet() const {
+		return Wide ? Wide->isEmptySet() : (Lo == Hi && Lo == 0);
+	}
+	bool isFullSet() const {
+		return Wide ? Wide->isFullSet() : (Lo == Hi && Lo != 0);
+	}
+	bool isWrappedSet() const {
+		return Wide ? Wide->isWrappedSet() : Lo > Hi;
+	}
+
+	bool operator==(const CRange &R) const {
+		if (Width != R.Width)
+			return false;
+		if (Wide)
+			return *Wide == *R.Wide;
+		return Lo == R.Lo && Hi == R.Hi;
+	}
+	bool operator!=(const CRange &R) const { return !(*this == R); }
+
+	CRange unionWith(const CRange &R) const {
+		if (!isSmall(R))
+			return slowUnionWith(R);
+		if (isFullSet() || R.isEmptySet())
+			return *this;
+		if (R.isFullSet() || isEmptySet())
+			return R;
+		if (!isPlain() || !R.isPlain())
+			return slowUnionWith(R);
+		// disjoint: bridge the smaller gap
+		if (R.Hi < Lo || Hi < R.Lo) {
+			uint64_t d1 = (R.Lo - Hi) & mask(), d2 = (Lo - R.Hi) & mask();
+			if (d1 < d2)
+				return CRange(Width, Lo, R.Hi);
+			return CRange(Width, R.Lo, Hi);
+		}
+		return CRange(Width, std::min(Lo, R.Lo), std::max(Hi, R.Hi));
+	}
+
+	CRange intersectWith(const CRange &R) const {
+		if (!isSmall(R))
+			return slowIntersectWith(R);
+		if (isEmptySet() || R.isFullSet())
+			return *this;
+		if (R.isEmptySet() || isFullSet())
+			return R;
+		if (!isPlain() || !R.isPlain())
+			return slowIntersectWith(R);
+		uint64_t L = std::max(Lo, R.Lo), H = std::min(Hi, R.Hi);
+		if (L >= H)
+			return makeEmptySet(Width);
+		return CRange(Width, L, H);
+	}
+
+	CRange add(const CRange &R) const {
+		if (!isSmall(R))
+			return slowAdd(R);
+		if (isEmptySet() || R.isEmptySet())
+			return makeEmptySet(Width);
+		if (isFullSet() || R.isFullSet() || !fitsSum(R))
+			return makeFullSet(Width);
+		return CRange(Width, (Lo + R.Lo) & mask(), (Hi + R.Hi - 1) & mask());
+	}
+
+	CRange sub(const CRange &R) const {
+		if (!isSmall(R))
+			return slowSub(R);
+		if (isEmptySet() || R.isEmptySet())
+			return makeEmptySet(Width);
+		if (isFullSet() || R.isFullSet() || !fitsSum(R))
+			return makeFullSet(Width);
+		return CRange(Width, (Lo - R.Hi + 1) & mask(), (Hi - R.Lo) & mask());
+	}
+
+	CRange multiply(const CRange &R) const {
+		if (!isSmall(R))
+			return slowMultiply(R);
+		if (isEmptySet() || R.isEmptySet())
+			return makeEmptySet(Width);
+		if (isFullSet() || R.isFullSet())
+			return makeFullSet(Width);
+		if (!isPlain() || !R.isPlain())
+			return slowMultiply(R);
+		uint64_t A = Hi - 1, B = R.Hi - 1;
+		if (B && A > mask() / B)
+			return slowMultiply(R);
+		uint64_t Max = A * B;
+		if (Max >= mask())
+			return slowMultiply(R);
+		return CRange(Width, Lo * R.Lo, Max + 1);
+	}
+
+	CRange zextOrTrunc(uint32_t BitWidth) const {
+		if (BitWidth == Width)
+			return *this;
+		if (Wide || BitWidth > 64)
+			return slowZextOrTrunc(BitWidth);
+		if (isEmptySet())
+			return makeEmptySet(BitWidth);
+		if (BitWidth > Width) {
+			if (isFullSet())
+				return CRange(BitWidth, 0, 1ULL << Width);
+			if (isPlain())
+				return CRange(BitWidth, Lo, Hi);
+		} else {
+			if (isFullSet())
+				return makeFullSet(BitWidth);
+			if (isPlain() && Hi <= mask(BitWidth))
+				return CRange(BitWidth, Lo, Hi);
+		}
+		return slowZextOrTrunc(BitWidth);
+	}
+
+	// Fallbacks of the above.
+	CRange slowUnionWith(const CRange &R) const;
+	CRange slowIntersectWith(const CRange &R) const;
+	CRange slowAdd(const CRange &R) const;
+	CRange slowSub(const CRange &R) const;
+	CRange slowMultiply(const CRange &R) const;
+	CRange slowZextOrTrunc(uint32_t BitWidth) const;
+
+	// No fast path for these.
+	CRange udiv(const CRange &R) const;
+	CRange shl(const CRange &R) const;
+	CRange lshr(const CRange &R) const;
+	CRange binaryAnd(const CRange &R) const;
+	CRange binaryOr(const CRange &R) const;
+	CRange signExtend(uint32_t BitWidth) const;
+	CRange inverse() const;
+
+	void print(llvm::raw_ostream &OS) const {
+		toConstantRange().print(OS);
 	}
 
 	void match(const CRange &R) {
 		if (this->getBitWidth() != R.getBitWidth()) {
-			llvm::dbgs() << "warning: range " << *this << " " 
+			llvm::dbgs() << "warning: range " << *this << " "
 				<< this->getBitWidth() << " and " << R << " "
 				<< R.getBitWidth() << " unmatch\n";
 			*this = this->zextOrTrunc(R.getBitWidth());
@@ -49,4 +235,44 @@ public:
 		return makeFullSet(getBitWidth());
 	}
 
+	friend llvm::raw_ostream &operator<<(llvm::raw_ostream &OS,
+	                                     const CRange &R) {
+		R.print(OS);
+		return OS;
+	}
+
+private:
+	uint32_t Width;
+	uint64_t Lo, Hi;	// [Lo, Hi) if Width <= 64
+	super *Wide;		// otherwise
+
+	CRange(uint32_t BitWidth, uint64_t L, uint64_t H)
+		: Width(BitWidth), Lo(L), Hi(H), Wide(NULL) {}
+
+	void setRange(const super &CR) {
+		if (Width > 64) {
+			Wide = new super(CR);
+			return;
+		}
+		Lo = CR.getLower().getZExtValue();
+		Hi = CR.getUpper().getZExtValue();
+	}
+
+	static uint64_t mask(uint32_t BitWidth) {
+		return BitWidth >= 64 ? ~0ULL : (1ULL << BitWidth) - 1;
+	}
+	uint64_t mask() const { return mask(Width); }
+
+	bool isSmall(const CRange &R) const {
+		return !Wide && Width == R.Width;
+	}
+	// Neither empty, full nor wrapped.
+	bool isPlain() const { return Lo < Hi; }
+
+	// Whether the sum of both set sizes minus one fits in Width bits;
+	// otherwise ConstantRange::add/sub would give a full set.
+	bool fitsSum(const CRange &R) const {
+		uint64_t S = (Hi - Lo) & mask(), T = ((R.Hi - R.Lo) & mask()) - 1;
+		return S + T >= S && S + T <= mask();
+	}
 };
@@ -0,0 +1,124 @@
+// Microbenchmark of the CRange transfer functions used by RangePass,
+// against plain llvm::ConstantRange.  Also checks that both agree.
+//
+//   $ make crange-bench && ./crange-bench [iterations]
+
+#include "CRange.h"
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+using namespace llvm;
+
+namespace {
+
+enum Op { Union, Intersect, Add, Sub, Mul, ZextOrTrunc, NumOps };
+
+const char *OpNames[] = {
+	"unionWith", "intersectWith", "add", "sub", "multiply", "zextOrTrunc",
+};
+
+double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+uint64_t random64() {
+	return ((uint64_t)rand() << 32) ^ ((uint64_t)rand() << 16) ^ rand();
+}
+
+// Mostly small non-wrapped ranges, as RangePass sees them, plus
+// some singletons, empty, full and wrapped sets.
+ConstantRange randomRange(unsigned Width) {
+	uint64_t Mask = Width == 64 ? ~0ULL : (1ULL << Width) - 1;
+	switch (rand() % 16) {
+	case 0:  return ConstantRange(Width, true);
+	case 1:  return ConstantRange(Width, false);
+	case 2:  return ConstantRange(APInt(Width, random64() & Mask));
+	case 3: {
+		uint64_t L = random64() & Mask, H = random64() & Mask;
+		return L == H ? ConstantRange(Width, true)
+		              : ConstantRange(APInt(Width, L), APInt(Width, H));
+	}
+	default: {
+		uint64_t L = (rand() % 4096) & Mask, H = (L + 1 + rand() % 4096) & Mask;
+		if (L == H)
+			return ConstantRange(Width, true);
+		return ConstantRange(APInt(Width, L), APInt(Width, H));
+	}
+	}
+}
+
+template <typename R>
+R apply(Op O, const R &A, const R &B, unsigned Width) {
+	switch (O) {
+	case Union:       return A.unionWith(B);
+	case Intersect:   return A.intersectWith(B);
+	case Add:         return A.add(B);
+	case Sub:         return A.sub(B);
+	case Mul:         return A.multiply(B);
+	case ZextOrTrunc: return A.zextOrTrunc(Width);
+	default:          return A;
+	}
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+	unsigned Iterations = argc > 1 ? atoi(argv[1]) : 200;
+	const unsigned Widths[] = { 8, 16, 32, 64 };
+	const unsigned N = 4096;
+
+	std::vector<ConstantRange> CA, CB;
+	std::vector<CRange> RA, RB;
+	std::vector<unsigned> DstWidths;
+	srand(1);
+	for (unsigned i = 0; i < N; ++i) {
+		unsigned W = Widths[rand() % 4];
+		CA.push_back(randomRange(W));
+		CB.push_back(randomRange(W));
+		RA.push_back(CA.back());
+		RB.push_back(CB.back());
+		DstWidths.push_back(Widths[rand() % 4]);
+	}
+
+	outs() << "operation        ConstantRange(ns)  CRange(ns)  speedup\n";
+	unsigned Mismatches = 0;
+	for (unsigned o = 0; o < NumOps; ++o) {
+		Op O = (Op)o;
+		unsigned Sink = 0;
+
+		double t0 = now();
+		for (unsigned k = 0; k < Iterations; ++k)
+			for (unsigned i = 0; i < N; ++i)
+				Sink += apply(O, CA[i], CB[i], DstWidths[i]).isEmptySet();
+		double t1 = now();
+		for (unsigned k = 0; k < Iterations; ++k)
+			for (unsigned i = 0; i < N; ++i)
+				Sink += apply(O, RA[i], RB[i], DstWidths[i]).isEmptySet();
+		double t2 = now();
+
+		for (unsigned i = 0; i < N; ++i) {
+			ConstantRange Expected = apply(O, CA[i], CB[i], DstWidths[i]);
+			CRange Actual = apply(O, RA[i], RB[i], DstWidths[i]);
+			if (Actual.toConstantRange() != Expected) {
+				if (++Mismatches <= 10)
+					errs() << "mismatch: " << OpNames[o] << " " << CA[i]
+					       << " " << CB[i] << ": " << Actual
+					       << " != " << Expected << "\n";
+			}
+		}
+
+		double Total = (double)Iterations * N;
+		double Slow = (t1 - t0) / Total * 1e9, Fast = (t2 - t1) / Total * 1e9;
+		outs() << format("%-16s %17.1f %11.1f %7.2fx", OpNames[o], Slow, Fast,
+		                 Slow / Fast);
+		outs() << (Sink == ~0U ? " " : "") << "\n";
+	}
+	if (Mismatches)
+		errs() << Mismatches << " mismatches\n";
+	return Mismatches != 0;
+}
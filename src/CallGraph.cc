@@ -48,13 +48,6 @@ CallGraphPass::processInitializers(Module *M, Constant *I, GlobalValue *V) {
 	}
 }
 
-bool CallGraphPass::mergeFuncSet(FuncSet &S, const std::string &Id) {
-	FuncPtrMap::iterator i = Ctx->FuncPtrs.find(Id);
-	if (i != Ctx->FuncPtrs.end())
-		return mergeFuncSet(S, i->second);
-	return false;
-}
-
 bool CallGraphPass::mergeFuncSet(FuncSet &Dst, const FuncSet &Src) {
 	bool Changed = false;
 	for (FuncSet::const_iterator i = Src.begin(), e = Src.end(); i != e; ++i)
@@ -62,85 +55,144 @@ bool CallGraphPass::mergeFuncSet(FuncSet &Dst, const FuncSet &Src) {
 	return Changed;
 }
 
+// FuncPtrs entry of an interned ID, NULL if none and !Create
+FuncSet *CallGraphPass::getFuncPtrs(uint32_t ID, bool Create) {
+	if (FuncPtrSets.size() <= ID)
+		FuncPtrSets.resize(Ctx->IDs.size(), NULL);
+	FuncSet *&FS = FuncPtrSets[ID];
+	if (FS)
+		return FS;
+	const std::string &Id = Ctx->IDs.str(ID);
+	if (Create)
+		FS = &Ctx->FuncPtrs[Id];
+	else {
+		FuncPtrMap::iterator i = Ctx->FuncPtrs.find(Id);
+		if (i != Ctx->FuncPtrs.end())
+			FS = &i->second;
+	}
+	return FS;
+}
+
+uint32_t CallGraphPass::getArgID(Function *F, unsigned No) {
+	uint32_t &ID = ArgIDs[std::make_pair(F, No)];
+	if (!ID)
+		ID = Ctx->IDs.get(getArgId(F, No));
+	return ID;
+}
+
+bool CallGraphPass::resolve(const FuncSource &Src, FuncSet &S) {
+	bool Changed = false;
+	for (unsigned i = 0; i != Src.Funcs.size(); ++i)
+		Changed |= S.insert(Src.Funcs[i]);
+	for (unsigned i = 0; i != Src.IDs.size(); ++i)
+		if (FuncSet *FS = getFuncPtrs(Src.IDs[i], false))
+			Changed |= mergeFuncSet(S, *FS);
+	return Changed;
+}
 
 bool CallGraphPass::findFunctions(Value *V, FuncSet &S) {
+	FuncSource Src;
 	SmallPtrSet<Value *, 4> Visited;
-	return findFunctions(V, S, Visited);
+	findSources(V, Src, Visited);
+	return resolve(Src, S);
 }
 
-bool CallGraphPass::findFunctions(Value *V, FuncSet &S, 
-                                  SmallPtrSet<Value *, 4> Visited) {
+void CallGraphPass::findSources(Value *V, FuncSource &Src,
+                                SmallPtrSet<Value *, 4> Visited) {
 	if (!Visited.insert(V))
-		return false;
+		return;
 
 	// real function, S = S + {F}
 	if (Function *F = dyn_cast<Function>(V)) {
-		if (!F->empty())
-			return S.insert(F);
+		if (!F->empty()) {
+			Src.Funcs.push_back(F);
+			return;
+		}
 
 		// prefer the real definition to declarations
 		FuncMap::iterator it = Ctx->Funcs.find(F->getName());
 		if (it != Ctx->Funcs.end())
-			return S.insert(it->second);
+			Src.Funcs.push_back(it->second);
 		else
-			return S.insert(F);
+			Src.Funcs.push_back(F);
+		return;
 	}
 
 	// bitcast, ignore the cast
 	if (BitCastInst *B = dyn_cast<BitCastInst>(V))
-		return findFunctions(B->getOperand(0), S, Visited);
+		return findSources(B->getOperand(0), Src, Visited);
 	
 	// const bitcast, ignore the cast
 	if (ConstantExpr *C = dyn_cast<ConstantExpr>(V)) {
 		if (C->isCast())
-			return findFunctions(C->getOperand(0), S, Visited);
+			return findSources(C->getOperand(0), Src, Visited);
 	}
 	
 	// PHI node, recursively collect all incoming values
 	if (PHINode *P = dyn_cast<PHINode>(V)) {
-		bool Changed = false;
 		for (unsigned i = 0; i != P->getNumIncomingValues(); ++i)
-			Changed |= findFunctions(P->getIncomingValue(i), S, Visited);
-		return Changed;
+			findSources(P->getIncomingValue(i), Src, Visited);
+		return;
 	}
 	
 	// select, recursively collect both paths
 	if (SelectInst *SI = dyn_cast<SelectInst>(V)) {
-		bool Changed = false;
-		Changed |= findFunctions(SI->getTrueValue(), S, Visited);
-		Changed |= findFunctions(SI->getFalseValue(), S, Visited);
-		return Changed;
+		findSources(SI->getTrueValue(), Src, Visited);
+		findSources(SI->getFalseValue(), Src, Visited);
+		return;
 	}
 	
 	// arguement, S = S + FuncPtrs[arg.ID]
-	if (Argument *A = dyn_cast<Argument>(V))
-		return mergeFuncSet(S, getArgId(A));
+	if (Argument *A = dyn_cast<Argument>(V)) {
+		Src.IDs.push_back(Ctx->IDs.get(getArgId(A)));
+		return;
+	}
 	
 	// return value, S = S + FuncPtrs[ret.ID]
 	if (CallInst *CI = dyn_cast<CallInst>(V)) {
 		if (Function *CF = CI->getCalledFunction())
-			return mergeFuncSet(S, getRetId(CF));
+			Src.IDs.push_back(Ctx->IDs.get(getRetId(CF)));
 
 		// TODO: handle indirect calls
-		return false;
+		return;
 	}
 	
 	// loads, S = S + FuncPtrs[struct.ID]
-	if (LoadInst *L = dyn_cast<LoadInst>(V))
-		return mergeFuncSet(S, getLoadStoreId(L));
+	if (LoadInst *L = dyn_cast<LoadInst>(V)) {
+		if (uint32_t ID = Ctx->IDs.get(getLoadStoreId(L)))
+			Src.IDs.push_back(ID);
+		return;
+	}
 	
 	// ignore other constant (usually null), inline asm and inttoptr
 	if (isa<Constant>(V) || isa<InlineAsm>(V) || isa<IntToPtrInst>(V))
-		return false;
+		return;
 		
 	V->dump();
 	report_fatal_error("findFunctions: unhandled value type\n");
-	return false;
 }
 
-bool CallGraphPass::runOnFunction(Function *F) {
-	bool Changed = false;
+// Ops of a lowered function; a source is encoded as
+// [#funcs, func slot..., #IDs, ID...].
+enum {
+	CG_Store,	// [CG_Store, ID, source]
+	CG_Call,	// [CG_Call, callee source, #args, (arg no, source)...]
+};
 
+void CallGraphPass::lowerSource(Value *V, FactBuilder &B) {
+	FuncSource Src;
+	SmallPtrSet<Value *, 4> Visited;
+	findSources(V, Src, Visited);
+	B.emit(Src.Funcs.size());
+	for (unsigned i = 0; i != Src.Funcs.size(); ++i)
+		B.emit(B.slot(Src.Funcs[i]));
+	B.emit(Src.IDs.size());
+	for (unsigned i = 0; i != Src.IDs.size(); ++i)
+		B.emit(Src.IDs[i]);
+}
+
+void CallGraphPass::lower(Function *F, FactFunction &FF) {
+	FactBuilder B(FF);
 	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 		Instruction *I = &*i;
 		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
@@ -148,15 +200,18 @@ bool CallGraphPass::runOnFunction(Function *F) {
 			Value *V = SI->getValueOperand();
 			if (isFunctionPointer(V->getType())) {
 				StringRef Id = getLoadStoreId(SI);
-				if (!Id.empty())
-					Changed |= findFunctions(V, Ctx->FuncPtrs[Id]);
+				if (!Id.empty()) {
+					B.emit(CG_Store);
+					B.emit(Ctx->IDs.get(Id));
+					lowerSource(V, B);
+				}
 			}
 		} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
 			// function returns
 			if (isFunctionPointer(F->getReturnType())) {
-				Value *V = RI->getReturnValue();
-				std::string Id = getRetId(F);
-				Changed |= findFunctions(V, Ctx->FuncPtrs[Id]);
+				B.emit(CG_Store);
+				B.emit(Ctx->IDs.get(getRetId(F)));
+				lowerSource(RI->getReturnValue(), B);
 			}
 		} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
 			// ignore inline asm or intrinsic calls
@@ -164,30 +219,68 @@ bool CallGraphPass::runOnFunction(Function *F) {
 					&& CI->getCalledFunction()->isIntrinsic()))
 				continue;
 
-			// might be an indirect call, find all possible callees
-			FuncSet FS;
-			if (!findFunctions(CI->getCalledValue(), FS))
+			// looking for function pointer arguments
+			SmallVector<unsigned, 4> Args;
+			for (unsigned no = 0; no != CI->getNumArgOperands(); ++no)
+				if (isFunctionPointer(CI->getArgOperand(no)->getType()))
+					Args.push_back(no);
+			if (Args.empty())
 				continue;
 
-			// looking for function pointer arguments
-			for (unsigned no = 0; no != CI->getNumArgOperands(); ++no) {
-				Value *V = CI->getArgOperand(no);
-				if (!isFunctionPointer(V->getType()))
-					continue;
+			B.emit(CG_Call);
+			lowerSource(CI->getCalledValue(), B);
+			B.emit(Args.size());
+			for (unsigned j = 0; j != Args.size(); ++j) {
+				B.emit(Args[j]);
+				lowerSource(CI->getArgOperand(Args[j]), B);
+			}
+		}
+	}
+}
 
+// S = S + functions of the source at FF.Ops[i]; moves i past it
+bool CallGraphPass::resolve(const FactFunction &FF, unsigned &i, FuncSet &S) {
+	bool Changed = false;
+	for (unsigned n = FF.Ops[i++]; n; --n)
+		Changed |= S.insert(cast<Function>(FF.Slots[FF.Ops[i++]]));
+	for (unsigned n = FF.Ops[i++]; n; --n)
+		if (FuncSet *FS = getFuncPtrs(FF.Ops[i++], false))
+			Changed |= mergeFuncSet(S, *FS);
+	return Changed;
+}
+
+bool CallGraphPass::runOnFacts(const FactFunction &FF) {
+	bool Changed = false;
+
+	for (unsigned i = 0, n = FF.Ops.size(); i < n; ) {
+		switch (FF.Ops[i++]) {
+		case CG_Store: {
+			FuncSet *FS = getFuncPtrs(FF.Ops[i++], true);
+			Changed |= resolve(FF, i, *FS);
+			break;
+		}
+		case CG_Call: {
+			// might be an indirect call, find all possible callees
+			FuncSet FS;
+			bool HasCallees = resolve(FF, i, FS);
+			for (unsigned k = FF.Ops[i++]; k; --k) {
+				unsigned no = FF.Ops[i++];
 				// find all possible assignments to the argument
 				FuncSet VS;
-				if (!findFunctions(V, VS))
+				if (!resolve(FF, i, VS) || !HasCallees)
 					continue;
 
 				// update argument FP-set for possible callees
-				for (FuncSet::iterator k = FS.begin(), ke = FS.end();
-				        k != ke; ++k) {
-					llvm::Function *CF = *k;
-					std::string Id = getArgId(CF, no);
-					Changed |= mergeFuncSet(Ctx->FuncPtrs[Id], VS);
+				for (FuncSet::iterator j = FS.begin(), je = FS.end();
+				        j != je; ++j) {
+					FuncSet *AS = getFuncPtrs(getArgID(*j, no), true);
+					Changed |= mergeFuncSet(*AS, VS);
 				}
 			}
+			break;
+		}
+		default:
+			llvm_unreachable("Unknown call graph op!");
 		}
 	}
 	return Changed;
@@ -214,6 +307,7 @@ bool CallGraphPass::doFinalization(Module *M) {
 	// update callee mapping
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
 		Function *F = &*f;
+		Facts.erase(F);
 		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 			// map callsite to possible callees
 			if (CallInst *CI = dyn_cast<CallInst>(&*i)) {
@@ -226,11 +320,24 @@ bool CallGraphPass::doFinalization(Module *M) {
 }
 
 bool CallGraphPass::doModulePass(Module *M) {
+	// lower functions on first visit
+	std::vector<FactFunction *> FFs;
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i) {
+		if (i->empty())
+			continue;
+		FactMap::iterator it = Facts.find(&*i);
+		if (it == Facts.end()) {
+			it = Facts.insert(std::make_pair(&*i, FactFunction())).first;
+			lower(&*i, it->second);
+		}
+		FFs.push_back(&it->second);
+	}
+
 	bool Changed = true, ret = false;
 	while (Changed) {
 		Changed = false;
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			Changed |= runOnFunction(&*i);
+		for (unsigned i = 0; i != FFs.size(); ++i)
+			Changed |= runOnFacts(*FFs[i]);
 		ret |= Changed;
 	}
 	return ret;
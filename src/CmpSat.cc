@@ -4,14 +4,27 @@
 #include <llvm/Pass.h>
 #include <llvm/ADT/OwningPtr.h>
 #include <llvm/Analysis/Dominators.h>
+#include <llvm/Support/CommandLine.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include "Diagnostic.h"
 #include "PathGen.h"
+#include "SMTPipeline.h"
 #include "ValueGen.h"
+#include <deque>
 
 using namespace llvm;
 
+static cl::opt<PathGen::Encoding>
+PathEncoding("cmp-path-encoding", cl::desc("Path condition encoding of cmpck"),
+             cl::values(
+               clEnumValN(PathGen::Nested, "nested",
+                          "Expand the guards of predecessors"),
+               clEnumValN(PathGen::Linear, "linear",
+                          "One reachability variable per block"),
+               clEnumValEnd),
+             cl::init(PathGen::Nested));
+
 namespace {
 
 typedef const char *CmpStatus;
@@ -33,6 +46,8 @@ struct CmpSat : FunctionPass {
 	}
 
 	virtual bool runOnFunction(Function &F) {
+		if (!Pipeline && SMTPipeline::enabled())
+			Pipeline.reset(new SMTPipeline);
 		DL = &getAnalysis<DataLayout>();
 		DT = &getAnalysis<DominatorTree>();
 		FindFunctionBackedges(F, Backedges);
@@ -42,17 +57,35 @@ struct CmpSat : FunctionPass {
 				continue;
 			check(BI);
 		}
+		if (Pipeline)
+			drain(0);
 		Backedges.clear();
 		return false;
 	}
 
+	virtual bool doFinalization(Module &) {
+		Pipeline.reset();
+		return false;
+	}
+
 private:
 	Diagnostic Diag;
 	DataLayout *DL;
 	DominatorTree *DT;
 	SmallVector<PathGen::Edge, 32> Backedges;
 
+	// With -smt-threads, both queries of a branch are solved on other
+	// threads; results are reported in program order.
+	struct Pending {
+		BranchInst *I;
+		unsigned IfFalse, IfTrue;
+	};
+	OwningPtr<SMTPipeline> Pipeline;
+	std::deque<Pending> InFlight;
+
 	void check(BranchInst *);
+	void drain(size_t Keep);
+	void report(BranchInst *, CmpStatus);
 };
 
 } // anonymous namespace
@@ -60,28 +93,57 @@ private:
 void CmpSat::check(BranchInst *I) {
 	BasicBlock *BB = I->getParent();
 	Value *V = I->getCondition();
-	SMTSolver SMT(false);
+	OwningPtr<SMTSolver> Solver(SMTSolver::create(false));
+	SMTSolver &SMT = *Solver;
 	ValueGen VG(*DL, SMT);
-	PathGen PG(VG, Backedges, *DT);
-	SMTExpr ValuePred = VG.get(V);
-	SMTExpr PathPred = PG.get(BB);
-	SMTExpr Query = SMT.bvand(ValuePred, PathPred);
-	SMTStatus Status = SMT.query(Query);
-	SMT.decref(Query);
+	PathGen PG(VG, Backedges, *DT, PathEncoding);
+	SMTNode *IfFalse = VG.DAG.bvfalse(), *IfTrue = VG.DAG.bvfalse();
+	for (unsigned n = 0, e = PG.iterations(BB); n != e; ++n) {
+		SMTNode *ValuePred = VG.get(V, BB, n);
+		SMTNode *PathPred = PG.slice(PG.get(BB, n), ValuePred);
+		SMTNode *NotValuePred = VG.DAG.bvnot(ValuePred);
+		IfFalse = VG.DAG.bvor(IfFalse, VG.DAG.bvand(ValuePred, PathPred));
+		IfTrue = VG.DAG.bvor(IfTrue, VG.DAG.bvand(NotValuePred, PathPred));
+	}
+	if (Pipeline) {
+		std::string FalseText, TrueText;
+		SMT.serialize(VG.DAG.lower(IfFalse), FalseText);
+		SMT.serialize(VG.DAG.lower(IfTrue), TrueText);
+		Pending P = { I, Pipeline->submit(FalseText),
+		              Pipeline->submit(TrueText) };
+		InFlight.push_back(P);
+		drain(2 * Pipeline->threads());
+		return;
+	}
 	CmpStatus Reason = 0;
-	if (Status == SMT_UNSAT) {
+	if (SMT.query(VG.DAG.lower(IfFalse)) == SMT_UNSAT)
 		Reason = CMP_FALSE;
-	} else {
-		SMTExpr NotValuePred = SMT.bvnot(ValuePred);
-		Query = SMT.bvand(NotValuePred, PathPred);
-		Status = SMT.query(Query);
-		SMT.decref(Query);
-		SMT.decref(NotValuePred);
-		if (Status == SMT_UNSAT)
-			Reason = CMP_TRUE;
+	else if (SMT.query(VG.DAG.lower(IfTrue)) == SMT_UNSAT)
+		Reason = CMP_TRUE;
+	if (Reason)
+		report(I, Reason);
+}
+
+// Report finished branches in order, waiting until at most Keep are
+// left in flight.
+void CmpSat::drain(size_t Keep) {
+	while (!InFlight.empty()) {
+		Pending &P = InFlight.front();
+		if (InFlight.size() <= Keep && !(Pipeline->done(P.IfFalse)
+		                                 && Pipeline->done(P.IfTrue)))
+			break;
+		// claim both tickets, even if the first decides
+		SMTStatus FalseStatus = Pipeline->wait(P.IfFalse);
+		SMTStatus TrueStatus = Pipeline->wait(P.IfTrue);
+		if (FalseStatus == SMT_UNSAT)
+			report(P.I, CMP_FALSE);
+		else if (TrueStatus == SMT_UNSAT)
+			report(P.I, CMP_TRUE);
+		InFlight.pop_front();
 	}
-	if (!Reason)
-		return;
+}
+
+void CmpSat::report(BranchInst *I, CmpStatus Reason) {
 	Diag.bug(Reason);
 	Diag.backtrace(I);
 }
@@ -0,0 +1,171 @@
+#define DEBUG_TYPE "demand"
+#include <llvm/Pass.h>
+#include <llvm/Instructions.h>
+#include <llvm/Support/Debug.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Module.h>
+#include <llvm/Constants.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+
+#include "Annotation.h"
+#include "IntGlobal.h"
+
+using namespace llvm;
+
+// Collect the IDs V depends on within its function: the IDs of loads,
+// arguments and calls reached backward through operands.  Calls do not
+// look at their arguments, just as TaintPass and RangePass do not.
+void DemandPass::trace(Value *V, std::vector<uint32_t> &IDs)
+{
+	SmallPtrSet<Value *, 16> Visited;
+	SmallVector<Value *, 16> Worklist;
+	Worklist.push_back(V);
+	while (!Worklist.empty()) {
+		Value *V = Worklist.pop_back_val();
+		if (!(isa<Instruction>(V) || isa<Argument>(V)) || !Visited.insert(V))
+			continue;
+		if (uint32_t ID = Ctx->IDs.get(getValueId(V)))
+			IDs.push_back(ID);
+		if (CallInst *CI = dyn_cast<CallInst>(V)) {
+			CalleeMap::iterator ci = Ctx->Callees.find(CI);
+			if (CI->isInlineAsm() || ci == Ctx->Callees.end())
+				continue;
+			FuncSet &CEEs = ci->second;
+			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
+				 i != e; ++i)
+				IDs.push_back(Ctx->IDs.get(getRetId(*i)));
+			continue;
+		}
+		if (Instruction *I = dyn_cast<Instruction>(V))
+			for (unsigned i = 0; i < I->getNumOperands(); ++i)
+				Worklist.push_back(I->getOperand(i));
+	}
+}
+
+void DemandPass::addDeps(StringRef ID, Value *V)
+{
+	uint32_t To = Ctx->IDs.get(ID);
+	if (!To)
+		return;
+	std::vector<uint32_t> IDs;
+	trace(V, IDs);
+	if (Deps.size() < Ctx->IDs.size())
+		Deps.resize(Ctx->IDs.size());
+	Deps[To].insert(Deps[To].end(), IDs.begin(), IDs.end());
+}
+
+void DemandPass::addSeed(Value *V)
+{
+	if (isa<Constant>(V))
+		return;
+	trace(V, Seeds);
+}
+
+void DemandPass::runOnFunction(Function *F)
+{
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		Instruction *I = &*i;
+
+		// operands of the checks IntRewrite and IntLibcalls insert
+		switch (I->getOpcode()) {
+		default: break;
+		case Instruction::Add:
+		case Instruction::Sub:
+		case Instruction::Mul:
+		case Instruction::SDiv:
+		case Instruction::UDiv:
+		case Instruction::Shl:
+		case Instruction::LShr:
+		case Instruction::AShr:
+			addSeed(I->getOperand(0));
+			addSeed(I->getOperand(1));
+			break;
+		case Instruction::GetElementPtr: {
+			GetElementPtrInst *GEP = cast<GetElementPtrInst>(I);
+			for (User::op_iterator j = GEP->idx_begin(), je = GEP->idx_end();
+				 j != je; ++j)
+				addSeed(*j);
+			break;
+		}
+		}
+
+		// flows into global IDs, as in TaintPass and RangePass
+		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+			addDeps(getValueId(SI), SI);
+		} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
+			if (RI->getReturnValue())
+				addDeps(getRetId(F), RI);
+		} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+			// sizes of library calls (conservatively, integer
+			// arguments of any call to a declaration)
+			Function *CF = CI->getCalledFunction();
+			if (CF && CF->empty()) {
+				addSeed(CI);
+				for (unsigned j = 0; j < CI->getNumArgOperands(); ++j)
+					if (CI->getArgOperand(j)->getType()->isIntegerTy())
+						addSeed(CI->getArgOperand(j));
+			}
+
+			CalleeMap::iterator ci = Ctx->Callees.find(CI);
+			if (CI->isInlineAsm() || ci == Ctx->Callees.end())
+				continue;
+			// range of the call site is that of all callees
+			addDeps(getRetId(CI), CI);
+			FuncSet &CEEs = ci->second;
+			for (FuncSet::iterator j = CEEs.begin(), je = CEEs.end();
+				 j != je; ++j) {
+				if ((*j)->isVarArg()
+					|| (*j)->getName().find('.') != StringRef::npos)
+					continue;
+				for (unsigned a = 0; a < CI->getNumArgOperands(); ++a)
+					addDeps(getArgId(*j, a), CI->getArgOperand(a));
+			}
+		}
+	}
+}
+
+bool DemandPass::doInitialization(Module *M)
+{
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
+		if (!i->empty())
+			runOnFunction(&*i);
+	return true;
+}
+
+void DemandPass::run(ModuleList &modules)
+{
+	IterativeModulePass::run(modules);
+
+	// backward closure from the seeds
+	std::vector<bool> Demanded(Ctx->IDs.size());
+	std::vector<uint32_t> Worklist;
+	Deps.resize(Ctx->IDs.size());
+	for (unsigned i = 0; i != Seeds.size(); ++i) {
+		if (!Demanded[Seeds[i]]) {
+			Demanded[Seeds[i]] = true;
+			Worklist.push_back(Seeds[i]);
+		}
+	}
+	while (!Worklist.empty()) {
+		uint32_t ID = Worklist.back();
+		Worklist.pop_back();
+		std::vector<uint32_t> &D = Deps[ID];
+		for (unsigned i = 0; i != D.size(); ++i) {
+			if (!Demanded[D[i]]) {
+				Demanded[D[i]] = true;
+				Worklist.push_back(D[i]);
+			}
+		}
+	}
+
+	for (uint32_t ID = 1; ID < Demanded.size(); ++ID)
+		if (Demanded[ID])
+			Ctx->DemandedIDs.insert(Ctx->IDs.str(ID));
+	Ctx->DemandDriven = true;
+	DEBUG(dbgs() << "[" << this->ID << "] " << Ctx->DemandedIDs.size()
+	             << " of " << Ctx->IDs.size() - 1 << " IDs demanded\n");
+
+	Deps.clear();
+	Seeds.clear();
+}
@@ -12,7 +12,7 @@
 
 using namespace llvm;
 
-Diagnostic::Diagnostic() : OS(errs()) {}
+Diagnostic::Diagnostic() : OS(&errs()) {}
 
 static void getPath(SmallVectorImpl<char> &Path, const MDNode *MD) {
 	StringRef Filename = DIScope(MD).getFilename();
@@ -27,12 +27,12 @@ void Diagnostic::backtrace(Instruction *I) {
 	MDNode *MD = I->getDebugLoc().getAsMDNode(I->getContext());
 	if (!MD)
 		return;
-	OS << "stack: \n";
+	*OS << "stack: \n";
 	DILocation Loc(MD);
 	for (;;) {
 		SmallString<64> Path;
 		getPath(Path, Loc.getScope());
-		OS << Prefix << Path
+		*OS << Prefix << Path
 		   << ':' << Loc.getLineNumber()
 		   << ':' << Loc.getColumnNumber() << '\n';
 		Loc = Loc.getOrigLocation();
@@ -42,7 +42,7 @@ void Diagnostic::backtrace(Instruction *I) {
 }
 
 void Diagnostic::bug(const Twine &Str) {
-	OS << "---\n" << "bug: " << Str << "\n";
+	*OS << "---\n" << "bug: " << Str << "\n";
 }
 
 void Diagnostic::classify(Value *V) {
@@ -52,11 +52,11 @@ void Diagnostic::classify(Value *V) {
 
 	if (MDNode *MD = I->getMetadata("taint")) {
 		StringRef s = dyn_cast<MDString>(MD->getOperand(0))->getString();
-		OS << "taint: " << s << "\n";
+		*OS << "taint: " << s << "\n";
 	}
 	if (MDNode *MD = I->getMetadata("sink")) {
 		StringRef s = dyn_cast<MDString>(MD->getOperand(0))->getString();
-		OS << "sink: " << s << "\n";
+		*OS << "sink: " << s << "\n";
 	}
 }
 
@@ -68,5 +68,5 @@ void Diagnostic::status(int Status) {
 	case SMT_SAT:     Str = "sat";     break;
 	default:          Str = "timeout"; break;
 	}
-	OS << "status: " << Str << "\n";
+	*OS << "status: " << Str << "\n";
 }
@@ -12,7 +12,9 @@ class Diagnostic {
 public:
 	Diagnostic();
 
-	llvm::raw_ostream &os() { return OS; }
+	llvm::raw_ostream &os() { return *OS; }
+	// Write to another stream, e.g., to keep the output.
+	void redirect(llvm::raw_ostream &Out) { OS = &Out; }
 
 	void bug(const llvm::Twine &);
 	void classify(llvm::Value *);
@@ -22,10 +24,10 @@ public:
 
 	template <typename T> Diagnostic &
 	operator <<(const T &Val) {
-		OS << Val;
+		*OS << Val;
 		return *this;
 	}
 
 private:
-	llvm::raw_ostream &OS;
+	llvm::raw_ostream *OS;
 };
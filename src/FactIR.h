@@ -0,0 +1,73 @@
+#pragma once
+
+#include <llvm/Value.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringRef.h>
+#include <string>
+#include <vector>
+
+#include "MemAcct.h"
+
+// Compact per-function facts for the iterative global passes.
+//
+// A pass lowers each function once into a flat stream of only the
+// operations it cares about (the encoding is up to the pass).  Operands
+// are indices into the function's value slots and global IDs are
+// interned, so the sweeps neither walk LLVM IR nor build ID strings.
+
+// Interned global IDs; 0 is the empty ID.
+class FactIDs {
+public:
+	FactIDs() : Strs(1) {}
+
+	uint32_t get(llvm::StringRef ID) {
+		if (ID.empty())
+			return 0;
+		llvm::StringMapEntry<uint32_t> &E = Map.GetOrCreateValue(ID, 0);
+		if (!E.getValue()) {
+			E.setValue(Strs.size());
+			Strs.push_back(ID);
+		}
+		return E.getValue();
+	}
+	const std::string &str(uint32_t ID) const { return Strs[ID]; }
+	uint32_t size() const { return Strs.size(); }
+
+	// heap bytes, roughly: each ID is stored twice
+	size_t getMemorySize() const {
+		size_t n = MemAcct::bytesOf(Strs)
+		           + Map.getNumBuckets() * 2 * sizeof(void *);
+		for (unsigned i = 1; i < Strs.size(); ++i)
+			n += sizeof(llvm::StringMapEntry<uint32_t>) + Strs[i].size() + 1;
+		return n;
+	}
+
+private:
+	std::vector<std::string> Strs;
+	llvm::StringMap<uint32_t> Map;
+};
+
+struct FactFunction {
+	std::vector<llvm::Value *> Slots;	// slot -> value
+	std::vector<uint32_t> Ops;		// op stream
+};
+
+class FactBuilder {
+public:
+	FactBuilder(FactFunction &FF_) : FF(FF_) {}
+
+	uint32_t slot(llvm::Value *V) {
+		std::pair<llvm::DenseMap<llvm::Value *, uint32_t>::iterator, bool>
+			R = Map.insert(std::make_pair(V, (uint32_t)FF.Slots.size()));
+		if (R.second)
+			FF.Slots.push_back(V);
+		return R.first->second;
+	}
+	bool hasSlot(llvm::Value *V) const { return Map.count(V); }
+	void emit(uint32_t X) { FF.Ops.push_back(X); }
+
+private:
+	FactFunction &FF;
+	llvm::DenseMap<llvm::Value *, uint32_t> Map;
+};
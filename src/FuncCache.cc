@@ -0,0 +1,202 @@
+#include "FuncCache.h"
+#include <llvm/Constants.h>
+#include <llvm/DebugInfo.h>
+#include <llvm/Function.h>
+#include <llvm/Instructions.h>
+#include <llvm/LLVMContext.h>
+#include <llvm/Metadata.h>
+#include <llvm/DerivedTypes.h>
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+FuncCacheDir("int-cache",
+             cl::desc("Reuse reports of identical functions from a directory"),
+             cl::value_desc("directory"));
+
+static StringMap<std::string> Entries;
+
+bool FuncCache::enabled() {
+	return !FuncCacheDir.empty();
+}
+
+// Metadata by contents, not by number; deep nodes, such as debug info
+// scopes, are cut off.
+static void printMD(raw_ostream &OS, MDNode *MD, unsigned Depth) {
+	OS << "!{";
+	for (unsigned i = 0, n = MD->getNumOperands(); i != n; ++i) {
+		Value *V = MD->getOperand(i);
+		if (i)
+			OS << ", ";
+		if (!V)
+			OS << "null";
+		else if (MDString *S = dyn_cast<MDString>(V))
+			OS << '"' << S->getString() << '"';
+		else if (ConstantInt *CI = dyn_cast<ConstantInt>(V))
+			OS << CI->getValue();
+		else if (MDNode *N = dyn_cast<MDNode>(V)) {
+			if (Depth)
+				printMD(OS, N, Depth - 1);
+			else
+				OS << "!{...}";
+		} else
+			OS << '?';
+	}
+	OS << '}';
+}
+
+// The stack Diagnostic::backtrace() prints.
+static void printLoc(raw_ostream &OS, Instruction *I) {
+	MDNode *MD = I->getDebugLoc().getAsMDNode(I->getContext());
+	if (!MD)
+		return;
+	DILocation Loc(MD);
+	for (;;) {
+		DIScope Scope(Loc.getScope());
+		OS << ' ' << Scope.getDirectory() << '/' << Scope.getFilename()
+		   << ':' << Loc.getLineNumber() << ':' << Loc.getColumnNumber();
+		Loc = Loc.getOrigLocation();
+		if (!Loc.Verify())
+			break;
+	}
+}
+
+// Named structs the function reaches through its types, in order of
+// first occurrence.
+static void collectStructs(Type *T, SmallPtrSet<Type *, 32> &Visited,
+                           SmallVectorImpl<StructType *> &Structs) {
+	if (!Visited.insert(T))
+		return;
+	if (StructType *ST = dyn_cast<StructType>(T))
+		if (!ST->isLiteral())
+			Structs.push_back(ST);
+	for (Type::subtype_iterator i = T->subtype_begin(),
+	     e = T->subtype_end(); i != e; ++i)
+		collectStructs(*i, Visited, Structs);
+}
+
+std::string FuncCache::key(Function &F, StringRef Config) {
+	std::string IR, Key = Config.str() + "\n";
+	{
+		raw_string_ostream OS(IR);
+		F.print(OS);
+	}
+	// Drop metadata numbers, which differ across modules.
+	for (size_t i = 0, n = IR.size(); i != n; ++i) {
+		Key += IR[i];
+		if (IR[i] == '!')
+			while (i + 1 != n && isdigit((unsigned char)IR[i + 1]))
+				++i;
+	}
+	// Add the metadata as contents, instruction by instruction.
+	raw_string_ostream OS(Key);
+	SmallVector<StringRef, 16> Kinds;
+	F.getContext().getMDKindNames(Kinds);
+	unsigned N = 0;
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i, ++N) {
+		SmallVector<std::pair<unsigned, MDNode *>, 4> MDs;
+		i->getAllMetadataOtherThanDebugLoc(MDs);
+		if (MDs.empty() && i->getDebugLoc().isUnknown())
+			continue;
+		OS << N << ':';
+		printLoc(OS, &*i);
+		for (unsigned k = 0; k != MDs.size(); ++k) {
+			OS << " !" << Kinds[MDs[k].first] << ' ';
+			printMD(OS, MDs[k].second, 3);
+		}
+		OS << '\n';
+	}
+	// The IR names structs but not their bodies, which other modules
+	// may define differently; with the data layout in Config, the
+	// bodies fix sizes and offsets.
+	SmallPtrSet<Type *, 32> Visited;
+	SmallVector<StructType *, 16> Structs;
+	collectStructs(F.getType(), Visited, Structs);
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		collectStructs(i->getType(), Visited, Structs);
+		for (unsigned k = 0, n = i->getNumOperands(); k != n; ++k)
+			collectStructs(i->getOperand(k)->getType(), Visited, Structs);
+	}
+	for (unsigned k = 0; k != Structs.size(); ++k) {
+		StructType *ST = Structs[k];
+		OS << '%' << ST->getName() << " =";
+		if (ST->isOpaque()) {
+			OS << " opaque\n";
+			continue;
+		}
+		OS << (ST->isPacked() ? " <{" : " {");
+		for (unsigned j = 0, n = ST->getNumElements(); j != n; ++j)
+			OS << (j ? ", " : " ") << *ST->getElementType(j);
+		OS << (ST->isPacked() ? " }>\n" : " }\n");
+	}
+	OS.flush();
+	return Key;
+}
+
+// 64-bit FNV-1a; entries keep the key against collisions.
+static std::string path(const std::string &Key) {
+	uint64_t H = 14695981039346656037ULL;
+	for (size_t i = 0; i != Key.size(); ++i) {
+		H ^= (unsigned char)Key[i];
+		H *= 1099511628211ULL;
+	}
+	char Hash[17];
+	snprintf(Hash, sizeof(Hash), "%016llx", (unsigned long long)H);
+	return FuncCacheDir + "/" + std::string(Hash, 2) + "/" + (Hash + 2);
+}
+
+// A file holds the length of the key, the key and the report.
+bool FuncCache::lookup(const std::string &Key, std::string &Report) {
+	StringMap<std::string>::iterator i = Entries.find(Key);
+	if (i != Entries.end()) {
+		Report = i->second;
+		return true;
+	}
+	OwningPtr<MemoryBuffer> MB;
+	if (MemoryBuffer::getFile(path(Key), MB))
+		return false;
+	StringRef Len, Rest;
+	tie(Len, Rest) = MB->getBuffer().split('\n');
+	size_t n;
+	if (Len.getAsInteger(10, n) || Rest.size() < n
+	    || Rest.substr(0, n) != Key)
+		return false;
+	Report = Rest.substr(n);
+	Entries[Key] = Report;
+	return true;
+}
+
+// Write a temporary file and rename it, as -smt-cache does.
+void FuncCache::store(const std::string &Key, const std::string &Report) {
+	Entries[Key] = Report;
+	std::string Path = path(Key);
+	bool Existed;
+	if (sys::fs::create_directories(sys::path::parent_path(Path), Existed))
+		return;
+	std::string Tmp = Path + ".tmp" + utostr(getpid());
+	{
+		std::string Err;
+		raw_fd_ostream OS(Tmp.c_str(), Err, raw_fd_ostream::F_Binary);
+		if (!Err.empty())
+			return;
+		OS << Key.size() << '\n' << Key << Report;
+	}
+	if (rename(Tmp.c_str(), Path.c_str()))
+		unlink(Tmp.c_str());
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <string>
+
+namespace llvm {
+	class Function;
+} // namespace llvm
+
+// Reports of intck per function (-int-cache=<dir>), so that copies of
+// a function, e.g., static inline helpers from shared headers, are
+// checked once.  The key is the function's IR with the contents of
+// the metadata the checks depend on (ranges, taint, bug types, debug
+// locations) instead of module-local metadata numbers, and the bodies
+// of the named structs it uses.  Entries are
+// kept in memory for the run and in the directory across runs.
+
+class FuncCache {
+public:
+	static bool enabled();
+
+	// Config names whatever else decides the reports, e.g., options.
+	static std::string key(llvm::Function &, llvm::StringRef Config);
+	static bool lookup(const std::string &Key, std::string &Report);
+	static void store(const std::string &Key, const std::string &Report);
+};
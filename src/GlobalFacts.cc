@@ -0,0 +1,168 @@
+#define DEBUG_TYPE "global-facts"
+#include <llvm/Constants.h>
+#include <llvm/Instructions.h>
+#include <llvm/Metadata.h>
+#include <llvm/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/InstIterator.h>
+#include <llvm/Support/raw_ostream.h>
+#include <set>
+
+#include "Annotation.h"
+#include "GlobalIndex.h"
+
+using namespace llvm;
+
+static cl::opt<std::string>
+IndexFilename("global-index",
+              cl::desc("Attach global ranges and taint from an intglobal index"),
+              cl::value_desc("filename"));
+
+namespace {
+
+// Attach the facts computed by intglobal (see GlobalIndex.h) as
+// intrange/taint metadata, just as intglobal's writeback would.
+struct GlobalFacts : ModulePass {
+	static char ID;
+	GlobalFacts() : ModulePass(ID) {}
+
+	virtual void getAnalysisUsage(AnalysisUsage &AU) const {
+		AU.setPreservesCFG();
+	}
+
+	virtual bool runOnModule(Module &);
+
+private:
+	typedef std::set<std::string> TaintSet;
+	typedef DenseMap<Value *, TaintSet> ValueTaintMap;
+
+	GlobalIndex Index;
+	ValueTaintMap VTS;
+
+	void attachRange(Instruction *);
+	TaintSet *getTaint(Value *);
+	bool propagateTaint(Instruction *);
+	void runOnFunction(Function &);
+};
+
+} // anonymous namespace
+
+bool GlobalFacts::runOnModule(Module &M) {
+	if (IndexFilename.empty())
+		return false;
+	if (!Index.isOpen()) {
+		std::string Err;
+		if (!Index.open(IndexFilename, Err)) {
+			errs() << "Cannot open index " << IndexFilename << ": "
+			       << Err << "\n";
+			return false;
+		}
+	}
+
+	// Annotation is idempotent; the input may not have been written
+	// back by intglobal.
+	AnnotationPass Anno;
+	Anno.doInitialization(M);
+	for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i)
+		Anno.runOnFunction(*i);
+
+	for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i)
+		runOnFunction(*i);
+	return true;
+}
+
+void GlobalFacts::attachRange(Instruction *I) {
+	I->setMetadata("intrange", NULL);
+	const GlobalIndexEntry *E = Index.lookup(getValueId(I));
+	if (!E || !(E->Flags & GlobalIndexEntry::HasRange))
+		return;
+	IntegerType *T = IntegerType::get(I->getContext(), E->Width);
+	Value *RL[] = {
+		ConstantInt::get(T, E->Lo),
+		ConstantInt::get(T, E->Hi),
+	};
+	I->setMetadata("intrange", MDNode::get(I->getContext(), RL));
+}
+
+// Local taint, falling back to the global taint of arguments,
+// loads and calls.  Mirrors TaintPass::getTaint.
+GlobalFacts::TaintSet *GlobalFacts::getTaint(Value *V) {
+	ValueTaintMap::iterator i = VTS.find(V);
+	if (i == VTS.end())
+		i = VTS.find(V->stripPointerCasts());
+	if (i != VTS.end())
+		return &i->second;
+
+	const GlobalIndexEntry *E = Index.lookup(getValueId(V));
+	if (!E || !(E->Flags & GlobalIndexEntry::Tainted))
+		return NULL;
+	// the index keeps the sources joined as in the metadata
+	TaintSet &TS = VTS[V];
+	StringRef Srcs = Index.getString(E->Taint);
+	while (!Srcs.empty()) {
+		std::pair<StringRef, StringRef> P = Srcs.split(", ");
+		TS.insert(P.first);
+		Srcs = P.second;
+	}
+	return &TS;
+}
+
+bool GlobalFacts::propagateTaint(Instruction *I) {
+	TaintSet D;
+	if (MDNode *MD = I->getMetadata(MD_TaintSrc)) {
+		if (MDString *S = dyn_cast_or_null<MDString>(MD->getOperand(0)))
+			D.insert(S->getString());
+	}
+	// taint flows into calls through arguments, not out of them
+	if (!isa<CallInst>(I)) {
+		for (unsigned j = 0; j < I->getNumOperands(); ++j)
+			if (TaintSet *TS = getTaint(I->getOperand(j)))
+				D.insert(TS->begin(), TS->end());
+	}
+	if (D.empty())
+		return false;
+	TaintSet &TS = VTS[I];
+	size_t n = TS.size();
+	TS.insert(D.begin(), D.end());
+	return TS.size() != n;
+}
+
+void GlobalFacts::runOnFunction(Function &F) {
+	VTS.clear();
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		Instruction *I = &*i;
+		if (isa<LoadInst>(I) || isa<CallInst>(I))
+			attachRange(I);
+	}
+
+	bool Changed = true;
+	while (Changed) {
+		Changed = false;
+		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)
+			Changed |= propagateTaint(&*i);
+	}
+
+	LLVMContext &C = F.getContext();
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		Instruction *I = &*i;
+		TaintSet *TS = getTaint(I);
+		if (!TS) {
+			I->setMetadata(MD_Taint, NULL);
+			continue;
+		}
+		std::string s;
+		for (TaintSet::iterator j = TS->begin(), je = TS->end(); j != je; ++j) {
+			if (j != TS->begin())
+				s += ", ";
+			s += *j;
+		}
+		I->setMetadata(MD_Taint, MDNode::get(C, MDString::get(C, s)));
+	}
+}
+
+char GlobalFacts::ID;
+
+static RegisterPass<GlobalFacts>
+X("global-facts", "Attach global ranges and taint from an intglobal index");
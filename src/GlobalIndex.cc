@@ -0,0 +1,167 @@
+#include "GlobalIndex.h"
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/raw_ostream.h>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace llvm;
+
+namespace {
+
+struct GlobalIndexHeader {
+	char Magic[8];
+	uint64_t NumEntries;
+	uint64_t StrtabOffset;
+};
+
+class StringTable {
+public:
+	StringTable() : Data(1, '\0') {}
+	uint32_t add(StringRef S) {
+		if (S.empty())
+			return 0;
+		StringMap<uint32_t>::iterator i = Offsets.find(S);
+		if (i != Offsets.end())
+			return i->second;
+		uint32_t Off = Data.size();
+		Data.append(S.begin(), S.end());
+		Data.push_back('\0');
+		Offsets[S] = Off;
+		return Off;
+	}
+	const std::string &str() const { return Data; }
+private:
+	std::string Data;
+	StringMap<uint32_t> Offsets;
+};
+
+} // anonymous namespace
+
+void GlobalIndexWriter::addRange(const std::string &ID, const APInt &Lo,
+                                 const APInt &Hi) {
+	unsigned Width = Lo.getBitWidth();
+	if (Width > 64)
+		return;
+	Fact &F = Facts[ID];
+	F.Flags |= GlobalIndexEntry::HasRange;
+	F.Width = Width;
+	F.Lo = Lo.getZExtValue();
+	F.Hi = Hi.getZExtValue();
+}
+
+void GlobalIndexWriter::addTaint(const std::string &ID, StringRef Desc,
+                                 bool Source) {
+	Fact &F = Facts[ID];
+	F.Flags |= GlobalIndexEntry::Tainted;
+	if (Source)
+		F.Flags |= GlobalIndexEntry::Source;
+	F.Taint = Desc;
+}
+
+bool GlobalIndexWriter::write(StringRef Path, std::string &Err) {
+	StringTable Strtab;
+	std::vector<GlobalIndexEntry> Entries;
+	Entries.reserve(Facts.size());
+	// std::map keeps IDs sorted, which is what lookup() expects.
+	for (std::map<std::string, Fact>::iterator i = Facts.begin(),
+			e = Facts.end(); i != e; ++i) {
+		GlobalIndexEntry E;
+		E.ID = Strtab.add(i->first);
+		E.Taint = Strtab.add(i->second.Taint);
+		E.Flags = i->second.Flags;
+		E.Width = i->second.Width;
+		E.Lo = i->second.Lo;
+		E.Hi = i->second.Hi;
+		Entries.push_back(E);
+	}
+
+	GlobalIndexHeader H;
+	memcpy(H.Magic, GLOBAL_INDEX_MAGIC, sizeof(H.Magic));
+	H.NumEntries = Entries.size();
+	H.StrtabOffset = sizeof(H) + Entries.size() * sizeof(GlobalIndexEntry);
+
+	// Write to a temporary file and rename, so that readers never
+	// map a partially written index.
+	std::string Tmp = Path.str() + ".tmp";
+	raw_fd_ostream OS(Tmp.c_str(), Err, raw_fd_ostream::F_Binary);
+	if (!Err.empty())
+		return false;
+	OS.write((const char *)&H, sizeof(H));
+	if (!Entries.empty())
+		OS.write((const char *)&Entries[0],
+		         Entries.size() * sizeof(GlobalIndexEntry));
+	OS << Strtab.str();
+	OS.close();
+	if (OS.has_error()) {
+		OS.clear_error();
+		Err = "write error";
+		return false;
+	}
+	if (::rename(Tmp.c_str(), Path.str().c_str())) {
+		Err = strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+GlobalIndex::~GlobalIndex() {
+	if (Base)
+		::munmap((void *)Base, Size);
+}
+
+bool GlobalIndex::open(StringRef Path, std::string &Err) {
+	int fd = ::open(Path.str().c_str(), O_RDONLY);
+	if (fd < 0) {
+		Err = strerror(errno);
+		return false;
+	}
+	struct stat st;
+	if (::fstat(fd, &st) || (size_t)st.st_size < sizeof(GlobalIndexHeader)) {
+		::close(fd);
+		Err = "truncated index";
+		return false;
+	}
+	void *P = ::mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (P == MAP_FAILED) {
+		Err = strerror(errno);
+		return false;
+	}
+	const GlobalIndexHeader *H = (const GlobalIndexHeader *)P;
+	if (memcmp(H->Magic, GLOBAL_INDEX_MAGIC, sizeof(H->Magic))
+	    || H->StrtabOffset > (uint64_t)st.st_size
+	    || H->StrtabOffset != sizeof(*H)
+	                          + H->NumEntries * sizeof(GlobalIndexEntry)) {
+		::munmap(P, st.st_size);
+		Err = "bad index format";
+		return false;
+	}
+	Base = (const char *)P;
+	Size = st.st_size;
+	Entries = (const GlobalIndexEntry *)(Base + sizeof(*H));
+	NumEntries = H->NumEntries;
+	Strtab = Base + H->StrtabOffset;
+	return true;
+}
+
+const GlobalIndexEntry *GlobalIndex::lookup(StringRef ID) const {
+	if (!Base || ID.empty())
+		return NULL;
+	uint64_t Lo = 0, Hi = NumEntries;
+	while (Lo < Hi) {
+		uint64_t Mid = Lo + (Hi - Lo) / 2;
+		int Cmp = getString(Entries[Mid].ID).compare(ID);
+		if (Cmp == 0)
+			return &Entries[Mid];
+		if (Cmp < 0)
+			Lo = Mid + 1;
+		else
+			Hi = Mid;
+	}
+	return NULL;
+}
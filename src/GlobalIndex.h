@@ -0,0 +1,68 @@
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <map>
+#include <string>
+
+// Read-only index of global facts (ranges, taint) keyed by global ID,
+// written by intglobal and mapped by intck.
+//
+// Layout (native byte order):
+//   header   magic, number of entries, offset of the string table
+//   entries  sorted by ID
+//   strtab   NUL-terminated strings, offset 0 is ""
+
+#define GLOBAL_INDEX_MAGIC "KINTIDX1"
+
+struct GlobalIndexEntry {
+	enum {
+		HasRange = 1,
+		Tainted  = 2,
+		Source   = 4,
+	};
+	uint32_t ID;	// string table offset
+	uint32_t Taint;	// taint descriptors, joined by ", "
+	uint32_t Flags;
+	uint32_t Width;
+	uint64_t Lo, Hi;	// range [Lo, Hi), valid if HasRange
+};
+
+class GlobalIndexWriter {
+public:
+	void addRange(const std::string &ID, const llvm::APInt &Lo,
+	              const llvm::APInt &Hi);
+	void addTaint(const std::string &ID, llvm::StringRef Desc, bool Source);
+	bool write(llvm::StringRef Path, std::string &Err);
+
+private:
+	struct Fact {
+		Fact() : Flags(0), Width(0), Lo(0), Hi(0) {}
+		std::string Taint;
+		uint32_t Flags, Width;
+		uint64_t Lo, Hi;
+	};
+	std::map<std::string, Fact> Facts;
+};
+
+class GlobalIndex {
+public:
+	GlobalIndex() : Base(NULL), Size(0), Entries(NULL), NumEntries(0) {}
+	~GlobalIndex();
+
+	bool open(llvm::StringRef Path, std::string &Err);
+	bool isOpen() const { return Base != NULL; }
+
+	const GlobalIndexEntry *lookup(llvm::StringRef ID) const;
+	llvm::StringRef getString(uint32_t Offset) const {
+		return Strtab + Offset;
+	}
+
+private:
+	const char *Base;
+	size_t Size;
+	const GlobalIndexEntry *Entries;
+	uint64_t NumEntries;
+	const char *Strtab;
+};
@@ -16,6 +16,10 @@
 
 #include "IntGlobal.h"
 #include "Annotation.h"
+#include "GlobalIndex.h"
+#include "MemAcct.h"
+#include "Summary.h"
+#include "Trace.h"
 
 using namespace llvm;
 
@@ -29,6 +33,25 @@ Verbose("v", cl::desc("Print information about actions taken"));
 static cl::opt<bool>
 NoWriteback("p", cl::desc("Do not writeback annotated bytecode"));
 
+static cl::opt<bool>
+SharedContext("shared-context",
+              cl::desc("Load all modules into one LLVMContext"));
+
+static cl::opt<bool>
+DemandDriven("demand",
+             cl::desc("Only compute facts of IDs that may reach a check"));
+
+static cl::opt<bool>
+EmitSummary("emit-summary",
+            cl::desc("Write a summary of each input to <input>.sum"));
+
+static cl::opt<bool>
+LinkSummaries("link", cl::desc("Solve global facts from .sum inputs"));
+
+static cl::opt<std::string>
+IndexFilename("index", cl::desc("Write global facts to an index for intck"),
+              cl::value_desc("filename"));
+
 ModuleList Modules;
 GlobalContext GlobalCtx;
 
@@ -47,6 +70,31 @@ void doWriteback(Module *M, StringRef name)
 	out->keep();
 }
 
+void writeSummary(Module *M, StringRef name)
+{
+	std::string err;
+	std::string path = name.str() + ".sum";
+	OwningPtr<tool_output_file> out(
+		new tool_output_file(path.c_str(), err, raw_fd_ostream::F_Binary));
+	if (!err.empty()) {
+		errs() << "Cannot write summary " << path << ": " << err << "\n";
+		return;
+	}
+	SummaryWriter(out->os()).run(M);
+	out->keep();
+}
+
+// sizes of the global facts, for -mem-stats
+static void sampleGlobalFacts(GlobalContext *Ctx) {
+	using MemAcct::bytesOf;
+	if (!MemAcct::enabled())
+		return;
+	MemAcct::update("FuncPtrs", bytesOf(Ctx->FuncPtrs));
+	MemAcct::update("Callees", bytesOf(Ctx->Callees));
+	MemAcct::update("Taints", bytesOf(Ctx->Taints.GTS));
+	MemAcct::update("IntRanges", bytesOf(Ctx->IntRanges));
+	MemAcct::update("IDs", Ctx->IDs.getMemorySize());
+}
 
 void IterativeModulePass::run(ModuleList &modules) {
 
@@ -66,6 +114,9 @@ void IterativeModulePass::run(ModuleList &modules) {
 			Diag << "[" << ID << " / " << iter << "] ";
 			Diag << "'" << i->first->getModuleIdentifier() << "'";
 
+			TraceSpan Span(ID, "global");
+			Span.arg("module", i->second);
+			Span.arg("iteration", iter);
 			bool ret = doModulePass(i->first);
 			if (ret) {
 				++changed;
@@ -74,6 +125,7 @@ void IterativeModulePass::run(ModuleList &modules) {
 				Diag << "\n";
 		}
 		Diag << "[" << ID << "] Updated in " << changed << " modules.\n";
+		sampleGlobalFacts(Ctx);
 	}
 
 	Diag << "\n[" << ID << "] Postprocessing ...\n";
@@ -87,6 +139,63 @@ void IterativeModulePass::run(ModuleList &modules) {
 	Diag << "[" << ID << "] Done!\n";
 }
 
+static std::string joinTaint(const DescSet &D) {
+	std::string s;
+	for (DescSet::const_iterator i = D.begin(), e = D.end(); i != e; ++i) {
+		if (i != D.begin())
+			s += ", ";
+		s += (*i).str();
+	}
+	return s;
+}
+
+static void writeIndex(StringRef Path) {
+	GlobalIndexWriter W;
+
+	RangeMap &IRM = GlobalCtx.IntRanges;
+	for (RangeMap::iterator i = IRM.begin(), e = IRM.end(); i != e; ++i) {
+		CRange &R = i->second;
+		if (!R.isEmptySet() && !R.isFullSet())
+			W.addRange(i->first, R.getLower(), R.getUpper());
+	}
+
+	TaintMap::GlobalMap &GTS = GlobalCtx.Taints.GTS;
+	for (TaintMap::GlobalMap::iterator i = GTS.begin(), e = GTS.end();
+	     i != e; ++i) {
+		if (!i->second.first.empty())
+			W.addTaint(i->first, joinTaint(i->second.first), i->second.second);
+	}
+
+	// Indirect calls are keyed by the function pointer's ID; merge the
+	// taint of all possible callees, as TaintPass does per call site.
+	std::map<std::string, DescSet> IndirectRets;
+	CalleeMap &CM = GlobalCtx.Callees;
+	for (CalleeMap::iterator i = CM.begin(), e = CM.end(); i != e; ++i) {
+		CallInst *CI = i->first;
+		if (CI->getCalledFunction() || CI->isInlineAsm())
+			continue;
+		std::string sID = getRetId(CI);
+		if (sID.empty() || GTS.count(sID))
+			continue;
+		for (FuncSet::iterator j = i->second.begin(), je = i->second.end();
+		     j != je; ++j) {
+			if (DescSet *DS = GlobalCtx.Taints.get(getRetId(*j)))
+				IndirectRets[sID].insert(DS->begin(), DS->end());
+		}
+	}
+	for (std::map<std::string, DescSet>::iterator i = IndirectRets.begin(),
+	     e = IndirectRets.end(); i != e; ++i) {
+		if (!i->second.empty())
+			W.addTaint(i->first, joinTaint(i->second), false);
+	}
+
+	std::string Err;
+	if (!W.write(Path, Err))
+		errs() << "Cannot write index " << Path << ": " << Err << "\n";
+	else
+		Diag << "Wrote index " << Path << "\n";
+}
+
 int main(int argc, char **argv)
 {
 	// Print a stack trace if we signal out.
@@ -97,13 +206,46 @@ int main(int argc, char **argv)
 	cl::ParseCommandLineOptions(argc, argv, "global analysis\n");
 	SMDiagnostic Err;	
 	
+	// Solve the global facts from module summaries alone
+	if (LinkSummaries) {
+		SummaryLinker Linker(&GlobalCtx);
+		for (unsigned i = 0; i < InputFilenames.size(); ++i) {
+			std::string ErrMsg;
+			Diag << "Reading '" << InputFilenames[i] << "'\n";
+			if (!Linker.read(InputFilenames[i], ErrMsg))
+				errs() << argv[0] << ": error reading summary '"
+					<< InputFilenames[i] << "': " << ErrMsg
+					<< ", skipped\n";
+		}
+		Linker.link();
+		if (!IndexFilename.empty())
+			writeIndex(IndexFilename);
+		else {
+			TaintPass TPass(&GlobalCtx);
+			TPass.dumpTaints();
+			RangePass RPass(&GlobalCtx);
+			RPass.dumpRange();
+		}
+		return 0;
+	}
+
 	// Loading modules
 	Diag << "Total " << InputFilenames.size() << " file(s)\n";
 
+	LLVMContext *SharedCtx = SharedContext ? new LLVMContext() : NULL;
+	StripTypeSuffixes = SharedContext;
+	size_t ModuleBytes = 0;
 	for (unsigned i = 0; i < InputFilenames.size(); ++i) {
-		// use separate LLVMContext to avoid type renaming
-		LLVMContext *LLVMCtx = new LLVMContext();
-		Module *M = ParseIRFile(InputFilenames[i], Err, *LLVMCtx);
+		size_t HeapBefore = MemAcct::heapBytes();
+		// use separate LLVMContext to avoid type renaming, unless asked
+		// to share one type table (see getScopeName)
+		LLVMContext *LLVMCtx = SharedCtx ? SharedCtx : new LLVMContext();
+		Module *M;
+		{
+			TraceSpan Span("load", "module");
+			Span.arg("module", InputFilenames[i]);
+			M = ParseIRFile(InputFilenames[i], Err, *LLVMCtx);
+		}
 
 		if (M == NULL) {
 			errs() << argv[0] << ": error loading file '" 
@@ -114,27 +256,55 @@ int main(int argc, char **argv)
 		Diag << "Loading '" << InputFilenames[i] << "'\n";
 
 		// annotate
-		static AnnotationPass AnnoPass;
-		AnnoPass.doInitialization(*M);
-		for (Module::iterator j = M->begin(), je = M->end(); j != je; ++j)
-			AnnoPass.runOnFunction(*j);
+		{
+			TraceSpan Span("annotate", "module");
+			Span.arg("module", InputFilenames[i]);
+			static AnnotationPass AnnoPass;
+			AnnoPass.doInitialization(*M);
+			for (Module::iterator j = M->begin(), je = M->end(); j != je; ++j)
+				AnnoPass.runOnFunction(*j);
+		}
+
+		// summarize each module on its own, without keeping it around
+		if (EmitSummary) {
+			writeSummary(M, InputFilenames[i]);
+			delete M;
+			if (!SharedCtx)
+				delete LLVMCtx;
+			continue;
+		}
+
 		if (!NoWriteback)
 			doWriteback(M, InputFilenames[i].c_str());
 
+		// loaded IR, including metadata added by annotation
+		ModuleBytes += MemAcct::heapBytes() - HeapBefore;
+		MemAcct::update("modules", ModuleBytes);
+
 		Modules.push_back(std::make_pair(M, InputFilenames[i]));
 	}
 
+	if (EmitSummary)
+		return 0;
+
 	// Main workflow
 	CallGraphPass CGPass(&GlobalCtx);
 	CGPass.run(Modules);
 
+	if (DemandDriven) {
+		DemandPass DPass(&GlobalCtx);
+		DPass.run(Modules);
+	}
+
 	TaintPass TPass(&GlobalCtx);
 	TPass.run(Modules);
 
 	RangePass RPass(&GlobalCtx);
 	RPass.run(Modules);
 
-	if (NoWriteback) {
+	if (!IndexFilename.empty())
+		writeIndex(IndexFilename);
+	else if (NoWriteback) {
 		TPass.dumpTaints();
 		RPass.dumpRange();
 	}
@@ -5,6 +5,7 @@
 #include <llvm/Instructions.h>
 #include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringSet.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/Support/ConstantRange.h>
 #include <llvm/Support/Path.h>
@@ -17,6 +18,7 @@
 #include <string>
 
 #include "CRange.h"
+#include "FactIR.h"
 
 typedef std::vector< std::pair<llvm::Module *, llvm::StringRef> > ModuleList;
 typedef llvm::SmallPtrSet<llvm::Function *, 8> FuncSet;
@@ -31,23 +33,8 @@ class TaintMap {
 
 public:
 	typedef std::map<std::string, std::pair<DescSet, bool> > GlobalMap;
-	typedef std::map<llvm::Value *, DescSet> ValueMap;
 	
 	GlobalMap GTS;
-	ValueMap VTS;
-
-	void add(llvm::Value *V, const DescSet &D) {
-		VTS[V].insert(D.begin(), D.end());
-	}
-	void add(llvm::Value *V, llvm::StringRef D) {
-		VTS[V].insert(D);
-	}
-	DescSet* get(llvm::Value *V) {
-		ValueMap::iterator it = VTS.find(V);
-		if (it != VTS.end())
-			return &it->second;
-		return NULL;
-	}
 
 	DescSet* get(const std::string &ID) {
 		if (ID.empty())
@@ -77,6 +64,8 @@ public:
 };
 
 struct GlobalContext {
+	GlobalContext() : DemandDriven(false) { }
+
 	// Map global function name to function defination
 	FuncMap Funcs;
 
@@ -91,6 +80,18 @@ struct GlobalContext {
 
 	// Ranges
 	RangeMap IntRanges;
+
+	// Interned global IDs of lowered functions
+	FactIDs IDs;
+
+	// IDs whose facts may reach an integer check (see DemandPass);
+	// all IDs are demanded unless DemandDriven
+	bool DemandDriven;
+	llvm::StringSet<> DemandedIDs;
+
+	bool isDemanded(llvm::StringRef ID) const {
+		return !DemandDriven || DemandedIDs.count(ID);
+	}
 };
 
 class IterativeModulePass {
@@ -117,15 +118,33 @@ public:
 };
 
 class CallGraphPass : public IterativeModulePass {
+public:
+	// Functions and IDs whose function pointer sets flow into a value
+	struct FuncSource {
+		llvm::SmallVector<llvm::Function *, 2> Funcs;
+		llvm::SmallVector<uint32_t, 2> IDs;
+	};
+
 private:
-	bool runOnFunction(llvm::Function *);
 	void processInitializers(llvm::Module *, llvm::Constant *, llvm::GlobalValue *);
-	bool mergeFuncSet(FuncSet &S, const std::string &Id);
 	bool mergeFuncSet(FuncSet &Dst, const FuncSet &Src);
 	bool findFunctions(llvm::Value *, FuncSet &);
-	bool findFunctions(llvm::Value *, FuncSet &, 
-	                   llvm::SmallPtrSet<llvm::Value *, 4>);
-
+	void findSources(llvm::Value *, FuncSource &,
+	                 llvm::SmallPtrSet<llvm::Value *, 4>);
+	bool resolve(const FuncSource &, FuncSet &);
+
+	// lowered functions
+	typedef std::map<llvm::Function *, FactFunction> FactMap;
+	FactMap Facts;
+	std::vector<FuncSet *> FuncPtrSets;
+	llvm::DenseMap<std::pair<llvm::Function *, unsigned>, uint32_t> ArgIDs;
+
+	void lower(llvm::Function *, FactFunction &);
+	void lowerSource(llvm::Value *, FactBuilder &);
+	bool resolve(const FactFunction &, unsigned &, FuncSet &);
+	bool runOnFacts(const FactFunction &);
+	FuncSet *getFuncPtrs(uint32_t ID, bool Create);
+	uint32_t getArgID(llvm::Function *, unsigned);
 
 public:
 	CallGraphPass(GlobalContext *Ctx_)
@@ -134,27 +153,63 @@ public:
 	virtual bool doFinalization(llvm::Module *);
 	virtual bool doModulePass(llvm::Module *);
 
+	void findSources(llvm::Value *V, FuncSource &Src) {
+		llvm::SmallPtrSet<llvm::Value *, 4> Visited;
+		findSources(V, Src, Visited);
+	}
+
 	// debug
 	void dumpFuncPtrs();
 	void dumpCallees();
 };
 
-class TaintPass : public IterativeModulePass {
+class DemandPass : public IterativeModulePass {
 private:
-	DescSet* getTaint(llvm::Value *);
-	bool runOnFunction(llvm::Function *);
-	bool checkTaintSource(llvm::Value *);
-	bool markTaint(const std::string &Id, bool isSource);
+	// Deps[ID]: IDs whose facts flow into ID
+	std::vector<std::vector<uint32_t> > Deps;
+	std::vector<uint32_t> Seeds;
 
-	bool checkTaintSource(llvm::Instruction *I);
-	bool checkTaintSource(llvm::Function *F);
+	void trace(llvm::Value *, std::vector<uint32_t> &);
+	void addDeps(llvm::StringRef ID, llvm::Value *);
+	void addSeed(llvm::Value *);
+	void runOnFunction(llvm::Function *);
+
+public:
+	DemandPass(GlobalContext *Ctx_)
+		: IterativeModulePass(Ctx_, "Demand") { }
+	virtual bool doInitialization(llvm::Module *);
+	virtual bool doFinalization(llvm::Module *) { return false; }
+	virtual void run(ModuleList &modules);
+};
 
-	typedef llvm::DenseMap<llvm::Value *, DescSet> ValueTaintSet;
-	ValueTaintSet VTS;
+class TaintPass : public IterativeModulePass {
+private:
+	// lowered function: per-slot global IDs and taint (an index into
+	// TaintSets, 0 if untainted)
+	struct TaintFunction : FactFunction {
+		std::vector<uint32_t> Strip;	// slot of stripPointerCasts()
+		std::vector<uint32_t> GlobalBegin;	// range in GlobalIDs
+		std::vector<uint32_t> GlobalIDs;
+		std::vector<uint32_t> Taint;
+	};
+	typedef std::map<llvm::Function *, TaintFunction> FactMap;
+	FactMap Facts;
+
+	std::vector<DescSet> TaintSets;
+	std::map<DescSet, uint32_t> TaintSetIDs;
+	std::vector<llvm::StringRef> Descs;
+
+	uint32_t internTaint(const DescSet &);
+	uint32_t mergeTaint(uint32_t, const DescSet &);
+	uint32_t getTaint(TaintFunction &, uint32_t Slot);
+	bool markTaint(uint32_t ID, uint32_t Taint, bool isSource = false);
+
+	void lower(llvm::Function *, TaintFunction &);
+	bool runOnFacts(TaintFunction &);
 
 public:
 	TaintPass(GlobalContext *Ctx_)
-		: IterativeModulePass(Ctx_, "Taint") { }
+		: IterativeModulePass(Ctx_, "Taint"), TaintSets(1) { }
 	virtual bool doModulePass(llvm::Module *);
 	virtual bool doFinalization(llvm::Module *);
 	bool isTaintSource(const std::string &sID);
@@ -168,49 +223,67 @@ class RangePass : public IterativeModulePass {
 
 private:
 	const unsigned MaxIterations;	
+
+	// lowered function: per-slot bit width (of the integer pointed to,
+	// for pointers), kind and global IDs, the callees' return IDs for
+	// calls; ranges are kept per block and slot
+	enum { RK_Value, RK_Call, RK_Const };
+	struct RangeFunction : FactFunction {
+		unsigned NumBlocks;
+		std::vector<uint8_t> Kind;
+		std::vector<uint32_t> Width;
+		std::vector<uint32_t> GlobalBegin;	// range in GlobalIDs
+		std::vector<uint32_t> GlobalIDs;
+		// per GEP: [block, slot of each index, ~0 if constant]
+		std::vector<uint32_t> Indices;
+	};
+	typedef std::map<llvm::Function *, RangeFunction> FactMap;
+	FactMap Facts;
+	struct RangeSweep;
 	
 	bool safeUnion(CRange &CR, const CRange &R);
 	bool unionRange(llvm::StringRef, const CRange &, llvm::Value *);
-	bool unionRange(llvm::BasicBlock *, llvm::Value *, const CRange &);
-	CRange getRange(llvm::BasicBlock *, llvm::Value *);
+	bool unionRange(unsigned BB, uint32_t Slot, const CRange &);
+	CRange getRange(const RangeFunction &, unsigned BB, uint32_t Slot);
 
 	void collectInitializers(llvm::GlobalVariable *, llvm::Constant *);
-	bool updateRangeFor(llvm::Function *);
-	bool updateRangeFor(llvm::BasicBlock *);
-	bool updateRangeFor(llvm::Instruction *);
 
-	typedef std::map<llvm::Value *, CRange> ValueRangeMap;
-	typedef std::map<llvm::BasicBlock *, ValueRangeMap> FuncValueRangeMaps;
-	FuncValueRangeMaps FuncVRMs;
+	typedef std::map<uint32_t, CRange> SlotRangeMap;
+	std::vector<SlotRangeMap> FuncVRMs;
 
 	typedef std::set<std::string> ChangeSet;
 	ChangeSet Changes;
+
+	// Buffered global updates of a parallel sweep; NULL to write through.
+	RangeMap *Deltas;
 	
 	typedef std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *> Edge;
 	typedef llvm::SmallVector<Edge, 16> EdgeList;
 	EdgeList BackEdges;
 	
 	bool isBackEdge(const Edge &);
-	
-	CRange visitBinaryOp(llvm::BinaryOperator *);
-	CRange visitCastInst(llvm::CastInst *);
-	CRange visitSelectInst(llvm::SelectInst *);
-	CRange visitPHINode(llvm::PHINode *);
-	
-	bool visitCallInst(llvm::CallInst *);
-	bool visitReturnInst(llvm::ReturnInst *);
-	bool visitStoreInst(llvm::StoreInst *);
-
-	void visitBranchInst(llvm::BranchInst *, 
-						 llvm::BasicBlock *, ValueRangeMap &);
-	void visitTerminator(llvm::TerminatorInst *,
-						 llvm::BasicBlock *, ValueRangeMap &);
-	void visitSwitchInst(llvm::SwitchInst *, 
-						 llvm::BasicBlock *, ValueRangeMap &);
+	bool isLoopCarried(llvm::Value *, llvm::SmallPtrSet<llvm::Value *, 16> &);
+
+	typedef llvm::DenseMap<llvm::BasicBlock *, unsigned> BlockMap;
+	void lower(llvm::Function *, RangeFunction &);
+	void lowerEdge(llvm::TerminatorInst *, llvm::BasicBlock *, BlockMap &,
+	               FactBuilder &);
+	void lowerInst(llvm::Instruction *, unsigned BB, BlockMap &,
+	               RangeFunction &, FactBuilder &);
+	void refine(const RangeFunction &, unsigned Pred, unsigned &i,
+	            SlotRangeMap &);
+	static CRange evalBinary(unsigned Opcode, CRange, CRange);
+	static CRange evalCast(unsigned Opcode, unsigned Bits, const CRange &);
+	bool runOnFacts(const RangeFunction &);
+
+	bool doParallelSweep(const std::vector<const RangeFunction *> &);
+	void annotateIndices(llvm::Function *, const RangeFunction &);
+	static void *sweepWorker(void *);
 
 public:
 	RangePass(GlobalContext *Ctx_)
-		: IterativeModulePass(Ctx_, "Range"), MaxIterations(5) { }
+		: IterativeModulePass(Ctx_, "Range"), MaxIterations(5),
+		  Deltas(NULL) { }
 	
 	virtual bool doInitialization(llvm::Module *);
 	virtual bool doModulePass(llvm::Module *M);
@@ -13,6 +13,7 @@
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/ValueTracking.h>
 #include <llvm/Support/CommandLine.h>
+#include <llvm/Support/ConstantRange.h>
 #include <llvm/Support/GetElementPtrTypeIterator.h>
 #include <llvm/Support/InstIterator.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
@@ -275,10 +276,26 @@ bool IntRewrite::insertShiftCheck(Instruction *I) {
 	return true;
 }
 
+// Range of the No-th index of a GEP, from intglobal's idxrange metadata.
+static bool getIndexRange(Instruction *I, unsigned No, APInt &Lo, APInt &Hi) {
+	MDNode *MD = I->getMetadata("idxrange");
+	if (!MD || MD->getNumOperands() != 2 * (I->getNumOperands() - 1))
+		return false;
+	ConstantInt *L = dyn_cast_or_null<ConstantInt>(MD->getOperand(2 * No));
+	ConstantInt *H = dyn_cast_or_null<ConstantInt>(MD->getOperand(2 * No + 1));
+	Type *IdxTy = I->getOperand(No + 1)->getType();
+	if (!L || !H || L->getType() != IdxTy || H->getType() != IdxTy
+	    || L == H)
+		return false;
+	Lo = L->getValue();
+	Hi = H->getValue();
+	return true;
+}
+
 bool IntRewrite::insertArrayCheck(Instruction *I) {
 	Value *V = NULL;
 	gep_type_iterator i = gep_type_begin(I), e = gep_type_end(I);
-	for (; i != e; ++i) {
+	for (unsigned No = 0; i != e; ++i, ++No) {
 		// For arr[idx], check idx >u n.  Here we don't use idx >= n
 		// since it is unclear if the pointer will be dereferenced.
 		ArrayType *T = dyn_cast<ArrayType>(*i);
@@ -292,6 +309,11 @@ bool IntRewrite::insertArrayCheck(Instruction *I) {
 		// Use the maximum signed value instead for the upper bound.
 		if (n <= 1)
 			n = INT_MAX;
+		// Skip indices that are in bounds on every path.
+		APInt Lo, Hi;
+		if (getIndexRange(I, No, Lo, Hi)
+		    && ConstantRange(Lo, Hi).getUnsignedMax().ule(n))
+			continue;
 		Value *Check = Builder->CreateICmpUGT(Idx, ConstantInt::get(IdxTy, n));
 		if (V)
 			V = Builder->CreateOr(V, Check);
@@ -1,7 +1,13 @@
 #define DEBUG_TYPE "int-sat"
 #include "Diagnostic.h"
+#include "FuncCache.h"
+#include "MemAcct.h"
 #include "PathGen.h"
+#include "SMTEval.h"
+#include "SMTPipeline.h"
 #include "SMTSolver.h"
+#include "SMTWorker.h"
+#include "Trace.h"
 #include "ValueGen.h"
 #include <llvm/BasicBlock.h>
 #include <llvm/Constants.h>
@@ -18,12 +24,27 @@
 #include <llvm/Support/InstIterator.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <deque>
+#include <vector>
 
 using namespace llvm;
 
 static cl::opt<bool>
 SMTModelOpt("smt-model", cl::desc("Output SMT model"));
 
+static cl::opt<bool>
+BatchOpt("int-batch", cl::desc("Check all int.sat of a function in one solver"));
+
+static cl::opt<PathGen::Encoding>
+PathEncoding("int-path-encoding", cl::desc("Path condition encoding of intck"),
+             cl::values(
+               clEnumValN(PathGen::Nested, "nested",
+                          "Expand the guards of predecessors"),
+               clEnumValN(PathGen::Linear, "linear",
+                          "One reachability variable per block"),
+               clEnumValEnd),
+             cl::init(PathGen::Nested));
+
 namespace {
 
 // Better to make this as a module pass rather than a function pass.
@@ -48,10 +69,39 @@ private:
 	SmallVector<PathGen::Edge, 32> BackEdges;
 	SmallPtrSet<Value *, 32> ReportedBugs;
 
+	// One solver per function; values and path guards are encoded once
+	// and each int.sat is checked under an assumption.
+	OwningPtr<SMTSolver> SMT;
+	OwningPtr<ValueGen> VG;
+	OwningPtr<PathGen> PG;
+	size_t SolverHeap;
+
+	// With -smt-threads, queries are solved on other threads while
+	// later ones are encoded; results are reported in program order.
+	struct Pending {
+		unsigned Ticket;
+		CallInst *I;
+		SMTNode *Query;
+		SMTEval *Witness;	// sat without solving
+	};
+	OwningPtr<SMTPipeline> Pipeline;
+	std::deque<Pending> InFlight;
+	bool TimedOut;		// this function's reports may be incomplete
+
+	// What else decides the reports of a function, for -int-cache.
+	std::string Config;
+
+	void setConfig(Module &);
 	void runOnFunction(Function &);
+	bool isCandidate(CallInst *);
+	SMTNode *encode(CallInst *, bool Models);
 	void check(CallInst *);
+	void checkBatch(SmallVectorImpl<CallInst *> &);
 	void classify(Value *);
-	SMTStatus query(Value *, Instruction *);
+	SMTStatus query(SMTNode *, Instruction *);
+	void drain(size_t Keep);
+	SMTEval *witness(SMTNode *);
+	void report(Instruction *, SMTModel, const SMTEval * = NULL);
 };
 
 } // anonymous namespace
@@ -62,90 +112,346 @@ bool IntSat::runOnModule(Module &M) {
 		return false;
 	TD.reset(new DataLayout(&M));
 	MD_bug = M.getContext().getMDKindID("bug");
+	if (FuncCache::enabled())
+		setConfig(M);
+	if (SMTPipeline::enabled())
+		Pipeline.reset(new SMTPipeline);
 	for (Module::iterator i = M.begin(), e = M.end(); i != e; ++i) {
 		Function &F = *i;
 		if (F.empty())
 			continue;
 		runOnFunction(F);
 	}
+	Pipeline.reset();
 	return false;
 }
 
+void IntSat::setConfig(Module &M) {
+	const char *Backend = SMTSolver::backend();
+	raw_string_ostream OS(Config);
+	OS << M.getDataLayout() << ' ' << (Backend ? Backend : "-")
+	   << (SMTWorker::portfolio() ? "+portfolio" : "")
+	   << " timeout=" << SMTTimeout()
+	   << " model=" << SMTModelOpt
+	   << " unroll=" << PathGen::unroll()
+	   << " slice=" << PathGen::slicing()
+	   << " eval=" << SMTEval::inputs()
+	   << " batch=" << BatchOpt
+	   << " path=" << PathEncoding;
+}
+
 void IntSat::runOnFunction(Function &F) {
+	TraceSpan Span("function", "intck");
+	Span.arg("module", F.getParent()->getModuleIdentifier());
+	Span.arg("function", F.getName());
+	// With -int-cache, replay the reports of an identical function.
+	std::string Key, Report;
+	if (FuncCache::enabled()) {
+		Key = FuncCache::key(F, Config);
+		if (FuncCache::lookup(Key, Report)) {
+			Span.arg("cached", 1);
+			errs() << Report;
+			return;
+		}
+	}
+	raw_string_ostream OS(Report);
+	if (!Key.empty())
+		Diag.redirect(OS);
 	BackEdges.clear();
 	FindFunctionBackedges(F, BackEdges);
 	ReportedBugs.clear();
+	TimedOut = false;
+	SmallVector<CallInst *, 32> Checks;
 	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 		CallInst *CI = dyn_cast<CallInst>(&*i);
-		if (CI && CI->getCalledFunction() == Trap)
+		if (!CI || CI->getCalledFunction() != Trap)
+			continue;
+		if (BatchOpt)
+			Checks.push_back(CI);
+		else
 			check(CI);
 	}
+	if (!Checks.empty())
+		checkBatch(Checks);
+	if (Pipeline)
+		drain(0);
+	PG.reset();
+	VG.reset();
+	SMT.reset();
+	if (!Key.empty()) {
+		Diag.redirect(errs());
+		OS.flush();
+		errs() << Report;
+		// a timed-out query may be decided on another run
+		if (!TimedOut)
+			FuncCache::store(Key, Report);
+	}
 }
 
-void IntSat::check(CallInst *I) {
+bool IntSat::isCandidate(CallInst *I) {
 	assert(I->getNumArgOperands() >= 1);
 	Value *V = I->getArgOperand(0);
 	assert(V->getType()->isIntegerTy(1));
 	if (isa<ConstantInt>(V))
-		return;
+		return false;
 	if (ReportedBugs.count(V))
-		return;
+		return false;
 
 	const DebugLoc &DbgLoc = I->getDebugLoc();
 	if (DbgLoc.isUnknown())
-		return;
+		return false;
 	if (!I->getMetadata(MD_bug))
+		return false;
+	return true;
+}
+
+// The query of an int.sat, in the solver of the function.
+SMTNode *IntSat::encode(CallInst *I, bool Models) {
+	if (!SMT) {
+		SolverHeap = MemAcct::heapBytes();
+		SMT.reset(SMTSolver::create(Models));
+		VG.reset(new ValueGen(*TD, *SMT));
+		PG.reset(new PathGen(*VG, BackEdges, PathEncoding));
+	}
+	// sat in any iteration if unrolled
+	Value *V = I->getArgOperand(0);
+	BasicBlock *BB = I->getParent();
+	SMTNode *Query = VG->DAG.bvfalse();
+	for (unsigned n = 0, e = PG->iterations(BB); n != e; ++n) {
+		SMTNode *E = VG->get(V, BB, n);
+		SMTNode *Q = VG->DAG.bvand(E, PG->slice(PG->get(BB, n), E));
+		Query = VG->DAG.bvor(Query, Q);
+	}
+	return Query;
+}
+
+void IntSat::check(CallInst *I) {
+	if (!isCandidate(I))
+		return;
+	Value *V = I->getArgOperand(0);
+
+	TraceSpan Span("int.sat", "smt");
+	Span.arg("function", I->getParent()->getParent()->getName());
+	SMTNode *Query = encode(I, SMTModelOpt);
+	// query size as the number of values encoded so far
+	Span.arg("values", VG->Cache.size());
+
+	OwningPtr<SMTEval> W(witness(Query));
+
+	if (Pipeline) {
+		Pending P = { 0, I, Query, W.take() };
+		if (!P.Witness) {
+			std::string Text;
+			SMT->serialize(VG->DAG.lower(Query), Text);
+			P.Ticket = Pipeline->submit(Text);
+		}
+		InFlight.push_back(P);
+		drain(4 * Pipeline->threads());
 		return;
+	}
 
-	int SMTRes;
-	if (SMTFork() == 0)
-		SMTRes = query(V, I);
-	SMTJoin(&SMTRes);
+	SMTStatus SMTRes = SMT_SAT;
+	if (W)
+		report(I, NULL, SMTModelOpt ? W.get() : NULL);
+	else
+		SMTRes = query(Query, I);
+	Span.arg("status", SMTRes);
+	// a solver stopped by the in-process timeout cannot go on
+	if (SMTRes == SMT_TIMEOUT) {
+		TimedOut = true;
+		PG.reset();
+		VG.reset();
+		SMT.reset();
+	}
 
 	// Save to suppress furture warnings.
 	if (SMTRes == SMT_SAT)
 		ReportedBugs.insert(V);
 }
 
-SMTStatus IntSat::query(Value *V, Instruction *I) {
-	SMTSolver SMT(SMTModelOpt);
-	ValueGen VG(*TD, SMT);
-	PathGen PG(VG, BackEdges);
-	SMTExpr Query = SMT.bvand(VG.get(V), PG.get(I->getParent()));
+// With -smt-eval, an evaluation of Query that makes it true.
+SMTEval *IntSat::witness(SMTNode *Query) {
+	if (!SMTEval::inputs())
+		return NULL;
+	OwningPtr<SMTEval> W(new SMTEval(VG->DAG));
+	if (!W->solve(Query))
+		return NULL;
+	return W.take();
+}
+
+SMTStatus IntSat::query(SMTNode *Query, Instruction *I) {
+	// without -smt-model, sat results can come from the -smt-cache
 	SMTModel Model = NULL;
-	SMTStatus Res = SMT.query(Query, &Model);
-	SMT.decref(Query);
-	if (Res != SMT_SAT)
-		return Res;
+	SMTExpr E = VG->DAG.lower(Query);
+	SMTStatus Res = SMT->query(E, SMTModelOpt ? &Model : NULL);
+	// queries solved by -smt-fork workers are not seen here
+	MemAcct::update("smt", MemAcct::heapBytes() - SolverHeap);
+	if (Res == SMT_SAT)
+		report(I, Model);
+	if (Model)
+		SMT->release(Model);
+	return Res;
+}
+
+// Batch mode (-int-batch): all checks of a function share one solver,
+// each with an indicator equal to its query.  Solving for any open
+// indicator reports and closes those true in the model, until no
+// check is sat; the last, unsat, call discharges all the rest.
+void IntSat::checkBatch(SmallVectorImpl<CallInst *> &Checks) {
+	TraceSpan Span("batch", "smt");
+	Span.arg("function", Checks[0]->getParent()->getParent()->getName());
+	std::vector<std::pair<CallInst *, SMTNode *> > Open;
+	for (unsigned i = 0, n = Checks.size(); i != n; ++i) {
+		CallInst *I = Checks[i];
+		if (!isCandidate(I))
+			continue;
+		SMTNode *Query = encode(I, true);
+		std::string Name;
+		{
+			raw_string_ostream OS(Name);
+			OS << "check@" << I;
+		}
+		SMTNode *B = VG->DAG.bvvar(1, Name.c_str());
+		VG->DAG.assume(VG->DAG.eq(B, Query));
+		Open.push_back(std::make_pair(I, B));
+	}
+	Span.arg("checks", Open.size());
+	unsigned Calls = 0;
+	// witnesses are tried until one is missed
+	bool Eval = SMTEval::inputs();
+	while (!Open.empty()) {
+		SMTDag &DAG = VG->DAG;
+		SMTNode *Any = DAG.bvfalse();
+		for (unsigned i = 0, n = Open.size(); i != n; ++i)
+			Any = DAG.bvor(Any, Open[i].second);
+		OwningPtr<SMTEval> W;
+		if (Eval) {
+			W.reset(witness(Any));
+			Eval = W.get() != NULL;
+		}
+		SMTModel Model = NULL;
+		SMTStatus Res = SMT_SAT;
+		if (!W) {
+			Res = SMT->query(DAG.lower(Any), &Model);
+			MemAcct::update("smt", MemAcct::heapBytes() - SolverHeap);
+			++Calls;
+		}
+		if (Res == SMT_UNSAT)
+			break;
+		if (Res == SMT_TIMEOUT)
+			TimedOut = true;
+		// Close the checks sat in the model or the witness, and
+		// those of values reported by them.
+		size_t Before = Open.size();
+		if (Res == SMT_SAT && (Model || W)) {
+			for (unsigned i = 0; i != Open.size(); ) {
+				CallInst *I = Open[i].first;
+				Value *V = I->getArgOperand(0);
+				APInt Val;
+				if (W)
+					W->eval(Open[i].second, Val);
+				else
+					SMT->eval(Model, DAG.lowered(Open[i].second), Val);
+				if (!ReportedBugs.count(V) && !Val)
+					++i;
+				else {
+					if (!ReportedBugs.count(V)) {
+						ReportedBugs.insert(V);
+						report(I, SMTModelOpt ? Model : NULL,
+						       SMTModelOpt ? W.get() : NULL);
+					}
+					Open.erase(Open.begin() + i);
+				}
+			}
+		}
+		if (Model)
+			SMT->release(Model);
+		if (Open.size() == Before) {
+			// Timed out or no model: check the rest one by one,
+			// in a new solver.
+			PG.reset();
+			VG.reset();
+			SMT.reset();
+			for (unsigned i = 0, n = Open.size(); i != n; ++i)
+				check(Open[i].first);
+			break;
+		}
+	}
+	Span.arg("queries", Calls);
+}
+
+// Report finished queries in order, waiting until at most Keep are
+// left in flight.
+void IntSat::drain(size_t Keep) {
+	while (!InFlight.empty()) {
+		Pending &P = InFlight.front();
+		if (InFlight.size() <= Keep && !P.Witness
+		    && !Pipeline->done(P.Ticket))
+			break;
+		SMTStatus Res = SMT_SAT;
+		if (!P.Witness)
+			Res = Pipeline->wait(P.Ticket);
+		if (Res == SMT_TIMEOUT)
+			TimedOut = true;
+		Value *V = P.I->getArgOperand(0);
+		// an earlier query of the same value may have been sat
+		if (Res == SMT_SAT && !ReportedBugs.count(V)) {
+			ReportedBugs.insert(V);
+			// without a witness, the model comes from solving
+			// again here
+			SMTModel Model = NULL;
+			if (P.Witness)
+				report(P.I, NULL, SMTModelOpt ? P.Witness : NULL);
+			else if (SMTModelOpt
+			         && SMT->query(VG->DAG.lower(P.Query), &Model) == SMT_SAT)
+				report(P.I, Model);
+			else
+				report(P.I, NULL);
+			if (Model)
+				SMT->release(Model);
+		}
+		delete P.Witness;
+		InFlight.pop_front();
+	}
+}
+
+void IntSat::report(Instruction *I, SMTModel Model, const SMTEval *W) {
 	// Output bug type.
 	MDNode *MD = I->getMetadata(MD_bug);
 	Diag.bug(cast<MDString>(MD->getOperand(0))->getString());
 	// Output location.
-	Diag.status(Res);
+	Diag.status(SMT_SAT);
 	Diag.classify(I);
 	Diag.backtrace(I);
 	// Output model.
-	if (SMTModelOpt && Model) {
+	if (Model || W) {
 		Diag << "model: |\n";
 		raw_ostream &OS = Diag.os();
-		for (ValueGen::iterator i = VG.begin(), e = VG.end(); i != e; ++i) {
+		for (ValueGen::iterator i = VG->begin(), e = VG->end(); i != e; ++i) {
 			Value *KeyV = i->first;
 			if (isa<Constant>(KeyV))
 				continue;
+			// values folded away were never lowered, nor
+			// evaluated if the query did not need them
+			APInt Val;
+			if (W) {
+				if (!W->eval(i->second, Val))
+					continue;
+			} else {
+				SMTExpr E = VG->DAG.lowered(i->second);
+				if (!E)
+					continue;
+				SMT->eval(Model, E, Val);
+			}
 			OS << "  ";
 			WriteAsOperand(OS, KeyV, false, Trap->getParent());
 			OS << ": ";
-			APInt Val;
-			SMT.eval(Model, i->second, Val);
 			if (Val.getLimitedValue(0xa) == 0xa)
 				OS << "0x";
 			OS << Val.toString(16, false);
 			OS << '\n';
 		}
 	}
-	if (Model)
-		SMT.release(Model);
-	return Res;
 }
 
 char IntSat::ID;
@@ -0,0 +1,323 @@
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/system_error.h>
+#include <stdlib.h>
+
+#include "Summary.h"
+
+using namespace llvm;
+
+unsigned SummaryLinker::getFunc(StringRef Scope) {
+	std::pair<std::map<std::string, unsigned>::iterator, bool> R =
+		FuncIdx.insert(std::make_pair(Scope.str(), (unsigned)FuncNames.size()));
+	if (R.second) {
+		FuncNames.push_back(Scope);
+		FuncSkip.push_back(false);
+	}
+	return R.first->second;
+}
+
+// rename module-local call sites @n to global ones
+static std::string renameSite(StringRef Tok, unsigned Base) {
+	if (!Tok.startswith("@"))
+		return Tok;
+	std::pair<StringRef, StringRef> P = Tok.substr(1).split('/');
+	std::string S = "@" + utostr(Base + atoi(P.first.str().c_str()));
+	if (!P.second.empty())
+		S += "/" + P.second.str();
+	return S;
+}
+
+bool SummaryLinker::read(StringRef Filename, std::string &Err) {
+	OwningPtr<MemoryBuffer> MB;
+	if (error_code ec = MemoryBuffer::getFile(Filename, MB)) {
+		Err = ec.message();
+		return false;
+	}
+
+	// check all records first, so that a bad file adds nothing
+	std::vector<StringRef> Lines;
+	StringRef Rest = MB->getBuffer();
+	while (!Rest.empty()) {
+		StringRef Line;
+		tie(Line, Rest) = Rest.split('\n');
+		if (Line.empty())
+			continue;
+		SmallVector<StringRef, 8> Fields;
+		Line.split(Fields, " ");
+		StringRef Kind = Fields[0];
+		if (Kind != "func" && Kind != "call" && Kind != "source"
+		    && Kind != "fp" && Kind != "taint" && Kind != "range") {
+			Err = "unknown record: " + Line.str();
+			return false;
+		}
+		// an indirect call may have no known sources, but its
+		// record still numbers the site
+		if (Fields.size() < (Kind == "call" ? 2U : 3U)) {
+			Err = "bad record: " + Line.str();
+			return false;
+		}
+		Lines.push_back(Line);
+	}
+
+	unsigned Base = SiteSrcs.size();
+	for (unsigned l = 0; l != Lines.size(); ++l) {
+		StringRef Line = Lines[l];
+		SmallVector<StringRef, 8> Fields;
+		Line.split(Fields, " ");
+		StringRef Kind = Fields[0];
+
+		if (Kind == "func") {
+			unsigned F = getFunc(Fields[1]);
+			FuncSkip[F] = FuncSkip[F] || Fields[2] != "-";
+		} else if (Kind == "call") {
+			unsigned Site = atoi(Fields[1].substr(1).str().c_str()) + Base;
+			if (SiteSrcs.size() <= Site) {
+				SiteSrcs.resize(Site + 1);
+				SiteCallees.resize(Site + 1);
+			}
+			for (unsigned i = 2; i < Fields.size(); ++i)
+				SiteSrcs[Site].push_back(Fields[i]);
+		} else if (Kind == "source") {
+			// the description may contain spaces
+			StringRef Desc = Line.substr(Kind.size() + Fields[1].size() + 2);
+			DescSet D;
+			D.insert(*Descs.insert(Desc).first);
+			Ctx->Taints.add(Fields[1].str(), D, true);
+		} else if (Kind == "fp" || Kind == "taint" || Kind == "range") {
+			std::vector<Flow> &Flows = Kind == "fp" ? FuncPtrFlows
+				: Kind == "taint" ? TaintFlows : RangeFlows;
+			Flows.push_back(Flow());
+			Flow &FL = Flows.back();
+			FL.Dst = renameSite(Fields[1], Base);
+			for (unsigned i = 2; i < Fields.size(); ++i)
+				FL.Srcs.push_back(renameSite(Fields[i], Base));
+		}
+	}
+	return true;
+}
+
+// expand @n/no to the argument IDs of all callees of call site @n
+void SummaryLinker::getDsts(const std::string &Dst, bool Skip, Tokens &Out) {
+	if (Dst[0] != '@') {
+		Out.push_back(Dst);
+		return;
+	}
+	std::pair<StringRef, StringRef> P = StringRef(Dst).substr(1).split('/');
+	unsigned Site = atoi(P.first.str().c_str());
+	if (Site >= SiteCallees.size())
+		return;
+	FuncIdxSet &S = SiteCallees[Site];
+	for (FuncIdxSet::iterator i = S.begin(), e = S.end(); i != e; ++i) {
+		// skip vaarg and builtin functions
+		if (Skip && FuncSkip[*i])
+			continue;
+		Out.push_back("arg." + FuncNames[*i] + "." + P.second.str());
+	}
+}
+
+// return IDs of all callees of call site @n
+void SummaryLinker::getRets(const std::string &Site, Tokens &Out) {
+	unsigned n = atoi(Site.c_str() + 1);
+	if (n >= SiteCallees.size())
+		return;
+	FuncIdxSet &S = SiteCallees[n];
+	for (FuncIdxSet::iterator i = S.begin(), e = S.end(); i != e; ++i)
+		Out.push_back("ret." + FuncNames[*i]);
+}
+
+bool SummaryLinker::resolve(const Tokens &Srcs, FuncIdxSet &S) {
+	bool Changed = false;
+	for (unsigned i = 0; i != Srcs.size(); ++i) {
+		const std::string &Src = Srcs[i];
+		if (Src[0] == '&') {
+			Changed |= S.insert(getFunc(StringRef(Src).substr(1))).second;
+			continue;
+		}
+		std::map<std::string, FuncIdxSet>::iterator it = FuncPtrs.find(Src);
+		if (it == FuncPtrs.end())
+			continue;
+		size_t n = S.size();
+		S.insert(it->second.begin(), it->second.end());
+		Changed |= S.size() != n;
+	}
+	return Changed;
+}
+
+void SummaryLinker::linkFuncPtrs() {
+	bool Changed = true;
+	while (Changed) {
+		Changed = false;
+		for (unsigned i = 0; i != SiteSrcs.size(); ++i)
+			Changed |= resolve(SiteSrcs[i], SiteCallees[i]);
+		for (unsigned i = 0; i != FuncPtrFlows.size(); ++i) {
+			Flow &FL = FuncPtrFlows[i];
+			FuncIdxSet S;
+			resolve(FL.Srcs, S);
+			if (S.empty())
+				continue;
+			Tokens Dsts;
+			getDsts(FL.Dst, false, Dsts);
+			for (unsigned j = 0; j != Dsts.size(); ++j) {
+				FuncIdxSet &D = FuncPtrs[Dsts[j]];
+				size_t n = D.size();
+				D.insert(S.begin(), S.end());
+				Changed |= D.size() != n;
+			}
+		}
+	}
+}
+
+bool SummaryLinker::unionTaint(const std::string &ID, const DescSet &D) {
+	DescSet *Old = Ctx->Taints.get(ID);
+	size_t n = Old ? Old->size() : 0;
+	Ctx->Taints.add(ID, D);
+	return Ctx->Taints.get(ID)->size() != n;
+}
+
+void SummaryLinker::linkTaints() {
+	bool Changed = true;
+	while (Changed) {
+		Changed = false;
+		for (unsigned i = 0; i != TaintFlows.size(); ++i) {
+			Flow &FL = TaintFlows[i];
+			Tokens Srcs;
+			for (unsigned j = 0; j != FL.Srcs.size(); ++j) {
+				if (FL.Srcs[j][0] == '@')
+					getRets(FL.Srcs[j], Srcs);
+				else
+					Srcs.push_back(FL.Srcs[j]);
+			}
+			DescSet D;
+			for (unsigned j = 0; j != Srcs.size(); ++j)
+				if (DescSet *DS = Ctx->Taints.get(Srcs[j]))
+					D.insert(DS->begin(), DS->end());
+			if (D.empty())
+				continue;
+			Tokens Dsts;
+			getDsts(FL.Dst, true, Dsts);
+			for (unsigned j = 0; j != Dsts.size(); ++j)
+				Changed |= unionTaint(Dsts[j], D);
+		}
+	}
+}
+
+bool SummaryLinker::unionRange(const std::string &ID, const CRange &R) {
+	if (R.isEmptySet())
+		return false;
+	bool Changed = true;
+	RangeMap::iterator it = Ctx->IntRanges.find(ID);
+	if (it != Ctx->IntRanges.end())
+		Changed = it->second.safeUnion(R);
+	else
+		Ctx->IntRanges.insert(std::make_pair(ID, R));
+	if (Changed)
+		Changes.insert(ID);
+	return Changed;
+}
+
+// global range lookup, as in RangePass::getRange
+CRange SummaryLinker::getRange(unsigned Width, const std::string &Src) {
+	CRange CR(Width, false);
+	RangeMap &IRM = Ctx->IntRanges;
+	RangeMap::iterator it;
+	if (Src[0] == '@') {
+		Tokens Rets;
+		getRets(Src, Rets);
+		for (unsigned i = 0; i != Rets.size(); ++i) {
+			if (Ctx->Taints.isSource(Rets[i]))
+				return CRange(Width, true);
+			if ((it = IRM.find(Rets[i])) != IRM.end())
+				CR.safeUnion(it->second);
+		}
+		return CR;
+	}
+	if (Ctx->Taints.isSource(Src))
+		return CRange(Width, true);
+	if ((it = IRM.find(Src)) != IRM.end())
+		CR = it->second;
+	return CR.zextOrTrunc(Width);
+}
+
+// evaluate the expression at Expr[i] (see Summary.h); moves i past it
+CRange SummaryLinker::evalRange(const Tokens &Expr, unsigned &i) {
+	StringRef Op = Expr[i++];
+	if (Op == "u") {
+		CRange L = evalRange(Expr, i);
+		L.safeUnion(evalRange(Expr, i));
+		return L;
+	}
+
+	unsigned Width;
+	if (Op == "e" || Op == "f" || Op == "k" || Op == "g"
+	    || Op == "trunc" || Op == "zext" || Op == "sext") {
+		Width = atoi(Expr[i++].c_str());
+		if (Op == "e" || Op == "f")
+			return CRange(Width, Op == "f");
+		if (Op == "k") {
+			APInt Lo(Width, Expr[i], 10), Hi(Width, Expr[i + 1], 10);
+			i += 2;
+			return CRange(Lo, Hi);
+		}
+		if (Op == "g")
+			return getRange(Width, Expr[i++]);
+		CRange R = evalRange(Expr, i);
+		if (Op == "sext")
+			return R.signExtend(Width);
+		return R.zextOrTrunc(Width);
+	}
+
+	// binary operators, as in RangePass::evalBinary
+	CRange L = evalRange(Expr, i);
+	CRange R = evalRange(Expr, i);
+	R.match(L);
+	if (Op == "add")  return L.add(R);
+	if (Op == "sub")  return L.sub(R);
+	if (Op == "mul")  return L.multiply(R);
+	if (Op == "udiv") return L.udiv(R);
+	if (Op == "sdiv") return L.sdiv(R);
+	if (Op == "urem") return R; // FIXME
+	if (Op == "srem") return R; // FIXME
+	if (Op == "shl")  return L.shl(R);
+	if (Op == "lshr") return L.lshr(R);
+	if (Op == "ashr") return L; // FIXME
+	if (Op == "and")  return L.binaryAnd(R);
+	if (Op == "or")   return L.binaryOr(R);
+	if (Op == "xor")  return L; // FIXME
+	return CRange(L.getBitWidth(), true);
+}
+
+void SummaryLinker::linkRanges() {
+	unsigned itr = 0;
+	bool Changed = true;
+	while (Changed) {
+		// if some values converge too slowly, expand them to full-set
+		if (++itr > MaxIterations) {
+			for (std::set<std::string>::iterator it = Changes.begin(),
+			     ie = Changes.end(); it != ie; ++it) {
+				RangeMap::iterator i = Ctx->IntRanges.find(*it);
+				i->second = CRange(i->second.getBitWidth(), true);
+			}
+		}
+		Changed = false;
+		Changes.clear();
+		for (unsigned i = 0; i != RangeFlows.size(); ++i) {
+			Flow &FL = RangeFlows[i];
+			unsigned j = 0;
+			CRange R = evalRange(FL.Srcs, j);
+			Tokens Dsts;
+			getDsts(FL.Dst, true, Dsts);
+			for (unsigned k = 0; k != Dsts.size(); ++k)
+				Changed |= unionRange(Dsts[k], R);
+		}
+	}
+}
+
+// function pointers first, which fix the callees of every call site
+void SummaryLinker::link() {
+	linkFuncPtrs();
+	linkTaints();
+	linkRanges();
+}
@@ -0,0 +1,109 @@
+#include "MemAcct.h"
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+#include <malloc.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using namespace llvm;
+
+static cl::opt<bool>
+MemStats("mem-stats",
+         cl::desc("Report memory use per subsystem at exit and on SIGUSR1"));
+
+namespace {
+
+struct Usage {
+	const char *Name;
+	size_t Cur, Peak;
+};
+
+// Subsystems in the order they first report; there are only a few.
+struct UsageTable {
+	std::vector<Usage> Entries;
+
+	~UsageTable() {
+		if (Entries.empty())
+			return;
+		// errs() may be gone already
+		raw_fd_ostream OS(STDERR_FILENO, false);
+		MemAcct::report(OS);
+	}
+};
+
+} // anonymous namespace
+
+static UsageTable Table;
+static volatile sig_atomic_t ReportPending;
+
+static void onReportSignal(int) {
+	ReportPending = 1;
+}
+
+bool MemAcct::enabled() {
+	static bool Installed;
+	if (MemStats && !Installed) {
+		signal(SIGUSR1, onReportSignal);
+		Installed = true;
+	}
+	return MemStats;
+}
+
+void MemAcct::update(const char *Name, size_t Bytes) {
+	if (!enabled())
+		return;
+	std::vector<Usage>::iterator i = Table.Entries.begin(),
+	                             e = Table.Entries.end();
+	for (; i != e; ++i)
+		if (!strcmp(i->Name, Name))
+			break;
+	if (i == e) {
+		Usage U = { Name, 0, 0 };
+		i = Table.Entries.insert(e, U);
+	}
+	i->Cur = Bytes;
+	i->Peak = std::max(i->Peak, Bytes);
+
+	if (ReportPending) {
+		ReportPending = 0;
+		report(errs());
+	}
+}
+
+// malloc'ed bytes in use.  mallinfo's int fields wrap beyond 2 GB, so
+// older C libraries fall back to the data segment size, which includes
+// free heap memory as well.
+size_t MemAcct::heapBytes() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 mi = mallinfo2();
+	return mi.uordblks + mi.hblkhd;
+#else
+	// size resident shared text lib data dt, in pages
+	unsigned long Pages[6] = {0};
+	if (FILE *fp = fopen("/proc/self/statm", "r")) {
+		if (fscanf(fp, "%lu %lu %lu %lu %lu %lu", &Pages[0], &Pages[1],
+		           &Pages[2], &Pages[3], &Pages[4], &Pages[5]) != 6)
+			Pages[5] = 0;
+		fclose(fp);
+	}
+	return (size_t)Pages[5] * sysconf(_SC_PAGESIZE);
+#endif
+}
+
+void MemAcct::report(raw_ostream &OS) {
+	const double MB = 1024 * 1024;
+	OS << "memory (MB)           current         peak\n";
+	std::vector<Usage>::iterator i = Table.Entries.begin(),
+	                             e = Table.Entries.end();
+	for (; i != e; ++i)
+		OS << format("%-16s %12.1f %12.1f\n", i->Name, i->Cur / MB,
+		             i->Peak / MB);
+	struct rusage ru;
+	if (!getrusage(RUSAGE_SELF, &ru))
+		OS << format("max RSS %35.1f\n", ru.ru_maxrss * 1024 / MB);
+	OS.flush();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <stddef.h>
+
+namespace llvm {
+	class raw_ostream;
+} // namespace llvm
+
+// Memory accounting per subsystem (-mem-stats).
+//
+// Subsystems report their current size at convenient points, either
+// estimated from their data structures with bytesOf() or measured as
+// heap growth with heapBytes(); the peak is the largest size reported.
+// The report prints at exit, and on SIGUSR1 at the next update.
+// Updates must come from the main thread.
+namespace MemAcct {
+
+bool enabled();
+void update(const char *Name, size_t Bytes);
+size_t heapBytes();
+void report(llvm::raw_ostream &);
+
+// Heap bytes owned by a container, roughly: elements plus per-node
+// overhead, but not sizeof the container itself.
+const size_t TreeNodeBytes = 4 * sizeof(void *);
+
+template <typename T>
+inline size_t bytesOf(const T &) { return 0; }
+
+// Declared up front, so that the nested calls below find them rather
+// than the generic one: argument-dependent lookup at instantiation only
+// searches std and llvm.
+inline size_t bytesOf(const std::string &);
+template <typename A, typename B>
+inline size_t bytesOf(const std::pair<A, B> &);
+template <typename T, typename Alloc>
+size_t bytesOf(const std::vector<T, Alloc> &);
+template <typename T, typename Cmp, typename Alloc>
+size_t bytesOf(const std::set<T, Cmp, Alloc> &);
+template <typename K, typename V, typename Cmp, typename Alloc>
+size_t bytesOf(const std::map<K, V, Cmp, Alloc> &);
+template <typename K, typename V, typename KeyInfo>
+size_t bytesOf(const llvm::DenseMap<K, V, KeyInfo> &);
+template <typename T, unsigned N>
+inline size_t bytesOf(const llvm::SmallPtrSet<T, N> &);
+
+inline size_t bytesOf(const std::string &S) { return S.capacity(); }
+
+template <typename A, typename B>
+inline size_t bytesOf(const std::pair<A, B> &P) {
+	return bytesOf(P.first) + bytesOf(P.second);
+}
+
+template <typename T, typename Alloc>
+size_t bytesOf(const std::vector<T, Alloc> &V) {
+	size_t n = V.capacity() * sizeof(T);
+	for (typename std::vector<T, Alloc>::const_iterator i = V.begin(),
+	     e = V.end(); i != e; ++i)
+		n += bytesOf(*i);
+	return n;
+}
+
+template <typename T, typename Cmp, typename Alloc>
+size_t bytesOf(const std::set<T, Cmp, Alloc> &S) {
+	size_t n = S.size() * (TreeNodeBytes + sizeof(T));
+	for (typename std::set<T, Cmp, Alloc>::const_iterator i = S.begin(),
+	     e = S.end(); i != e; ++i)
+		n += bytesOf(*i);
+	return n;
+}
+
+template <typename K, typename V, typename Cmp, typename Alloc>
+size_t bytesOf(const std::map<K, V, Cmp, Alloc> &M) {
+	size_t n = M.size() * (TreeNodeBytes + sizeof(std::pair<K, V>));
+	for (typename std::map<K, V, Cmp, Alloc>::const_iterator i = M.begin(),
+	     e = M.end(); i != e; ++i)
+		n += bytesOf(i->first) + bytesOf(i->second);
+	return n;
+}
+
+template <typename K, typename V, typename KeyInfo>
+size_t bytesOf(const llvm::DenseMap<K, V, KeyInfo> &M) {
+	size_t n = M.getMemorySize();
+	for (typename llvm::DenseMap<K, V, KeyInfo>::const_iterator
+	     i = M.begin(), e = M.end(); i != e; ++i)
+		n += bytesOf(i->first) + bytesOf(i->second);
+	return n;
+}
+
+// small sets live inline; larger ones in a hash table of twice the size
+template <typename T, unsigned N>
+inline size_t bytesOf(const llvm::SmallPtrSet<T, N> &S) {
+	return S.size() > N ? 2 * S.size() * sizeof(void *) : 0;
+}
+
+} // namespace MemAcct
@@ -1,23 +1,82 @@
+#define DEBUG_TYPE "path-gen"
 #include "PathGen.h"
 #include "ValueGen.h"
 #include <llvm/Constants.h>
 #include <llvm/Instructions.h>
 #include <llvm/Analysis/Dominators.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Support/CFG.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
 
 using namespace llvm;
 
-#define SMT VG.SMT
+static cl::opt<unsigned>
+UnrollOpt("unroll", cl::desc("Unroll innermost loops in path conditions"),
+          cl::value_desc("iterations"));
 
-PathGen::PathGen(ValueGen &VG, const EdgeVec &BE)
-	: VG(VG), Backedges(BE), DT(NULL) {}
+static cl::opt<bool>
+SliceOpt("slice-paths",
+         cl::desc("Drop branch conditions unrelated to the checked value"));
 
-PathGen::PathGen(ValueGen &VG, const EdgeVec &Backedges, DominatorTree &DT)
-	: VG(VG), Backedges(Backedges), DT(&DT) {}
+STATISTIC(NumLoopsUnrolled, "Number of loops unrolled");
+STATISTIC(NumLoopsKept, "Number of loops not unrolled (outer or irreducible)");
+STATISTIC(NumBlockIters, "Number of guards of blocks in unrolled loops");
 
-PathGen::~PathGen() {
-	for (iterator i = Cache.begin(), e = Cache.end(); i != e; ++i)
-		SMT.decref(i->second);
+#define DAG VG.DAG
+
+PathGen::PathGen(ValueGen &VG, const EdgeVec &BE, Encoding Enc)
+	: VG(VG), Backedges(BE), DT(NULL), Enc(Enc) {
+	findLoops();
+}
+
+PathGen::PathGen(ValueGen &VG, const EdgeVec &Backedges, DominatorTree &DT,
+                 Encoding Enc)
+	: VG(VG), Backedges(Backedges), DT(&DT), Enc(Enc) {
+	findLoops();
+}
+
+// Record innermost natural loops in VG for -unroll.  The body of a
+// loop is what reaches a latch without passing the header; if that
+// includes the entry block the header does not dominate the latch.
+// cmpck, which passes DT, needs guards that over-approximate paths:
+// bounded to K iterations, a comparison true only in later ones would
+// be reported as always false.
+void PathGen::findLoops() {
+	if (!UnrollOpt || DT || Backedges.empty())
+		return;
+	typedef SmallPtrSet<BasicBlock *, 16> BlockSet;
+	DenseMap<BasicBlock *, BlockSet> Bodies;
+	for (unsigned i = 0, n = Backedges.size(); i != n; ++i) {
+		BasicBlock *Latch = const_cast<BasicBlock *>(Backedges[i].first);
+		BasicBlock *Header = const_cast<BasicBlock *>(Backedges[i].second);
+		BlockSet &Body = Bodies[Header];
+		Body.insert(Header);
+		SmallVector<BasicBlock *, 16> Worklist(1, Latch);
+		while (!Worklist.empty()) {
+			BasicBlock *BB = Worklist.pop_back_val();
+			if (Body.insert(BB))
+				Worklist.append(pred_begin(BB), pred_end(BB));
+		}
+	}
+	VG.Unroll = UnrollOpt;
+	DenseMap<BasicBlock *, BlockSet>::iterator i, e = Bodies.end();
+	for (i = Bodies.begin(); i != e; ++i) {
+		BasicBlock *Header = i->first;
+		BlockSet &Body = i->second;
+		bool Innermost = !Body.count(&Header->getParent()->getEntryBlock());
+		DenseMap<BasicBlock *, BlockSet>::iterator j;
+		for (j = Bodies.begin(); Innermost && j != e; ++j)
+			Innermost = j == i || !Body.count(j->first);
+		if (!Innermost) {
+			++NumLoopsKept;
+			continue;
+		}
+		++NumLoopsUnrolled;
+		for (BlockSet::iterator k = Body.begin(), ke = Body.end(); k != ke; ++k)
+			VG.Loops[*k] = Header;
+	}
 }
 
 static BasicBlock *findCommonDominator(BasicBlock *BB, DominatorTree *DT) {
@@ -28,45 +87,99 @@ static BasicBlock *findCommonDominator(BasicBlock *BB, DominatorTree *DT) {
 	return Dom;
 }
 
-SMTExpr PathGen::get(BasicBlock *BB) {
-	SMTExpr G = Cache.lookup(BB);
+unsigned PathGen::unroll() {
+	return UnrollOpt;
+}
+
+bool PathGen::slicing() {
+	return SliceOpt;
+}
+
+// Reachability variables of the linear encoding hide the conditions.
+SMTNode *PathGen::slice(SMTNode *G, SMTNode *V) {
+	if (!SliceOpt || Enc == Linear)
+		return G;
+	return DAG.slice(G, V);
+}
+
+unsigned PathGen::iterations(BasicBlock *BB) {
+	return VG.Loops.count(BB) ? VG.Unroll : 1;
+}
+
+SMTNode *PathGen::get(BasicBlock *BB) {
+	return get(BB, 0);
+}
+
+SMTNode *PathGen::get(BasicBlock *BB, unsigned Iter) {
+	BasicBlock *Header = VG.Loops.lookup(BB);
+	if (!Header)
+		Iter = 0;
+	BBIter Key(BB, Iter);
+	SMTNode *G = Cache.lookup(Key);
 	if (G)
 		return G;
 	// Entry block has true guard.
 	if (BB == &BB->getParent()->getEntryBlock()) {
-		G = SMT.bvtrue();
-		Cache[BB] = G;
+		G = DAG.bvtrue();
+		Cache[Key] = G;
 		return G;
 	}
 	pred_iterator i, e = pred_end(BB);
-	if (DT) {
+	if (DT && !Header) {
 		// Fall back to common ancestors if any back edges.
 		for (i = pred_begin(BB); i != e; ++i) {
 			if (isBackedge(*i, BB))
 				return get(findCommonDominator(BB, DT));
 		}
 	}
+	if (Header)
+		++NumBlockIters;
 	// The guard is the disjunction of predecessors' guards.
 	// Initialize to false.
-	G = SMT.bvfalse();
+	G = DAG.bvfalse();
 	for (i = pred_begin(BB); i != e; ++i) {
 		BasicBlock *Pred = *i;
+		BasicBlock *PredHeader = VG.Loops.lookup(Pred);
+		// Within an unrolled loop, the header is entered from the
+		// previous iteration.
+		if (Header && PredHeader == Header) {
+			if (BB != Header)
+				G = DAG.bvor(G, getEdgeGuard(Pred, Iter, BB, Iter));
+			else if (Iter)
+				G = DAG.bvor(G, getEdgeGuard(Pred, Iter - 1, BB, Iter));
+			continue;
+		}
+		// Only the first iteration is entered from outside.
+		if (Iter)
+			continue;
 		// Skip back edges.
 		if (!DT && isBackedge(Pred, BB))
 			continue;
-		SMTExpr Term = getTermGuard(Pred->getTerminator(), BB);
-		SMTExpr PN = getPHIGuard(BB, Pred);
-		SMTExpr TermWithPN = SMT.bvand(Term, PN);
-		SMT.decref(Term);
-		SMT.decref(PN);
-		SMTExpr Br = SMT.bvand(TermWithPN, get(Pred));
-		SMT.decref(TermWithPN);
-		SMTExpr Tmp = SMT.bvor(G, Br);
-		SMT.decref(G);
-		SMT.decref(Br);
-		G = Tmp;
+		if (!PredHeader) {
+			G = DAG.bvor(G, getEdgeGuard(Pred, 0, BB, 0));
+			continue;
+		}
+		// Leaving an unrolled loop fixes its exit iteration.
+		SMTNode *Exit = VG.exitIter(PredHeader);
+		for (unsigned n = 0; n != VG.Unroll; ++n) {
+			SMTNode *N = DAG.bvconst(APInt(DAG.bvwidth(Exit), n));
+			SMTNode *Br = getEdgeGuard(Pred, n, BB, 0);
+			G = DAG.bvor(G, DAG.bvand(Br, DAG.eq(Exit, N)));
+		}
 	}
-	Cache[BB] = G;
+	if (Enc == Linear && !G->isConst()) {
+		std::string Name;
+		{
+			raw_string_ostream OS(Name);
+			OS << "reach@" << BB;
+			if (Iter)
+				OS << "#" << Iter;
+		}
+		SMTNode *R = DAG.bvvar(1, Name.c_str());
+		DAG.assume(DAG.eq(R, G));
+		G = R;
+	}
+	Cache[Key] = G;
 	return G;
 }
 
@@ -75,8 +188,16 @@ bool PathGen::isBackedge(llvm::BasicBlock *From, llvm::BasicBlock *To) {
 		!= Backedges.end();
 }
 
-SMTExpr PathGen::getPHIGuard(BasicBlock *BB, BasicBlock *Pred) {
-	SMTExpr E = SMT.bvtrue();
+SMTNode *PathGen::getEdgeGuard(BasicBlock *Pred, unsigned PredIter,
+                               BasicBlock *BB, unsigned Iter) {
+	SMTNode *Term = getTermGuard(Pred->getTerminator(), PredIter, BB);
+	SMTNode *PN = getPHIGuard(BB, Iter, Pred, PredIter);
+	return DAG.bvand(DAG.bvand(Term, PN), get(Pred, PredIter));
+}
+
+SMTNode *PathGen::getPHIGuard(BasicBlock *BB, unsigned Iter,
+                              BasicBlock *Pred, unsigned PredIter) {
+	SMTNode *E = DAG.bvtrue();
 	BasicBlock::iterator i = BB->begin(), e = BB->end();
 	for (; i != e; ++i) {
 		PHINode *I = dyn_cast<PHINode>(i);
@@ -90,76 +211,63 @@ SMTExpr PathGen::getPHIGuard(BasicBlock *BB, BasicBlock *Pred) {
 		if (!ValueGen::isAnalyzable(V))
 			continue;
 		// Generate I == V.
-		SMTExpr PN = SMT.eq(VG.get(I), VG.get(V));
-		SMTExpr Tmp = SMT.bvand(E, PN);
-		SMT.decref(E);
-		SMT.decref(PN);
-		E = Tmp;
+		SMTNode *PN = VG.get(I, BB, Iter);
+		E = DAG.bvand(E, DAG.eq(PN, VG.get(V, Pred, PredIter)));
 	}
 	return E;
 }
 
-SMTExpr PathGen::getTermGuard(TerminatorInst *I, BasicBlock *BB) {
+SMTNode *PathGen::getTermGuard(TerminatorInst *I, unsigned Iter,
+                               BasicBlock *BB) {
 	switch (I->getOpcode()) {
 	default: I->dump(); llvm_unreachable("Unknown terminator!");
 	case Instruction::Br:
-		return getTermGuard(cast<BranchInst>(I), BB);
+		return getTermGuard(cast<BranchInst>(I), Iter, BB);
 	case Instruction::Switch:
-		return getTermGuard(cast<SwitchInst>(I), BB);
+		return getTermGuard(cast<SwitchInst>(I), Iter, BB);
 	case Instruction::IndirectBr:
 	case Instruction::Invoke:
-		return SMT.bvtrue();
+		return DAG.bvtrue();
 	}
 }
 
-SMTExpr PathGen::getTermGuard(BranchInst *I, BasicBlock *BB) {
+SMTNode *PathGen::getTermGuard(BranchInst *I, unsigned Iter,
+                               BasicBlock *BB) {
 	if (I->isUnconditional())
-		return SMT.bvtrue();
+		return DAG.bvtrue();
 	// Conditional branch.
 	Value *V = I->getCondition();
-	SMTExpr E = VG.get(V);
-	SMT.incref(E);
+	SMTNode *E = VG.get(V, I->getParent(), Iter);
 	// True or false branch.
 	if (I->getSuccessor(0) != BB) {
 		assert(I->getSuccessor(1) == BB);
-		SMTExpr Tmp = SMT.bvnot(E);
-		SMT.decref(E);
-		E = Tmp;
+		E = DAG.bvnot(E);
 	}
 	return E;
 }
 
-SMTExpr PathGen::getTermGuard(SwitchInst *I, BasicBlock *BB) {
+SMTNode *PathGen::getTermGuard(SwitchInst *I, unsigned Iter,
+                               BasicBlock *BB) {
 	Value *V = I->getCondition();
-	SMTExpr L = VG.get(V);
+	SMTNode *L = VG.get(V, I->getParent(), Iter);
 	SwitchInst::CaseIt i = I->case_begin(), e = I->case_end();
 	if (I->getDefaultDest() != BB) {
 		// Find all x = C_i for BB.
-		SMTExpr E = SMT.bvfalse();
+		SMTNode *E = DAG.bvfalse();
 		for (; i != e; ++i) {
 			if (i.getCaseSuccessor() == BB) {
 				ConstantInt *CI = i.getCaseValue();
-				SMTExpr Cond = SMT.eq(L, VG.get(CI));
-				SMTExpr Tmp = SMT.bvor(E, Cond);
-				SMT.decref(Cond);
-				SMT.decref(E);
-				E = Tmp;
+				E = DAG.bvor(E, DAG.eq(L, VG.get(CI)));
 			}
 		}
 		return E;
 	}
 	// Compute guard for the default case.
 	// i starts from 1; 0 is reserved for the default.
-	SMTExpr E = SMT.bvfalse();
+	SMTNode *E = DAG.bvfalse();
 	for (; i != e; ++i) {
 		ConstantInt *CI = i.getCaseValue();
-		SMTExpr Cond = SMT.eq(L, VG.get(CI));
-		SMTExpr Tmp = SMT.bvor(E, Cond);
-		SMT.decref(Cond);
-		SMT.decref(E);
-		E = Tmp;
+		E = DAG.bvor(E, DAG.eq(L, VG.get(CI)));
 	}
-	SMTExpr NotE = SMT.bvnot(E);
-	SMT.decref(E);
-	return NotE;
+	return DAG.bvnot(E);
 }
@@ -2,7 +2,7 @@
 
 #include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallVector.h>
-#include "SMTSolver.h"
+#include "SMTDag.h"
 
 namespace llvm {
 	class BasicBlock;
@@ -16,26 +16,55 @@ class ValueGen;
 
 class PathGen {
 public:
-	typedef llvm::DenseMap<llvm::BasicBlock *, SMTExpr> BBExprMap;
+	// Guards of blocks by iteration, which is 0 outside unrolled loops.
+	typedef std::pair<llvm::BasicBlock *, unsigned> BBIter;
+	typedef llvm::DenseMap<BBIter, SMTNode *> BBExprMap;
 	typedef BBExprMap::iterator iterator;
 	typedef std::pair<const llvm::BasicBlock *, const llvm::BasicBlock *> Edge;
 	typedef llvm::SmallVectorImpl<Edge> EdgeVec;
 
-	PathGen(ValueGen &, const EdgeVec &);
-	PathGen(ValueGen &, const EdgeVec &, llvm::DominatorTree &DT);
-	~PathGen();
+	// Nested expands each guard into its predecessors' guards; Linear
+	// gives each block a reachability variable, constrained as
+	// reach(BB) = OR (reach(Pred) AND edge(Pred, BB)), so that the
+	// formula grows with the number of edges.
+	enum Encoding { Nested, Linear };
 
-	SMTExpr get(llvm::BasicBlock *);
+	PathGen(ValueGen &, const EdgeVec &, Encoding = Nested);
+	PathGen(ValueGen &, const EdgeVec &, llvm::DominatorTree &DT,
+	        Encoding = Nested);
+
+	SMTNode *get(llvm::BasicBlock *);
+	// Guard of BB in the given iteration of its loop; with -unroll=K,
+	// innermost loops are unrolled K times and paths are bounded to
+	// them, except with DT (cmpck).  Elsewhere back edges are handled
+	// as without -unroll.
+	SMTNode *get(llvm::BasicBlock *, unsigned Iter);
+	// Number of iterations of BB: K in an unrolled loop, otherwise 1.
+	unsigned iterations(llvm::BasicBlock *);
+	// With -slice-paths, G without the branch conditions unrelated to
+	// the checked value V (see SMTDag::slice); otherwise G.
+	SMTNode *slice(SMTNode *G, SMTNode *V);
+	// K of -unroll, or 0.
+	static unsigned unroll();
+	static bool slicing();
 
 private:
 	ValueGen &VG;
 	const EdgeVec &Backedges;
 	llvm::DominatorTree *DT;
+	Encoding Enc;
 	BBExprMap Cache;
 
+	void findLoops();
 	bool isBackedge(llvm::BasicBlock *, llvm::BasicBlock *);
-	SMTExpr getTermGuard(llvm::TerminatorInst *I, llvm::BasicBlock *BB);
-	SMTExpr getTermGuard(llvm::BranchInst *I, llvm::BasicBlock *BB);
-	SMTExpr getTermGuard(llvm::SwitchInst *I, llvm::BasicBlock *BB);
-	SMTExpr getPHIGuard(llvm::BasicBlock *BB, llvm::BasicBlock *Pred);
+	SMTNode *getEdgeGuard(llvm::BasicBlock *Pred, unsigned PredIter,
+	                      llvm::BasicBlock *BB, unsigned Iter);
+	SMTNode *getTermGuard(llvm::TerminatorInst *I, unsigned Iter,
+	                      llvm::BasicBlock *BB);
+	SMTNode *getTermGuard(llvm::BranchInst *I, unsigned Iter,
+	                      llvm::BasicBlock *BB);
+	SMTNode *getTermGuard(llvm::SwitchInst *I, unsigned Iter,
+	                      llvm::BasicBlock *BB);
+	SMTNode *getPHIGuard(llvm::BasicBlock *BB, unsigned Iter,
+	                     llvm::BasicBlock *Pred, unsigned PredIter);
 };
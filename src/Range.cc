@@ -6,17 +6,22 @@
 #include <llvm/Module.h>
 #include <llvm/Constants.h>
 #include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringExtras.h>
 #include <llvm/DebugInfo.h>
+#include <llvm/Support/Atomic.h>
+#include <llvm/Support/Threading.h>
 #include <llvm/Analysis/CallGraph.h>
 #include <llvm/Analysis/LoopInfo.h>
 #include <llvm/Analysis/ScalarEvolution.h>
 #include <llvm/Analysis/ScalarEvolutionExpressions.h>
 #include <llvm/Transforms/Utils/BasicBlockUtils.h>
 #include "llvm/Support/CommandLine.h"
+#include <pthread.h>
 
 #include "Annotation.h"
 #include "IntGlobal.h"
+#include "MemAcct.h"
 
 using namespace llvm;
 
@@ -24,10 +29,15 @@ static cl::opt<std::string>
 WatchID("w", cl::desc("Watch sID"), 
 			   cl::value_desc("sID"));
 
+static cl::opt<unsigned>
+Jobs("range-jobs", cl::desc("Number of threads per range sweep"),
+	 cl::value_desc("N"), cl::init(1));
+
 bool RangePass::unionRange(StringRef sID, const CRange &R,
 						   Value *V = NULL)
 {
-	if (R.isEmptySet())
+	// with -demand, facts of other IDs are not computed
+	if (R.isEmptySet() || !Ctx->isDemanded(sID))
 		return false;
 	
 	if (WatchID == sID && V) {
@@ -37,6 +47,16 @@ bool RangePass::unionRange(StringRef sID, const CRange &R,
 		dbgs() << "\n";
 	}
 	
+	// parallel sweep: buffer the update, merged at the end of the sweep
+	if (Deltas) {
+		RangeMap::iterator it = Deltas->find(sID);
+		if (it != Deltas->end())
+			it->second.safeUnion(R);
+		else
+			Deltas->insert(std::make_pair(sID, R));
+		return false;
+	}
+
 	bool changed = true;
 	RangeMap::iterator it = Ctx->IntRanges.find(sID);
 	if (it != Ctx->IntRanges.end()) {
@@ -53,78 +73,73 @@ bool RangePass::unionRange(StringRef sID, const CRange &R,
 	return changed;
 }
 
-bool RangePass::unionRange(BasicBlock *BB, Value *V,
-						   const CRange &R)
+bool RangePass::unionRange(unsigned BB, uint32_t Slot, const CRange &R)
 {
 	if (R.isEmptySet())
 		return false;
 	
 	bool changed = true;
-	ValueRangeMap &VRM = FuncVRMs[BB];
-	ValueRangeMap::iterator it = VRM.find(V);
+	SlotRangeMap &VRM = FuncVRMs[BB];
+	SlotRangeMap::iterator it = VRM.find(Slot);
 	if (it != VRM.end())
 		changed = it->second.safeUnion(R);
 	else
-		VRM.insert(std::make_pair(V, R));
+		VRM.insert(std::make_pair(Slot, R));
 	return changed;
 }
 
-CRange RangePass::getRange(BasicBlock *BB, Value *V)
+CRange RangePass::getRange(const RangeFunction &RF, unsigned BB,
+						   uint32_t Slot)
 {
 	// constants
-	if (ConstantInt *C = dyn_cast<ConstantInt>(V))
-		return CRange(C->getValue());
+	if (RF.Kind[Slot] == RK_Const)
+		return CRange(cast<ConstantInt>(RF.Slots[Slot])->getValue());
 	
-	ValueRangeMap &VRM = FuncVRMs[BB];
-	ValueRangeMap::iterator invrm = VRM.find(V);
+	SlotRangeMap &VRM = FuncVRMs[BB];
+	SlotRangeMap::iterator invrm = VRM.find(Slot);
 	
 	if (invrm != VRM.end())
 		return invrm->second;
 	
 	// V must be integer or pointer to integer
-	IntegerType *Ty = dyn_cast<IntegerType>(V->getType());
-	if (PointerType *PTy = dyn_cast<PointerType>(V->getType()))
-		Ty = dyn_cast<IntegerType>(PTy->getElementType());
-	assert(Ty != NULL);
+	unsigned Bits = RF.Width[Slot];
+	assert(Bits != 0);
 	
 	// not found in VRM, lookup global range, return empty set by default
-	CRange CR(Ty->getBitWidth(), false);
-	CRange Fullset(Ty->getBitWidth(), true);
+	CRange CR(Bits, false);
+	CRange Fullset(Bits, true);
 	
 	RangeMap &IRM = Ctx->IntRanges;
-	TaintPass TI(Ctx);
+	uint32_t i = RF.GlobalBegin[Slot], e = RF.GlobalBegin[Slot + 1];
 	
-	if (CallInst *CI = dyn_cast<CallInst>(V)) {
+	if (RF.Kind[Slot] == RK_Call) {
 		// calculate union of values ranges returned by all possible callees
-		if (!CI->isInlineAsm() && Ctx->Callees.count(CI)) {
-			FuncSet &CEEs = Ctx->Callees[CI];
-			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
-				 i != e; ++i) {
-				std::string sID = getRetId(*i);
-				if (sID != "" && TI.isTaintSource(sID)) {
-					CR = Fullset;
-					break;
-				}
-				RangeMap::iterator it;
-				if ((it = IRM.find(sID)) != IRM.end())
-					CR.safeUnion(it->second);
+		for (; i != e; ++i) {
+			const std::string &sID = Ctx->IDs.str(RF.GlobalIDs[i]);
+			if (sID != "" && (Ctx->Taints.isSource(sID)
+							  || !Ctx->isDemanded(sID))) {
+				CR = Fullset;
+				break;
 			}
+			RangeMap::iterator it;
+			if ((it = IRM.find(sID)) != IRM.end())
+				CR.safeUnion(it->second);
 		}
 	} else {
 		// arguments & loads
-		std::string sID = getValueId(V);
-		if (sID != "") {
+		if (i != e) {
+			const std::string &sID = Ctx->IDs.str(RF.GlobalIDs[i]);
 			RangeMap::iterator it;
-			if (TI.isTaintSource(sID))
+			if (Ctx->Taints.isSource(sID) || !Ctx->isDemanded(sID))
 				CR = Fullset;
 			else if ((it = IRM.find(sID)) != IRM.end())
 				CR = it->second;
 		}
 		// might load part of a struct field
-		CR = CR.zextOrTrunc(Ty->getBitWidth());
+		CR = CR.zextOrTrunc(Bits);
 	}
 	if (!CR.isEmptySet())
-		VRM.insert(std::make_pair(V, CR));
+		VRM.insert(std::make_pair(Slot, CR));
 	return CR;
 }
 
@@ -175,6 +190,9 @@ void RangePass::collectInitializers(GlobalVariable *GV, Constant *I)
 //
 bool RangePass::doInitialization(Module *M)
 {	
+	// make later metadata lookups read-only (see doParallelSweep)
+	M->getContext().getMDKindID(MD_ID);
+
 	// Looking for global variables
 	for (Module::global_iterator i = M->global_begin(), 
 		 e = M->global_end(); i != e; ++i) {
@@ -187,302 +205,498 @@ bool RangePass::doInitialization(Module *M)
 }
 
 
-CRange RangePass::visitBinaryOp(BinaryOperator *BO)
+// Ops of a lowered function, block by block in layout order.  Each
+// block starts with its predecessors other than by back edges, each
+// with how its terminator refines the ranges flowing into the block.
+enum {
+	R_Block,	// [R_Block, block, #preds, (pred, edge op...)...]
+	R_Jump,		// [R_Jump]
+	R_Branch,	// [R_Branch, predicate, taken, icmp block, lhs, rhs]
+	R_Switch,	// [R_Switch, default, cond, #cases, case slot...]
+	R_Store,	// [R_Store, ID, value, pointer, store]
+	R_Export,	// [R_Export, ID, value, inst]: returns, call arguments
+	R_Binary,	// [R_Binary, opcode, slot, lhs, rhs]
+	R_Cast,		// [R_Cast, opcode, slot, operand]
+	R_Select,	// [R_Select, slot, true, false]
+	R_PHI,		// [R_PHI, slot, #incoming, (pred, value)...]
+	R_Global,	// [R_Global, slot]: loads and calls
+	R_Full,		// [R_Full, slot]
+};
+
+static const uint32_t NoSlot = ~0U;
+
+void RangePass::lowerEdge(TerminatorInst *I, BasicBlock *BB,
+						  BlockMap &Blocks, FactBuilder &B)
 {
-	CRange L = getRange(BO->getParent(), BO->getOperand(0));
-	CRange R = getRange(BO->getParent(), BO->getOperand(1));
-	R.match(L);
-	switch (BO->getOpcode()) {
-		default: BO->dump(); llvm_unreachable("Unknown binary operator!");
-		case Instruction::Add:  return L.add(R);
-		case Instruction::Sub:  return L.sub(R);
-		case Instruction::Mul:  return L.multiply(R);
-		case Instruction::UDiv: return L.udiv(R);
-		case Instruction::SDiv: return L.sdiv(R);
-		case Instruction::URem: return R; // FIXME
-		case Instruction::SRem: return R; // FIXME
-		case Instruction::Shl:  return L.shl(R);
-		case Instruction::LShr: return L.lshr(R);
-		case Instruction::AShr: return L; // FIXME
-		case Instruction::And:  return L.binaryAnd(R);
-		case Instruction::Or:   return L.binaryOr(R);
-		case Instruction::Xor:  return L; // FIXME
+	if (BranchInst *BI = dyn_cast<BranchInst>(I)) {
+		ICmpInst *ICI = NULL;
+		if (BI->isConditional())
+			ICI = dyn_cast<ICmpInst>(BI->getCondition());
+		if (ICI && ICI->getOperand(0)->getType()->isIntegerTy()
+		    && ICI->getOperand(1)->getType()->isIntegerTy()) {
+			B.emit(R_Branch);
+			B.emit(ICI->getPredicate());
+			B.emit(BI->getSuccessor(0) == BB);
+			B.emit(Blocks[ICI->getParent()]);
+			B.emit(B.slot(ICI->getOperand(0)));
+			B.emit(B.slot(ICI->getOperand(1)));
+			return;
+		}
+	} else if (SwitchInst *SI = dyn_cast<SwitchInst>(I)) {
+		Value *V = SI->getCondition();
+		if (V->getType()->isIntegerTy()) {
+			// values that go to BB, or all others by default
+			bool Default = SI->getDefaultDest() == BB;
+			SmallVector<uint32_t, 8> Cases;
+			for (SwitchInst::CaseIt i = SI->case_begin(),
+				 e = SI->case_end(); i != e; ++i)
+				if (Default || i.getCaseSuccessor() == BB)
+					Cases.push_back(B.slot(i.getCaseValue()));
+			B.emit(R_Switch);
+			B.emit(Default);
+			B.emit(B.slot(V));
+			B.emit(Cases.size());
+			for (unsigned i = 0; i != Cases.size(); ++i)
+				B.emit(Cases[i]);
+			return;
+		}
 	}
+	B.emit(R_Jump);
 }
 
-
-CRange RangePass::visitCastInst(CastInst *CI)
+void RangePass::lowerInst(Instruction *I, unsigned BB, BlockMap &Blocks,
+						  RangeFunction &RF, FactBuilder &B)
 {
-	unsigned bits = dyn_cast<IntegerType>(
-								CI->getDestTy())->getBitWidth();
-	
-	BasicBlock *BB = CI->getParent();
-	Value *V = CI->getOperand(0);
-	switch (CI->getOpcode()) {
-		case CastInst::Trunc:    return getRange(BB, V).zextOrTrunc(bits);
-		case CastInst::ZExt:     return getRange(BB, V).zextOrTrunc(bits);
-		case CastInst::SExt:     return getRange(BB, V).signExtend(bits);
-		case CastInst::BitCast:  return getRange(BB, V);
-		default:                 return CRange(bits, true);
+	// store, return and call might update global range
+	if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+		Value *V = SI->getValueOperand();
+		StringRef sID = getLoadStoreId(SI);
+		if (V->getType()->isIntegerTy() && !sID.empty()) {
+			B.emit(R_Store);
+			B.emit(Ctx->IDs.get(sID));
+			B.emit(B.slot(V));
+			B.emit(B.slot(SI->getPointerOperand()));
+			B.emit(B.slot(SI));
+		}
+	} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
+		Value *V = RI->getReturnValue();
+		if (V && V->getType()->isIntegerTy()) {
+			B.emit(R_Export);
+			B.emit(Ctx->IDs.get(getRetId(RI->getParent()->getParent())));
+			B.emit(B.slot(V));
+			B.emit(B.slot(RI));
+		}
+	} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+		CalleeMap::iterator ci = Ctx->Callees.find(CI);
+		if (!CI->isInlineAsm() && ci != Ctx->Callees.end()) {
+			// update arguments of all possible callees
+			FuncSet &CEEs = ci->second;
+			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
+				 i != e; ++i) {
+				// skip vaarg and builtin functions
+				if ((*i)->isVarArg() 
+					|| (*i)->getName().find('.') != StringRef::npos)
+					continue;
+				
+				for (unsigned j = 0; j < CI->getNumArgOperands(); ++j) {
+					Value *V = CI->getArgOperand(j);
+					// skip non-integer arguments
+					if (!V->getType()->isIntegerTy())
+						continue;
+					B.emit(R_Export);
+					B.emit(Ctx->IDs.get(getArgId(*i, j)));
+					B.emit(B.slot(V));
+					B.emit(B.slot(CI));
+				}
+			}
+			// range for the return value of this call site
+			if (CI->getType()->isIntegerTy()) {
+				B.emit(R_Export);
+				B.emit(Ctx->IDs.get(getRetId(CI)));
+				B.emit(B.slot(CI));
+				B.emit(B.slot(CI));
+			}
+		}
+	} else if (GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(I)) {
+		// indices for idxrange, see annotateIndices
+		RF.Indices.push_back(BB);
+		for (User::op_iterator j = GEP->idx_begin(), je = GEP->idx_end();
+			 j != je; ++j) {
+			Value *V = *j;
+			if (!isa<Constant>(V) && V->getType()->isIntegerTy())
+				RF.Indices.push_back(B.slot(V));
+			else
+				RF.Indices.push_back(NoSlot);
+		}
 	}
-}
-
-CRange RangePass::visitSelectInst(SelectInst *SI)
-{
-	CRange T = getRange(SI->getParent(), SI->getTrueValue());
-	CRange F = getRange(SI->getParent(), SI->getFalseValue());
-	T.safeUnion(F);
-	return T;
-}
-
-CRange RangePass::visitPHINode(PHINode *PHI)
-{
-	IntegerType *Ty = cast<IntegerType>(PHI->getType());
-	CRange CR(Ty->getBitWidth(), false);
 	
-	for (unsigned i = 0, n = PHI->getNumIncomingValues(); i < n; ++i) {
-		BasicBlock *Pred = PHI->getIncomingBlock(i);
+	if (!I->getType()->isIntegerTy())
+		return;
+	
+	if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
+		B.emit(R_Binary);
+		B.emit(BO->getOpcode());
+		B.emit(B.slot(BO));
+		B.emit(B.slot(BO->getOperand(0)));
+		B.emit(B.slot(BO->getOperand(1)));
+	} else if (CastInst *CI = dyn_cast<CastInst>(I)) {
+		B.emit(R_Cast);
+		B.emit(CI->getOpcode());
+		B.emit(B.slot(CI));
+		B.emit(B.slot(CI->getOperand(0)));
+	} else if (SelectInst *SI = dyn_cast<SelectInst>(I)) {
+		B.emit(R_Select);
+		B.emit(B.slot(SI));
+		B.emit(B.slot(SI->getTrueValue()));
+		B.emit(B.slot(SI->getFalseValue()));
+	} else if (PHINode *PHI = dyn_cast<PHINode>(I)) {
 		// skip back edges
-		if (isBackEdge(Edge(Pred, PHI->getParent())))
-			continue;
-		CR.safeUnion(getRange(Pred, PHI->getIncomingValue(i)));
+		SmallVector<unsigned, 4> Incoming;
+		for (unsigned i = 0, n = PHI->getNumIncomingValues(); i < n; ++i)
+			if (!isBackEdge(Edge(PHI->getIncomingBlock(i), PHI->getParent())))
+				Incoming.push_back(i);
+		B.emit(R_PHI);
+		B.emit(B.slot(PHI));
+		B.emit(Incoming.size());
+		for (unsigned i = 0; i != Incoming.size(); ++i) {
+			B.emit(Blocks[PHI->getIncomingBlock(Incoming[i])]);
+			B.emit(B.slot(PHI->getIncomingValue(Incoming[i])));
+		}
+	} else if (isa<LoadInst>(I) || isa<CallInst>(I)) {
+		B.emit(R_Global);
+		B.emit(B.slot(I));
+	} else {
+		B.emit(R_Full);
+		B.emit(B.slot(I));
 	}
-	return CR;
 }
 
-bool RangePass::visitCallInst(CallInst *CI)
+void RangePass::lower(Function *F, RangeFunction &RF)
 {
-	bool changed = false;
-	if (CI->isInlineAsm() || Ctx->Callees.count(CI) == 0)
-		return false;
+	FactBuilder B(RF);
+	BlockMap Blocks;
+	for (Function::iterator b = F->begin(), be = F->end(); b != be; ++b) {
+		unsigned n = Blocks.size();
+		Blocks[&*b] = n;
+	}
+	RF.NumBlocks = Blocks.size();
+	BackEdges.clear();
+	FindFunctionBackedges(*F, BackEdges);
 
-	// update arguments of all possible callees
-	FuncSet &CEEs = Ctx->Callees[CI];
-	for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end(); i != e; ++i) {
-		// skip vaarg and builtin functions
-		if ((*i)->isVarArg() 
-			|| (*i)->getName().find('.') != StringRef::npos)
-			continue;
-		
-		for (unsigned j = 0; j < CI->getNumArgOperands(); ++j) {
-			Value *V = CI->getArgOperand(j);
-			// skip non-integer arguments
-			if (!V->getType()->isIntegerTy())
-				continue;
-			std::string sID = getArgId(*i, j);
-			changed |= unionRange(sID, getRange(CI->getParent(), V), CI);
+	for (Function::iterator b = F->begin(), be = F->end(); b != be; ++b) {
+		BasicBlock *BB = &*b;
+		SmallVector<BasicBlock *, 4> Preds;
+		for (pred_iterator i = pred_begin(BB), e = pred_end(BB); i != e; ++i)
+			if (!isBackEdge(Edge(*i, BB)))
+				Preds.push_back(*i);
+		B.emit(R_Block);
+		B.emit(Blocks[BB]);
+		B.emit(Preds.size());
+		for (unsigned i = 0; i != Preds.size(); ++i) {
+			B.emit(Blocks[Preds[i]]);
+			lowerEdge(Preds[i]->getTerminator(), BB, Blocks, B);
 		}
+		for (BasicBlock::iterator i = BB->begin(), e = BB->end(); i != e; ++i)
+			lowerInst(&*i, Blocks[BB], Blocks, RF, B);
 	}
-	// range for the return value of this call site
-	if (CI->getType()->isIntegerTy())
-		changed |= unionRange(getRetId(CI), getRange(CI->getParent(), CI), CI);
-	return changed;
-}
 
-bool RangePass::visitStoreInst(StoreInst *SI)
-{
-	std::string sID = getValueId(SI);
-	Value *V = SI->getValueOperand();
-	if (V->getType()->isIntegerTy() && sID != "") {
-		CRange CR = getRange(SI->getParent(), V);
-		unionRange(SI->getParent(), SI->getPointerOperand(), CR);
-		return unionRange(sID, CR, SI);
+	// where to look for global ranges of each slot
+	unsigned n = RF.Slots.size();
+	RF.Kind.resize(n);
+	RF.Width.resize(n);
+	RF.GlobalBegin.resize(n + 1);
+	for (unsigned i = 0; i != n; ++i) {
+		Value *V = RF.Slots[i];
+		Type *Ty = V->getType();
+		if (PointerType *PTy = dyn_cast<PointerType>(Ty))
+			Ty = PTy->getElementType();
+		RF.Width[i] = Ty->isIntegerTy() ? cast<IntegerType>(Ty)->getBitWidth() : 0;
+		RF.GlobalBegin[i] = RF.GlobalIDs.size();
+		if (isa<ConstantInt>(V)) {
+			RF.Kind[i] = RK_Const;
+		} else if (CallInst *CI = dyn_cast<CallInst>(V)) {
+			RF.Kind[i] = RK_Call;
+			CalleeMap::iterator ci = Ctx->Callees.find(CI);
+			if (!CI->isInlineAsm() && ci != Ctx->Callees.end()) {
+				FuncSet &CEEs = ci->second;
+				for (FuncSet::iterator j = CEEs.begin(), je = CEEs.end();
+					 j != je; ++j)
+					RF.GlobalIDs.push_back(Ctx->IDs.get(getRetId(*j)));
+			}
+		} else {
+			RF.Kind[i] = RK_Value;
+			if (uint32_t ID = Ctx->IDs.get(getValueId(V)))
+				RF.GlobalIDs.push_back(ID);
+		}
 	}
-	return false;
+	RF.GlobalBegin[n] = RF.GlobalIDs.size();
 }
 
-bool RangePass::visitReturnInst(ReturnInst *RI)
+bool RangePass::isBackEdge(const Edge &E)
 {
-	Value *V = RI->getReturnValue();
-	if (!V || !V->getType()->isIntegerTy())
-		return false;
-	
-	std::string sID = getRetId(RI->getParent()->getParent());
-	return unionRange(sID, getRange(RI->getParent(), V), RI);
+	return std::find(BackEdges.begin(), BackEdges.end(), E)	!= BackEdges.end();
 }
 
-bool RangePass::updateRangeFor(Instruction *I)
+// Refine the ranges VRM flowing from Pred by the edge op at Ops[i];
+// moves i past it.
+void RangePass::refine(const RangeFunction &RF, unsigned Pred,
+					   unsigned &i, SlotRangeMap &VRM)
 {
-	bool changed = false;
-	
-	// store, return and call might update global range
-	if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-		changed |= visitStoreInst(SI);
-	} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
-		changed |= visitReturnInst(RI);
-	} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
-		changed |= visitCallInst(CI);
+	const std::vector<uint32_t> &Ops = RF.Ops;
+	switch (Ops[i++]) {
+	case R_Jump:
+		break;
+	case R_Branch: {
+		CmpInst::Predicate P = (CmpInst::Predicate)Ops[i++];
+		bool Taken = Ops[i++];
+		unsigned CmpBB = Ops[i++];
+		uint32_t LHS = Ops[i++], RHS = Ops[i++];
+		CRange LCR = getRange(RF, CmpBB, LHS);
+		CRange RCR = getRange(RF, CmpBB, RHS);
+		RCR.match(LCR);
+		
+		if (Taken) {
+			// true target
+			CRange PLCR = CRange::makeICmpRegion(
+				CmpInst::getSwappedPredicate(P), LCR);
+			CRange PRCR = CRange::makeICmpRegion(P, RCR);
+			VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
+			VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
+		} else {
+			// false target, use inverse predicate
+			// N.B. why there's no getSwappedInversePredicate()...
+			CRange PLCR = CRange::makeICmpRegion(
+				CmpInst::getInversePredicate(
+					CmpInst::getSwappedPredicate(P)), RCR);
+			CRange PRCR = CRange::makeICmpRegion(
+				CmpInst::getInversePredicate(P), RCR);
+			VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
+			VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
+		}
+		break;
 	}
-	
-	IntegerType *Ty = dyn_cast<IntegerType>(I->getType());
-	if (!Ty)
-		return changed;
-	
-	CRange CR(Ty->getBitWidth(), true);
-	if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
-		CR = visitBinaryOp(BO);
-	} else if (CastInst *CI = dyn_cast<CastInst>(I)) {
-		CR = visitCastInst(CI);
-	} else if (SelectInst *SI = dyn_cast<SelectInst>(I)) {
-		CR = visitSelectInst(SI);
-	} else if (PHINode *PHI = dyn_cast<PHINode>(I)) {
-		CR = visitPHINode(PHI);
-	} else if (LoadInst *LI = dyn_cast<LoadInst>(I)) {
-		CR = getRange(LI->getParent(), LI);
-	} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
-		CR = getRange(CI->getParent(), CI);
+	case R_Switch: {
+		bool Default = Ops[i++];
+		uint32_t V = Ops[i++];
+		CRange VCR = getRange(RF, Pred, V);
+		CRange CR(RF.Width[V], false);
+		// union all values that goes to BB, or the default case
+		for (unsigned k = Ops[i++]; k; --k)
+			CR.safeUnion(getRange(RF, Pred, Ops[i++]));
+		if (Default)
+			CR = CR.inverse();
+		VRM.insert(std::make_pair(V, VCR.intersectWith(CR)));
+		break;
+	}
+	default:
+		llvm_unreachable("Unknown edge op!");
 	}
-	unionRange(I->getParent(), I, CR);
-	
-	return changed;
 }
 
-bool RangePass::isBackEdge(const Edge &E)
+CRange RangePass::evalBinary(unsigned Opcode, CRange L, CRange R)
 {
-	return std::find(BackEdges.begin(), BackEdges.end(), E)	!= BackEdges.end();
+	R.match(L);
+	switch (Opcode) {
+		default: llvm_unreachable("Unknown binary operator!");
+		case Instruction::Add:  return L.add(R);
+		case Instruction::Sub:  return L.sub(R);
+		case Instruction::Mul:  return L.multiply(R);
+		case Instruction::UDiv: return L.udiv(R);
+		case Instruction::SDiv: return L.sdiv(R);
+		case Instruction::URem: return R; // FIXME
+		case Instruction::SRem: return R; // FIXME
+		case Instruction::Shl:  return L.shl(R);
+		case Instruction::LShr: return L.lshr(R);
+		case Instruction::AShr: return L; // FIXME
+		case Instruction::And:  return L.binaryAnd(R);
+		case Instruction::Or:   return L.binaryOr(R);
+		case Instruction::Xor:  return L; // FIXME
+	}
 }
 
-void RangePass::visitBranchInst(BranchInst *BI, BasicBlock *BB, 
-								ValueRangeMap &VRM)
+CRange RangePass::evalCast(unsigned Opcode, unsigned bits, const CRange &R)
 {
-	if (!BI->isConditional())
-		return;
-	
-	ICmpInst *ICI = dyn_cast<ICmpInst>(BI->getCondition());
-	if (ICI == NULL)
-		return;
-	
-	Value *LHS = ICI->getOperand(0);
-	Value *RHS = ICI->getOperand(1);
-	
-	if (!LHS->getType()->isIntegerTy() || !RHS->getType()->isIntegerTy())
-		return;
-	
-	CRange LCR = getRange(ICI->getParent(), LHS);
-	CRange RCR = getRange(ICI->getParent(), RHS);
-	RCR.match(LCR);
-
-	if (BI->getSuccessor(0) == BB) {
-		// true target
-		CRange PLCR = CRange::makeICmpRegion(
-									ICI->getSwappedPredicate(), LCR);
-		CRange PRCR = CRange::makeICmpRegion(
-									ICI->getPredicate(), RCR);
-		VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
-		VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
-	} else {
-		// false target, use inverse predicate
-		// N.B. why there's no getSwappedInversePredicate()...
-		ICI->swapOperands();
-		CRange PLCR = CRange::makeICmpRegion(
-									ICI->getInversePredicate(), RCR);
-		ICI->swapOperands();
-		CRange PRCR = CRange::makeICmpRegion(
-									ICI->getInversePredicate(), RCR);
-		VRM.insert(std::make_pair(LHS, LCR.intersectWith(PRCR)));
-		VRM.insert(std::make_pair(RHS, LCR.intersectWith(PLCR)));
+	switch (Opcode) {
+		case CastInst::Trunc:    return R.zextOrTrunc(bits);
+		case CastInst::ZExt:     return R.zextOrTrunc(bits);
+		case CastInst::SExt:     return R.signExtend(bits);
+		case CastInst::BitCast:  return R;
+		default:                 return CRange(bits, true);
 	}
 }
 
-void RangePass::visitSwitchInst(SwitchInst *SI, BasicBlock *BB, 
-								ValueRangeMap &VRM)
+bool RangePass::runOnFacts(const RangeFunction &RF)
 {
-	Value *V = SI->getCondition();
-	IntegerType *Ty = dyn_cast<IntegerType>(V->getType());
-	if (!Ty)
-		return;
+	bool changed = false;
+	const std::vector<uint32_t> &Ops = RF.Ops;
+	unsigned BB = 0;
+	
+	FuncVRMs.assign(RF.NumBlocks, SlotRangeMap());
 	
-	CRange VCR = getRange(SI->getParent(), V);
-	CRange CR(Ty->getBitWidth(), false);
-						   
-	if (SI->getDefaultDest() != BB) {
-		// union all values that goes to BB
-		for (SwitchInst::CaseIt i = SI->case_begin(), e = SI->case_end();
-			 i != e; ++i) {
-			if (i.getCaseSuccessor() == BB)
-				CR.safeUnion(i.getCaseValue()->getValue());
+	for (unsigned i = 0, n = Ops.size(); i < n; ) {
+		switch (Ops[i++]) {
+		case R_Block: {
+			// propagate value ranges from pred BBs, ranges in BB are
+			// union of ranges in pred BBs, constrained by each terminator.
+			BB = Ops[i++];
+			for (unsigned k = Ops[i++]; k; --k) {
+				unsigned Pred = Ops[i++];
+				// Copy from its predecessor
+				SlotRangeMap VRM(FuncVRMs[Pred]);
+				// Refine according to the terminator
+				refine(RF, Pred, i, VRM);
+				
+				// union with other predecessors
+				SlotRangeMap &BBVRM = FuncVRMs[BB];
+				for (SlotRangeMap::iterator j = VRM.begin(), je = VRM.end();
+					 j != je; ++j) {
+					SlotRangeMap::iterator it = BBVRM.find(j->first);
+					if (it != BBVRM.end())
+						it->second.safeUnion(j->second);
+					else
+						BBVRM.insert(*j);
+				}
+			}
+			break;
+		}
+		case R_Store: {
+			uint32_t ID = Ops[i++], V = Ops[i++], Ptr = Ops[i++];
+			uint32_t SI = Ops[i++];
+			CRange CR = getRange(RF, BB, V);
+			unionRange(BB, Ptr, CR);
+			changed |= unionRange(Ctx->IDs.str(ID), CR, RF.Slots[SI]);
+			break;
+		}
+		case R_Export: {
+			uint32_t ID = Ops[i++], V = Ops[i++], I = Ops[i++];
+			changed |= unionRange(Ctx->IDs.str(ID), getRange(RF, BB, V),
+								  RF.Slots[I]);
+			break;
+		}
+		case R_Binary: {
+			unsigned Opcode = Ops[i++];
+			uint32_t Slot = Ops[i++], L = Ops[i++], R = Ops[i++];
+			CRange LCR = getRange(RF, BB, L);
+			CRange RCR = getRange(RF, BB, R);
+			unionRange(BB, Slot, evalBinary(Opcode, LCR, RCR));
+			break;
+		}
+		case R_Cast: {
+			unsigned Opcode = Ops[i++];
+			uint32_t Slot = Ops[i++], V = Ops[i++];
+			unsigned bits = RF.Width[Slot];
+			// only integer casts look at their operand
+			CRange CR(bits, true);
+			if (Opcode == CastInst::Trunc || Opcode == CastInst::ZExt
+			    || Opcode == CastInst::SExt || Opcode == CastInst::BitCast)
+				CR = evalCast(Opcode, bits, getRange(RF, BB, V));
+			unionRange(BB, Slot, CR);
+			break;
+		}
+		case R_Select: {
+			uint32_t Slot = Ops[i++], T = Ops[i++], F = Ops[i++];
+			CRange CR = getRange(RF, BB, T);
+			CR.safeUnion(getRange(RF, BB, F));
+			unionRange(BB, Slot, CR);
+			break;
+		}
+		case R_PHI: {
+			uint32_t Slot = Ops[i++];
+			CRange CR(RF.Width[Slot], false);
+			for (unsigned k = Ops[i++]; k; --k, i += 2)
+				CR.safeUnion(getRange(RF, Ops[i], Ops[i + 1]));
+			unionRange(BB, Slot, CR);
+			break;
+		}
+		case R_Global: {
+			uint32_t Slot = Ops[i++];
+			unionRange(BB, Slot, getRange(RF, BB, Slot));
+			break;
+		}
+		case R_Full: {
+			uint32_t Slot = Ops[i++];
+			unionRange(BB, Slot, CRange(RF.Width[Slot], true));
+			break;
+		}
+		default:
+			llvm_unreachable("Unknown range op!");
 		}
-	} else {
-		// default case
-		for (SwitchInst::CaseIt i = SI->case_begin(), e = SI->case_end();
-			 i != e; ++i)
-			CR.safeUnion(i.getCaseValue()->getValue());
-		CR = CR.inverse();
 	}
-	VRM.insert(std::make_pair(V, VCR.intersectWith(CR)));
-}
 
-void RangePass::visitTerminator(TerminatorInst *I, BasicBlock *BB,
-								 ValueRangeMap &VRM) {
-	if (BranchInst *BI = dyn_cast<BranchInst>(I))
-		visitBranchInst(BI, BB, VRM);
-	else if (SwitchInst *SI = dyn_cast<SwitchInst>(I))
-		visitSwitchInst(SI, BB, VRM);
-	else {
-		// ignore: I->dump(); llvm_unreachable("Unknown terminator!");
-	}
+	// sweep workers (with Deltas) are not sampled
+	if (!Deltas && MemAcct::enabled())
+		MemAcct::update("FuncVRMs", MemAcct::bytesOf(FuncVRMs));
+	
+	return changed;
 }
 
+// Functions of one sweep, each with its own buffer of global updates.
+struct RangePass::RangeSweep {
+	RangePass *Pass;
+	std::vector<const RangeFunction *> Funcs;
+	std::vector<RangeMap> Deltas;
+	volatile sys::cas_flag Next;
+};
 
-bool RangePass::updateRangeFor(BasicBlock *BB)
+void *RangePass::sweepWorker(void *Arg)
 {
-	bool changed = false;
-
-	// propagate value ranges from pred BBs, ranges in BB are union of ranges
-	// in pred BBs, constrained by each terminator.
-	for (pred_iterator i = pred_begin(BB), e = pred_end(BB);
-			i != e; ++i) {
-		BasicBlock *Pred = *i;
-		if (isBackEdge(Edge(Pred, BB)))
-			continue;
-		
-		ValueRangeMap &PredVRM = FuncVRMs[Pred];
-		ValueRangeMap &BBVRM = FuncVRMs[BB];
-		
-		// Copy from its predecessor
-		ValueRangeMap VRM(PredVRM.begin(), PredVRM.end());
-		// Refine according to the terminator
-		visitTerminator(Pred->getTerminator(), BB, VRM);
-		
-		// union with other predecessors
-		for (ValueRangeMap::iterator j = VRM.begin(), je = VRM.end();
-			 j != je; ++j) {
-			ValueRangeMap::iterator it = BBVRM.find(j->first);
-			if (it != BBVRM.end())
-				it->second.safeUnion(j->second);
-			else
-				BBVRM.insert(*j);
-		}
+	RangeSweep *S = static_cast<RangeSweep *>(Arg);
+	RangePass P(S->Pass->Ctx);
+	for (;;) {
+		unsigned i = sys::AtomicIncrement(&S->Next) - 1;
+		if (i >= S->Funcs.size())
+			break;
+		P.Deltas = &S->Deltas[i];
+		P.runOnFacts(*S->Funcs[i]);
 	}
-	
-	// Now run through instructions
-	for (BasicBlock::iterator i = BB->begin(), e = BB->end(); 
-		 i != e; ++i) {
-		changed |= updateRangeFor(&*i);
-	}
-	
-	return changed;
+	return NULL;
 }
 
-bool RangePass::updateRangeFor(Function *F)
+// Jacobi-style sweep: every function sees the IntRanges snapshot taken
+// at the start of the sweep; deltas are merged in function order.
+bool RangePass::doParallelSweep(const std::vector<const RangeFunction *> &RFs)
 {
+	RangeSweep S;
+	S.Pass = this;
+	S.Next = 0;
+	S.Funcs = RFs;
+	S.Deltas.resize(S.Funcs.size());
+
+	unsigned n = std::min<unsigned>(Jobs, S.Funcs.size());
+	std::vector<pthread_t> Threads(n);
+	for (unsigned i = 0; i < n; ++i)
+		pthread_create(&Threads[i], NULL, sweepWorker, &S);
+	for (unsigned i = 0; i < n; ++i)
+		pthread_join(Threads[i], NULL);
+
 	bool changed = false;
-	
-	FuncVRMs.clear();
-	BackEdges.clear();
-	FindFunctionBackedges(*F, BackEdges);
-	
-	for (Function::iterator b = F->begin(), be = F->end(); b != be; ++b)
-		changed |= updateRangeFor(&*b);
-	
+	for (unsigned i = 0; i < S.Deltas.size(); ++i) {
+		RangeMap &D = S.Deltas[i];
+		for (RangeMap::iterator j = D.begin(), je = D.end(); j != je; ++j)
+			changed |= unionRange(j->first, j->second);
+	}
 	return changed;
 }
 
 bool RangePass::doModulePass(Module *M)
 {
+	static bool Parallel = Jobs > 1 && llvm_start_multithreaded();
 	unsigned itr = 0;
 	bool changed = true, ret = false;
 
+	// lower functions on first visit, before any sweep thread starts
+	std::vector<const RangeFunction *> RFs;
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i) {
+		if (i->empty())
+			continue;
+		FactMap::iterator it = Facts.find(&*i);
+		if (it == Facts.end()) {
+			it = Facts.insert(std::make_pair(&*i, RangeFunction())).first;
+			lower(&*i, it->second);
+		}
+		RFs.push_back(&it->second);
+	}
+
 	while (changed) {
 		// if some values converge too slowly, expand them to full-set
 		if (++itr > MaxIterations) {
@@ -494,19 +708,95 @@ bool RangePass::doModulePass(Module *M)
 		}
 		changed = false;
 		Changes.clear();
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			if (!i->empty())
-				changed |= updateRangeFor(&*i);
+		if (Parallel)
+			changed = doParallelSweep(RFs);
+		else
+			for (unsigned i = 0; i != RFs.size(); ++i)
+				changed |= runOnFacts(*RFs[i]);
 		ret |= changed;
 	}
 	return ret;
 }
 
+// values that change around a loop: PHIs taking a back edge, and what
+// is computed from them; their ranges leave out later iterations, as
+// visitPHINode skips back edges
+bool RangePass::isLoopCarried(Value *V, SmallPtrSet<Value *, 16> &Visited)
+{
+	Instruction *I = dyn_cast<Instruction>(V);
+	if (!I || !Visited.insert(I))
+		return false;
+	// loaded and returned values take their ranges from IntRanges
+	if (isa<LoadInst>(I) || isa<CallInst>(I))
+		return false;
+	if (PHINode *PHI = dyn_cast<PHINode>(I)) {
+		for (unsigned i = 0, n = PHI->getNumIncomingValues(); i < n; ++i)
+			if (isBackEdge(Edge(PHI->getIncomingBlock(i), PHI->getParent())))
+				return true;
+	}
+	for (User::op_iterator i = I->op_begin(), e = I->op_end(); i != e; ++i)
+		if (isLoopCarried(*i, Visited))
+			return true;
+	return false;
+}
+
+// attach the ranges of GEP indices, which IntRewrite uses to skip
+// array bound checks: one (lo, hi) pair per index, NULL if unknown
+void RangePass::annotateIndices(Function *F, const RangeFunction &RF)
+{
+	// re-evaluate F against the final IntRanges, without updating them
+	RangeMap Scratch;
+	Deltas = &Scratch;
+	runOnFacts(RF);
+	Deltas = NULL;
+	BackEdges.clear();
+	FindFunctionBackedges(*F, BackEdges);
+
+	// GEPs come in the order lower() saw them
+	LLVMContext &VMCtx = F->getContext();
+	unsigned k = 0;
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		GetElementPtrInst *GEP = dyn_cast<GetElementPtrInst>(&*i);
+		if (!GEP)
+			continue;
+		GEP->setMetadata("idxrange", NULL);
+		unsigned BB = RF.Indices[k++];
+
+		bool found = false;
+		SmallVector<Value *, 8> RL;
+		for (User::op_iterator j = GEP->idx_begin(), je = GEP->idx_end();
+			 j != je; ++j) {
+			Value *V = *j;
+			uint32_t Slot = RF.Indices[k++];
+			Value *Lo = NULL, *Hi = NULL;
+			SmallPtrSet<Value *, 16> Visited;
+			if (Slot != NoSlot && !isLoopCarried(V, Visited)) {
+				CRange R = getRange(RF, BB, Slot);
+				if (!R.isEmptySet() && !R.isFullSet()) {
+					Lo = ConstantInt::get(VMCtx, R.getLower());
+					Hi = ConstantInt::get(VMCtx, R.getUpper());
+					found = true;
+				}
+			}
+			RL.push_back(Lo);
+			RL.push_back(Hi);
+		}
+		if (found)
+			GEP->setMetadata("idxrange", MDNode::get(VMCtx, RL));
+	}
+	FuncVRMs.clear();
+}
+
 // write back
 bool RangePass::doFinalization(Module *M) {
 	LLVMContext &VMCtx = M->getContext();
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
 		Function *F = &*f;
+		FactMap::iterator it = Facts.find(F);
+		if (it != Facts.end()) {
+			annotateIndices(F, it->second);
+			Facts.erase(it);
+		}
 		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 			Instruction *I = &*i;
 			if (!isa<LoadInst>(I) && !isa<CallInst>(I))
@@ -8,12 +8,106 @@
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/time.h>
+// The timeout hook below uses private structures of Boolector 1.5.116,
+// the version in lib/ (boolector-1.5.116-eeaf10b-121004.tar.gz), which
+// lib/Makefile.am builds with Lingeling; that changes struct layouts.
+#define BTOR_USE_LINGELING
 extern "C" {
 #include <boolector/boolector.h>
+#include <boolector/btoraig.h>
+#include <boolector/btoraigvec.h>
+#include <boolector/btorconfig.h>
+#include <boolector/btorexp.h>
+#include <boolector/btorsat.h>
+#include <boolector/btorsmt.h>
+#include <lingeling/lglib.h>
 }
 
 using namespace llvm;
 
+namespace {
+
+class BoolectorSolver : public SMTSolver {
+public:
+	BoolectorSolver(bool modelgen);
+	~BoolectorSolver();
+
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+
+	void dump(SMTExpr);
+	void print(SMTExpr, llvm::raw_ostream &);
+
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+
+	unsigned bvwidth(SMTExpr);
+
+	SMTExpr bvfalse();
+	SMTExpr bvtrue();
+	SMTExpr bvconst(const llvm::APInt &);
+	SMTExpr bvvar(unsigned width, const char *name);
+
+	// If-else-then.
+	SMTExpr ite(SMTExpr, SMTExpr, SMTExpr);
+
+	// Comparison.
+	SMTExpr eq(SMTExpr, SMTExpr);
+	SMTExpr ne(SMTExpr, SMTExpr);
+	SMTExpr bvslt(SMTExpr, SMTExpr);
+	SMTExpr bvsle(SMTExpr, SMTExpr);
+	SMTExpr bvsgt(SMTExpr, SMTExpr);
+	SMTExpr bvsge(SMTExpr, SMTExpr);
+	SMTExpr bvult(SMTExpr, SMTExpr);
+	SMTExpr bvule(SMTExpr, SMTExpr);
+	SMTExpr bvugt(SMTExpr, SMTExpr);
+	SMTExpr bvuge(SMTExpr, SMTExpr);
+
+	SMTExpr extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr zero_extend(unsigned i, SMTExpr);
+	SMTExpr sign_extend(unsigned i, SMTExpr);
+
+	SMTExpr bvredand(SMTExpr);
+	SMTExpr bvredor(SMTExpr);
+	SMTExpr bvnot(SMTExpr);
+	SMTExpr bvneg(SMTExpr);
+
+	// Arithmetic operations.
+	SMTExpr bvadd(SMTExpr, SMTExpr);
+	SMTExpr bvsub(SMTExpr, SMTExpr);
+	SMTExpr bvmul(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr bvudiv(SMTExpr, SMTExpr);
+	SMTExpr bvsrem(SMTExpr, SMTExpr);
+	SMTExpr bvurem(SMTExpr, SMTExpr);
+	SMTExpr bvshl(SMTExpr, SMTExpr);
+	SMTExpr bvlshr(SMTExpr, SMTExpr);
+	SMTExpr bvashr(SMTExpr, SMTExpr);
+	SMTExpr bvand(SMTExpr, SMTExpr);
+	SMTExpr bvor(SMTExpr, SMTExpr);
+	SMTExpr bvxor(SMTExpr, SMTExpr);
+
+	// Overflow detection.
+	SMTExpr bvneg_overflow(SMTExpr);
+	SMTExpr bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	SMTStatus solveText(const std::string &);
+};
+
+} // anonymous namespace
+
 #define ctx ((Btor *)ctx_)
 #define m   ((Btor *)m_)
 #define e   ((BtorNode *)e_)
@@ -30,26 +124,80 @@ namespace {
 
 static SMTWorkaround X;
 
-SMTSolver::SMTSolver(bool modelgen) {
+BoolectorSolver::BoolectorSolver(bool modelgen) {
 	ctx_ = boolector_new();
 	if (modelgen)
 		boolector_enable_model_gen(ctx);
 	boolector_enable_inc_usage(ctx);
 }
 
-SMTSolver::~SMTSolver() {
+BoolectorSolver::~BoolectorSolver() {
+	if (Facts)
+		decref(Facts);
 	assert(boolector_get_refs(ctx) == 0);
 	boolector_delete(ctx);
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+// Fails to compile unless the SAT manager is laid out as in 1.5.116
+// with Lingeling: the solver first, nofork present.
+typedef char BtorSATMgrLayout[
+	offsetof(BtorSATMgr, solver) == 0
+	&& offsetof(BtorSATMgr, nofork)
+	   == offsetof(BtorSATMgr, used_that_inc_was_not_required) + sizeof(int)
+	? 1 : -1];
+
+// Boolector 1.5 has no termination hook, but its Lingeling backend
+// does.  Reach it through the SAT manager, set up eagerly as
+// boolector_sat would, with Lingeling's brute-force forks disabled,
+// since clones would not see the callback.  Other versions, or another
+// SAT solver, get no hook and so no in-process timeout.
+static LGL *getLingeling(Btor *btor) {
+	if (strcmp(BTOR_VERSION, "1.5.116"))
+		return NULL;
+	BtorAIGMgr *amgr = btor_get_aig_mgr_aigvec_mgr(btor->avmgr);
+	BtorSATMgr *smgr = btor_get_sat_mgr_aig_mgr(amgr);
+	if (!btor_is_initialized_sat(smgr)) {
+		if (!btor_enable_lingeling_sat(smgr, NULL, 1))
+			return NULL;
+		btor_init_sat(smgr);
+	}
+	if (strcmp(smgr->name, "Lingeling"))
+		return NULL;
+	// struct BtorLGL in btorsat.c starts with the LGL pointer
+	return *(LGL **)smgr->solver;
+}
+
+static uint64_t nowMillis() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static int pastDeadline(void *Deadline) {
+	return nowMillis() >= *(uint64_t *)Deadline;
+}
+
+void BoolectorSolver::constrain(SMTExpr e_) {
 	boolector_assert(ctx, e);
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+// After a timeout Lingeling stays terminated; start a new solver.
+SMTStatus BoolectorSolver::solve(SMTExpr e_, SMTModel *m_) {
+	uint64_t Deadline = 0;
+	LGL *L = NULL;
+	if (unsigned Timeout = timeout()) {
+		L = getLingeling(ctx);
+		Deadline = nowMillis() + Timeout;
+		if (L)
+			lglseterm(L, pastDeadline, &Deadline);
+	}
 	boolector_assume(ctx, e);
-	switch (boolector_sat(ctx)) {
-	default:              return SMT_UNDEF;
+	int res = boolector_sat(ctx);
+	if (L)
+		lglseterm(L, NULL, NULL);
+	switch (res) {
+	default:
+		return Deadline && nowMillis() >= Deadline ? SMT_TIMEOUT : SMT_UNDEF;
 	case BOOLECTOR_UNSAT: return SMT_UNSAT;
 	case BOOLECTOR_SAT:   break;
 	}
@@ -58,7 +206,28 @@ SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
 	return SMT_SAT;
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &v) {
+// Parse the SMT-LIB benchmark that print() writes.
+SMTStatus BoolectorSolver::solveText(const std::string &Text) {
+	const BtorParserAPI *API = btor_smt_parser_api();
+	BtorParseOpt Opt = { (BtorParseMode)0, 0, 0, 0 };
+	BtorParser *Parser = API->init(ctx, &Opt);
+	BtorParseResult Result;
+	FILE *fp = fmemopen((void *)Text.data(), Text.size(), "r");
+	assert(fp && "fmemopen");
+	char *Err = API->parse(Parser, NULL, fp, "query", &Result);
+	fclose(fp);
+	BtorNode *Root = NULL;
+	if (!Err && Result.noutputs == 1)
+		Root = boolector_copy(ctx, Result.outputs[0]);
+	API->reset(Parser);
+	if (!Root)
+		return SMT_UNDEF;
+	SMTStatus Res = solve(Root, NULL);
+	boolector_release(ctx, Root);
+	return Res;
+}
+
+void BoolectorSolver::eval(SMTModel m_, SMTExpr e_, APInt &v) {
 	char *s = boolector_bv_assignment(ctx, e);
 	std::string str(s);
 	boolector_free_bv_assignment(ctx, s);
@@ -66,14 +235,14 @@ void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &v) {
 	v = APInt(bvwidth(e), str.c_str(), 2);
 }
 
-void SMTSolver::release(SMTModel m_) {}
+void BoolectorSolver::release(SMTModel m_) {}
 
-void SMTSolver::dump(SMTExpr e_) {
+void BoolectorSolver::dump(SMTExpr e_) {
 	print(e, dbgs());
 	dbgs() << "\n";
 }
 
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
+void BoolectorSolver::print(SMTExpr e_, raw_ostream &OS) {
 	FILE *fp = tmpfile();
 	assert(fp && "tmpfile");
 	boolector_dump_smt(ctx, fp, e);
@@ -88,27 +257,27 @@ void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
 	fclose(fp);
 }
 
-void SMTSolver::incref(SMTExpr e_) {
+void BoolectorSolver::incref(SMTExpr e_) {
 	boolector_copy(ctx, e);
 }
 
-void SMTSolver::decref(SMTExpr e_) {
+void BoolectorSolver::decref(SMTExpr e_) {
 	boolector_release(ctx, e);
 }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned BoolectorSolver::bvwidth(SMTExpr e_) {
 	return boolector_get_width(ctx, e);
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr BoolectorSolver::bvfalse() {
 	return boolector_false(ctx);
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr BoolectorSolver::bvtrue() {
 	return boolector_true(ctx);
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr BoolectorSolver::bvconst(const APInt &Val) {
 	unsigned intbits = sizeof(unsigned) * CHAR_BIT;
 	unsigned width = Val.getBitWidth();
 	if (width <= intbits)
@@ -121,107 +290,107 @@ SMTExpr SMTSolver::bvconst(const APInt &Val) {
 	return boolector_const(ctx, FullStr.c_str());
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr BoolectorSolver::bvvar(unsigned width, const char *name) {
 	return boolector_var(ctx, width, name);
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_cond(ctx, e, lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_eq(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ne(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_slt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_slte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sgt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sgte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ult(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ulte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ugt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ugte(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr BoolectorSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
 	return boolector_slice(ctx, e, high, low);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr BoolectorSolver::zero_extend(unsigned i, SMTExpr e_) {
 	return boolector_uext(ctx, e, i);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr BoolectorSolver::sign_extend(unsigned i, SMTExpr e_) {
 	return boolector_sext(ctx, e, i);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
+SMTExpr BoolectorSolver::bvredand(SMTExpr e_) {
 	return boolector_redand(ctx, e);
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr BoolectorSolver::bvredor(SMTExpr e_) {
 	return boolector_redor(ctx, e);
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr BoolectorSolver::bvnot(SMTExpr e_) {
 	return boolector_not(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr BoolectorSolver::bvneg(SMTExpr e_) {
 	return boolector_neg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_add(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_mul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_udiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_srem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_urem(ctx, lhs, rhs);
 }
 
@@ -248,61 +417,73 @@ static inline SMTExpr shift(Btor *btor,  BtorNode *e0,  BtorNode *e1) {
 	return result;
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_sll>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_srl>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return shift<boolector_sra>(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_and(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_or(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_xor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
+SMTExpr BoolectorSolver::bvneg_overflow(SMTExpr e_) {
 	SMTExpr zero = boolector_zero(ctx, bvwidth(e));
 	SMTExpr tmp = bvssub_overflow(zero, e);
 	decref(zero);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_saddo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_uaddo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_ssubo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_usubo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_smulo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_umulo(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr BoolectorSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return boolector_sdivo(ctx, lhs, rhs);
 }
+
+static const char *name() {
+	return "boolector";
+}
+
+static SMTSolver *create(bool modelgen) {
+	return new BoolectorSolver(modelgen);
+}
+
+extern "C" const SMTPlugin kint_smt_plugin = {
+	SMT_PLUGIN_VERSION, name, create
+};
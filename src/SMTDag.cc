@@ -0,0 +1,247 @@
+#include "SMTDag.h"
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/ErrorHandling.h>
+#include <string.h>
+
+using namespace llvm;
+
+static void profile(FoldingSetNodeID &ID, SMTNode::Kind K, unsigned Width,
+                    SMTNode *A, SMTNode *B, SMTNode *C,
+                    unsigned X, unsigned Y) {
+	ID.AddInteger(K);
+	ID.AddInteger(Width);
+	ID.AddPointer(A);
+	ID.AddPointer(B);
+	ID.AddPointer(C);
+	ID.AddInteger(X);
+	ID.AddInteger(Y);
+}
+
+void SMTNode::Profile(FoldingSetNodeID &ID) const {
+	profile(ID, K, Width, Ops[0], Ops[1], Ops[2], X, Y);
+	if (K == Const)
+		Val.Profile(ID);
+	else if (K == Var)
+		ID.AddString(Name);
+}
+
+SMTDag::~SMTDag() {
+	for (DenseMap<SMTNode *, SMTExpr>::iterator i = Lowered.begin(),
+	     e = Lowered.end(); i != e; ++i)
+		SMT.decref(i->second);
+	// Wide constants own memory; the rest goes with the allocator.
+	for (FoldingSet<SMTNode>::iterator i = Nodes.begin(), e = Nodes.end();
+	     i != e; ) {
+		SMTNode &N = *i++;
+		N.~SMTNode();
+	}
+}
+
+SMTNode *SMTDag::newNode(SMTNode::Kind K, unsigned Width) {
+	SMTNode *N = new (Alloc.Allocate<SMTNode>()) SMTNode;
+	N->K = K;
+	N->Width = Width;
+	N->ID = NextID++;
+	N->Ops[0] = N->Ops[1] = N->Ops[2] = NULL;
+	N->X = N->Y = 0;
+	N->Name = NULL;
+	return N;
+}
+
+SMTNode *SMTDag::get(SMTNode::Kind K, unsigned Width,
+                     SMTNode *A, SMTNode *B, SMTNode *C,
+                     unsigned X, unsigned Y) {
+	FoldingSetNodeID ID;
+	profile(ID, K, Width, A, B, C, X, Y);
+	void *IP;
+	if (SMTNode *N = Nodes.FindNodeOrInsertPos(ID, IP))
+		return N;
+	SMTNode *N = newNode(K, Width);
+	N->Ops[0] = A;
+	N->Ops[1] = B;
+	N->Ops[2] = C;
+	N->X = X;
+	N->Y = Y;
+	Nodes.InsertNode(N, IP);
+	return N;
+}
+
+SMTNode *SMTDag::bvconst(const APInt &Val) {
+	FoldingSetNodeID ID;
+	profile(ID, SMTNode::Const, Val.getBitWidth(), NULL, NULL, NULL, 0, 0);
+	Val.Profile(ID);
+	void *IP;
+	if (SMTNode *N = Nodes.FindNodeOrInsertPos(ID, IP))
+		return N;
+	SMTNode *N = newNode(SMTNode::Const, Val.getBitWidth());
+	N->Val = Val;
+	Nodes.InsertNode(N, IP);
+	return N;
+}
+
+SMTNode *SMTDag::bvvar(unsigned Width, const char *Name) {
+	FoldingSetNodeID ID;
+	profile(ID, SMTNode::Var, Width, NULL, NULL, NULL, 0, 0);
+	ID.AddString(Name);
+	void *IP;
+	if (SMTNode *N = Nodes.FindNodeOrInsertPos(ID, IP))
+		return N;
+	SMTNode *N = newNode(SMTNode::Var, Width);
+	size_t Len = strlen(Name);
+	char *S = (char *)Alloc.Allocate(Len + 1, 1);
+	memcpy(S, Name, Len + 1);
+	N->Name = S;
+	Nodes.InsertNode(N, IP);
+	return N;
+}
+
+SMTExpr SMTDag::lower(SMTNode *N) {
+	SMTExpr E = lowerNode(N);
+	for (; Assumed != Assumptions.size(); ++Assumed)
+		SMT.assume(lowerNode(Assumptions[Assumed]));
+	return E;
+}
+
+SMTExpr SMTDag::lowerNode(SMTNode *N) {
+	if (SMTExpr E = Lowered.lookup(N))
+		return E;
+	SMTExpr A = N->Ops[0] ? lowerNode(N->Ops[0]) : NULL;
+	SMTExpr B = N->Ops[1] ? lowerNode(N->Ops[1]) : NULL;
+	SMTExpr C = N->Ops[2] ? lowerNode(N->Ops[2]) : NULL;
+	SMTExpr E;
+	switch (N->K) {
+	default: llvm_unreachable("Unknown node!");
+	case SMTNode::Const:   E = SMT.bvconst(N->Val); break;
+	case SMTNode::Var:     E = SMT.bvvar(N->Width, N->Name); break;
+	case SMTNode::Ite:     E = SMT.ite(A, B, C); break;
+	case SMTNode::Eq:      E = SMT.eq(A, B); break;
+	case SMTNode::Ne:      E = SMT.ne(A, B); break;
+	case SMTNode::Slt:     E = SMT.bvslt(A, B); break;
+	case SMTNode::Sle:     E = SMT.bvsle(A, B); break;
+	case SMTNode::Sgt:     E = SMT.bvsgt(A, B); break;
+	case SMTNode::Sge:     E = SMT.bvsge(A, B); break;
+	case SMTNode::Ult:     E = SMT.bvult(A, B); break;
+	case SMTNode::Ule:     E = SMT.bvule(A, B); break;
+	case SMTNode::Ugt:     E = SMT.bvugt(A, B); break;
+	case SMTNode::Uge:     E = SMT.bvuge(A, B); break;
+	case SMTNode::Extract: E = SMT.extract(N->X, N->Y, A); break;
+	case SMTNode::ZExt:    E = SMT.zero_extend(N->X, A); break;
+	case SMTNode::SExt:    E = SMT.sign_extend(N->X, A); break;
+	case SMTNode::Not:     E = SMT.bvnot(A); break;
+	case SMTNode::Add:     E = SMT.bvadd(A, B); break;
+	case SMTNode::Sub:     E = SMT.bvsub(A, B); break;
+	case SMTNode::Mul:     E = SMT.bvmul(A, B); break;
+	case SMTNode::SDiv:    E = SMT.bvsdiv(A, B); break;
+	case SMTNode::UDiv:    E = SMT.bvudiv(A, B); break;
+	case SMTNode::SRem:    E = SMT.bvsrem(A, B); break;
+	case SMTNode::URem:    E = SMT.bvurem(A, B); break;
+	case SMTNode::Shl:     E = SMT.bvshl(A, B); break;
+	case SMTNode::LShr:    E = SMT.bvlshr(A, B); break;
+	case SMTNode::AShr:    E = SMT.bvashr(A, B); break;
+	case SMTNode::And:     E = SMT.bvand(A, B); break;
+	case SMTNode::Or:      E = SMT.bvor(A, B); break;
+	case SMTNode::Xor:     E = SMT.bvxor(A, B); break;
+	case SMTNode::SAddO:   E = SMT.bvsadd_overflow(A, B); break;
+	case SMTNode::UAddO:   E = SMT.bvuadd_overflow(A, B); break;
+	case SMTNode::SSubO:   E = SMT.bvssub_overflow(A, B); break;
+	case SMTNode::USubO:   E = SMT.bvusub_overflow(A, B); break;
+	case SMTNode::SMulO:   E = SMT.bvsmul_overflow(A, B); break;
+	case SMTNode::UMulO:   E = SMT.bvumul_overflow(A, B); break;
+	case SMTNode::SDivO:   E = SMT.bvsdiv_overflow(A, B); break;
+	}
+	Lowered[N] = E;
+	return E;
+}
+
+namespace {
+
+// Classes of nodes connected through shared subterms, i.e., shared
+// values; constants connect nothing.
+struct Cone {
+	DenseMap<SMTNode *, SMTNode *> Parent;
+
+	SMTNode *find(SMTNode *N) {
+		SMTNode *P = Parent.lookup(N);
+		if (!P || P == N)
+			return N;
+		P = find(P);
+		Parent[N] = P;
+		return P;
+	}
+
+	void add(SMTNode *N) {
+		if (N->isConst() || Parent.count(N))
+			return;
+		Parent[N] = N;
+		for (unsigned i = 0; i != 3 && N->Ops[i]; ++i) {
+			SMTNode *Op = N->Ops[i];
+			if (Op->isConst())
+				continue;
+			add(Op);
+			SMTNode *A = find(N), *B = find(Op);
+			if (A != B)
+				Parent[A] = B;
+		}
+	}
+};
+
+typedef DenseMap<std::pair<SMTNode *, unsigned>, SMTNode *> SliceMap;
+
+} // anonymous namespace
+
+// The boolean structure of a guard, above its conditions.
+static bool isConnective(SMTNode *N) {
+	return N->Width == 1 && (N->K == SMTNode::And || N->K == SMTNode::Or
+	                         || N->K == SMTNode::Not);
+}
+
+typedef SmallPtrSet<SMTNode *, 32> NodeSet;
+
+static void addConditions(SMTNode *G, Cone &C, NodeSet &Seen) {
+	if (!Seen.insert(G))
+		return;
+	if (!isConnective(G)) {
+		C.add(G);
+		return;
+	}
+	for (unsigned i = 0; i != 3 && G->Ops[i]; ++i)
+		addConditions(G->Ops[i], C, Seen);
+}
+
+// Pos is the polarity of G; a dropped condition becomes whatever makes
+// it hold.
+static SMTNode *sliceGuard(SMTDag &DAG, SMTNode *G, bool Pos, Cone &C,
+                           SMTNode *Class, SliceMap &Memo) {
+	if (G->isConst())
+		return G;
+	std::pair<SMTNode *, unsigned> Key(G, Pos);
+	if (SMTNode *N = Memo.lookup(Key))
+		return N;
+	SMTNode *N;
+	if (!isConnective(G)) {
+		if (C.find(G) == Class)
+			N = G;
+		else
+			N = Pos ? DAG.bvtrue() : DAG.bvfalse();
+	} else if (G->K == SMTNode::Not) {
+		N = DAG.bvnot(sliceGuard(DAG, G->Ops[0], !Pos, C, Class, Memo));
+	} else {
+		SMTNode *L = sliceGuard(DAG, G->Ops[0], Pos, C, Class, Memo);
+		SMTNode *R = sliceGuard(DAG, G->Ops[1], Pos, C, Class, Memo);
+		N = G->K == SMTNode::And ? DAG.bvand(L, R) : DAG.bvor(L, R);
+	}
+	Memo[Key] = N;
+	return N;
+}
+
+SMTNode *SMTDag::slice(SMTNode *G, SMTNode *Root) {
+	if (Root->isConst() || G->isConst())
+		return G;
+	Cone C;
+	NodeSet Seen;
+	C.add(Root);
+	addConditions(G, C, Seen);
+	SliceMap Memo;
+	return sliceGuard(*this, G, true, C, C.find(Root), Memo);
+}
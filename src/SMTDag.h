@@ -0,0 +1,58 @@
+#pragma once
+
+#include "SMTRewrite.h"
+#include "SMTSolver.h"
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/Allocator.h>
+#include <vector>
+
+// The nodes behind SMTRewriter, uniqued in a FoldingSet and allocated
+// in an arena.  Nodes are lowered to the backend only when a query
+// needs them.
+class SMTDag : public SMTRewriter {
+public:
+	SMTSolver &SMT;
+
+	SMTDag(SMTSolver &SMT) : SMT(SMT), NextID(0), Assumed(0) { }
+	~SMTDag();
+
+	// Backend expression of N, owned by the DAG; constraints from
+	// assume() are passed to the solver first.
+	SMTExpr lower(SMTNode *N);
+	// Backend expression of N if a query has needed it, or NULL.
+	SMTExpr lowered(SMTNode *N) const { return Lowered.lookup(N); }
+
+	// Constrain all later queries.
+	void assume(SMTNode *N) { Assumptions.push_back(N); }
+	const std::vector<SMTNode *> &assumptions() const {
+		return Assumptions;
+	}
+
+	// G with its conditions that share no subterms with Root, even
+	// transitively through other conditions, replaced by what makes
+	// them hold; this only widens the paths G allows.
+	SMTNode *slice(SMTNode *G, SMTNode *Root);
+
+	SMTNode *bvconst(const llvm::APInt &);
+	SMTNode *bvvar(unsigned width, const char *name);
+
+protected:
+	SMTNode *get(SMTNode::Kind, unsigned Width, SMTNode *A, SMTNode *B = 0,
+	             SMTNode *C = 0, unsigned X = 0, unsigned Y = 0);
+
+private:
+	llvm::BumpPtrAllocator Alloc;
+	llvm::FoldingSet<SMTNode> Nodes;
+	unsigned NextID;
+	// One backend reference per lowered node.
+	llvm::DenseMap<SMTNode *, SMTExpr> Lowered;
+	std::vector<SMTNode *> Assumptions;
+	size_t Assumed;
+
+	SMTNode *newNode(SMTNode::Kind, unsigned Width);
+
+	SMTExpr lowerNode(SMTNode *);
+
+	SMTDag(const SMTDag &);
+	void operator=(const SMTDag &);
+};
@@ -0,0 +1,344 @@
+#define DEBUG_TYPE "smt-eval"
+#include "SMTEval.h"
+#include <llvm/ADT/Statistic.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/ErrorHandling.h>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+SMTEvalOpt("smt-eval",
+           cl::desc("Look for a sat witness among N inputs before solving"),
+           cl::value_desc("N"));
+
+STATISTIC(NumWitnesses, "Number of queries sat by concrete evaluation");
+STATISTIC(NumMisses, "Number of queries concrete evaluation left to solve");
+
+unsigned SMTEval::inputs() {
+	return SMTEvalOpt;
+}
+
+static uint64_t mask(unsigned W) {
+	return W == 64 ? ~0ULL : (1ULL << W) - 1;
+}
+
+static int64_t sext(uint64_t X, unsigned W) {
+	return (int64_t)(X << (64 - W)) >> (64 - W);
+}
+
+static uint64_t msb(uint64_t X, unsigned W) {
+	return (X >> (W - 1)) & 1;
+}
+
+// xorshift64*, seeded the same for every query so that runs repeat.
+static uint64_t next(uint64_t &S) {
+	S ^= S >> 12;
+	S ^= S << 25;
+	S ^= S >> 27;
+	return S * 2685821657736338717ULL;
+}
+
+bool SMTEval::compile(SMTNode *N) {
+	if (Slots.count(N))
+		return true;
+	if (N->Width > 64)
+		return false;
+	Step S = { N, { NoSlot, NoSlot, NoSlot } };
+	if (N->K == SMTNode::Var) {
+		DenseMap<SMTNode *, SMTNode *>::iterator i = Defs.find(N);
+		if (i != Defs.end()) {
+			SMTNode *D = i->second;
+			Defs.erase(i);
+			if (!compile(D))
+				return false;
+			// a cyclic definition made N an input
+			if (Slots.count(N))
+				return true;
+			Defs[N] = D;
+			S.Ops[0] = Slots[D];
+		}
+	} else {
+		for (unsigned i = 0; i != 3 && N->Ops[i]; ++i) {
+			if (!compile(N->Ops[i]))
+				return false;
+			S.Ops[i] = Slots[N->Ops[i]];
+		}
+	}
+	Slots[N] = Prog.size();
+	Prog.push_back(S);
+	return true;
+}
+
+static uint64_t boundary(unsigned k, uint64_t M) {
+	switch (k) {
+	default: return 0;
+	case 1: return 1;
+	case 2: return M;		// -1
+	case 3: return M >> 1;		// INT_MAX
+	case 4: return (M >> 1) + 1;	// INT_MIN
+	}
+}
+
+// In the first round, the first 25 lanes pair up boundary values of
+// every two inputs, and the other lanes try powers of two; the rest is
+// random.
+void SMTEval::setInputs(unsigned Round, uint64_t &Seed) {
+	unsigned Var = 0;
+	for (unsigned i = 0, n = Prog.size(); i != n; ++i) {
+		SMTNode *N = Prog[i].N;
+		if (N->K != SMTNode::Var || Prog[i].Ops[0] != NoSlot)
+			continue;
+		unsigned W = N->Width;
+		uint64_t M = mask(W), *R = reg(i);
+		for (unsigned l = 0; l != Lanes; ++l) {
+			unsigned k = (l + 3 * Var) % (Lanes - 25);
+			uint64_t X;
+			if (Round || W == 1)
+				X = next(Seed);
+			else if (l < 25)
+				X = boundary(Var % 2 ? l / 5 : l % 5, M);
+			else if (k < W)
+				X = 1ULL << k;
+			else
+				X = next(Seed);
+			R[l] = X & M;
+		}
+		++Var;
+	}
+}
+
+// Each step is a loop over the lanes, which compilers vectorize.
+void SMTEval::run() {
+	for (unsigned i = 0, n = Prog.size(); i != n; ++i) {
+		const Step &S = Prog[i];
+		SMTNode *N = S.N;
+		unsigned W = N->Width;
+		uint64_t M = mask(W), *D = reg(i);
+		const uint64_t *A = S.Ops[0] != NoSlot ? reg(S.Ops[0]) : NULL;
+		const uint64_t *B = S.Ops[1] != NoSlot ? reg(S.Ops[1]) : NULL;
+		const uint64_t *C = S.Ops[2] != NoSlot ? reg(S.Ops[2]) : NULL;
+		// operand width, for predicates and extensions
+		unsigned OW = N->Ops[0] ? N->Ops[0]->Width : W;
+		unsigned l;
+		switch (N->K) {
+		default: llvm_unreachable("Unknown node!");
+		case SMTNode::Const: {
+			uint64_t V = N->Val.getZExtValue();
+			for (l = 0; l != Lanes; ++l) D[l] = V;
+			break;
+		}
+		case SMTNode::Var:
+			if (A)
+				for (l = 0; l != Lanes; ++l) D[l] = A[l];
+			break;
+		case SMTNode::Ite:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] ? B[l] : C[l];
+			break;
+		case SMTNode::Eq:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] == B[l];
+			break;
+		case SMTNode::Ne:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] != B[l];
+			break;
+		case SMTNode::Slt:
+			for (l = 0; l != Lanes; ++l) D[l] = sext(A[l], OW) < sext(B[l], OW);
+			break;
+		case SMTNode::Sle:
+			for (l = 0; l != Lanes; ++l) D[l] = sext(A[l], OW) <= sext(B[l], OW);
+			break;
+		case SMTNode::Sgt:
+			for (l = 0; l != Lanes; ++l) D[l] = sext(A[l], OW) > sext(B[l], OW);
+			break;
+		case SMTNode::Sge:
+			for (l = 0; l != Lanes; ++l) D[l] = sext(A[l], OW) >= sext(B[l], OW);
+			break;
+		case SMTNode::Ult:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] < B[l];
+			break;
+		case SMTNode::Ule:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] <= B[l];
+			break;
+		case SMTNode::Ugt:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] > B[l];
+			break;
+		case SMTNode::Uge:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] >= B[l];
+			break;
+		case SMTNode::Extract:
+			for (l = 0; l != Lanes; ++l) D[l] = (A[l] >> N->Y) & M;
+			break;
+		case SMTNode::ZExt:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l];
+			break;
+		case SMTNode::SExt:
+			for (l = 0; l != Lanes; ++l) D[l] = (uint64_t)sext(A[l], OW) & M;
+			break;
+		case SMTNode::Not:
+			for (l = 0; l != Lanes; ++l) D[l] = ~A[l] & M;
+			break;
+		case SMTNode::Add:
+			for (l = 0; l != Lanes; ++l) D[l] = (A[l] + B[l]) & M;
+			break;
+		case SMTNode::Sub:
+			for (l = 0; l != Lanes; ++l) D[l] = (A[l] - B[l]) & M;
+			break;
+		case SMTNode::Mul:
+			for (l = 0; l != Lanes; ++l) D[l] = (A[l] * B[l]) & M;
+			break;
+		case SMTNode::UDiv:
+		case SMTNode::URem:
+		case SMTNode::SDiv:
+		case SMTNode::SRem:
+			// division by zero drops the lane
+			for (l = 0; l != Lanes; ++l) {
+				uint64_t X = A[l], Y = B[l];
+				if (!Y) {
+					Valid[l] = 0;
+					D[l] = 0;
+					continue;
+				}
+				bool NegX = false, NegY = false;
+				if (N->K == SMTNode::SDiv || N->K == SMTNode::SRem) {
+					NegX = msb(X, W);
+					NegY = msb(Y, W);
+					if (NegX)
+						X = -X & M;
+					if (NegY)
+						Y = -Y & M;
+				}
+				bool Div = N->K == SMTNode::UDiv || N->K == SMTNode::SDiv;
+				uint64_t R = Div ? X / Y : X % Y;
+				// the quotient is negative for different signs, the
+				// remainder has the sign of the dividend
+				if (Div ? NegX != NegY : NegX)
+					R = -R;
+				D[l] = R & M;
+			}
+			break;
+		case SMTNode::Shl:
+		case SMTNode::LShr:
+		case SMTNode::AShr:
+			// so do oversized shift amounts, which some solvers
+			// truncate to the low bits
+			for (l = 0; l != Lanes; ++l) {
+				if (B[l] >= W) {
+					Valid[l] = 0;
+					D[l] = 0;
+				} else if (N->K == SMTNode::Shl)
+					D[l] = (A[l] << B[l]) & M;
+				else if (N->K == SMTNode::LShr)
+					D[l] = A[l] >> B[l];
+				else
+					D[l] = (uint64_t)(sext(A[l], W) >> B[l]) & M;
+			}
+			break;
+		case SMTNode::And:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] & B[l];
+			break;
+		case SMTNode::Or:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] | B[l];
+			break;
+		case SMTNode::Xor:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] ^ B[l];
+			break;
+		case SMTNode::SAddO:
+			// the sum's sign differs from both operands'
+			for (l = 0; l != Lanes; ++l) {
+				uint64_t R = A[l] + B[l];
+				D[l] = msb((R ^ A[l]) & (R ^ B[l]), OW);
+			}
+			break;
+		case SMTNode::UAddO:
+			for (l = 0; l != Lanes; ++l)
+				D[l] = ((A[l] + B[l]) & mask(OW)) < A[l];
+			break;
+		case SMTNode::SSubO:
+			for (l = 0; l != Lanes; ++l) {
+				uint64_t R = A[l] - B[l];
+				D[l] = msb((A[l] ^ B[l]) & (R ^ A[l]), OW);
+			}
+			break;
+		case SMTNode::USubO:
+			for (l = 0; l != Lanes; ++l) D[l] = A[l] < B[l];
+			break;
+		case SMTNode::SMulO:
+			for (l = 0; l != Lanes; ++l) {
+				__int128 R = (__int128)sext(A[l], OW) * sext(B[l], OW);
+				D[l] = R != sext((uint64_t)R, OW);
+			}
+			break;
+		case SMTNode::UMulO:
+			for (l = 0; l != Lanes; ++l) {
+				unsigned __int128 R = (unsigned __int128)A[l] * B[l];
+				D[l] = R > mask(OW);
+			}
+			break;
+		case SMTNode::SDivO:
+			// INT_MIN / -1
+			for (l = 0; l != Lanes; ++l)
+				D[l] = A[l] == (mask(OW) >> 1) + 1 && B[l] == mask(OW);
+			break;
+		}
+	}
+}
+
+bool SMTEval::solve(SMTNode *Query) {
+	const std::vector<SMTNode *> &Facts = DAG.assumptions();
+	// The first equality assumed of a variable defines it.
+	for (unsigned i = 0, n = Facts.size(); i != n; ++i) {
+		SMTNode *F = Facts[i];
+		if (F->K != SMTNode::Eq)
+			continue;
+		for (unsigned k = 0; k != 2; ++k) {
+			SMTNode *V = F->Ops[k];
+			if (V->K == SMTNode::Var && !Defs.count(V)) {
+				Defs[V] = F->Ops[1 - k];
+				break;
+			}
+		}
+	}
+	if (!compile(Query)) {
+		++NumMisses;
+		return false;
+	}
+	for (unsigned i = 0, n = Facts.size(); i != n; ++i) {
+		if (!compile(Facts[i])) {
+			++NumMisses;
+			return false;
+		}
+	}
+	Regs.resize(Prog.size() * Lanes);
+	uint64_t Seed = 0x9e3779b97f4a7c15ULL;
+	for (unsigned Round = 0; Round * Lanes < SMTEvalOpt; ++Round) {
+		for (unsigned l = 0; l != Lanes; ++l)
+			Valid[l] = 1;
+		setInputs(Round, Seed);
+		run();
+		uint64_t Hit[Lanes];
+		const uint64_t *Q = reg(Slots[Query]);
+		for (unsigned l = 0; l != Lanes; ++l)
+			Hit[l] = Valid[l] & Q[l];
+		for (unsigned i = 0, n = Facts.size(); i != n; ++i) {
+			const uint64_t *F = reg(Slots[Facts[i]]);
+			for (unsigned l = 0; l != Lanes; ++l)
+				Hit[l] &= F[l];
+		}
+		for (unsigned l = 0; l != Lanes; ++l) {
+			if (Hit[l]) {
+				Witness = l;
+				++NumWitnesses;
+				return true;
+			}
+		}
+	}
+	++NumMisses;
+	return false;
+}
+
+bool SMTEval::eval(SMTNode *N, APInt &Val) const {
+	DenseMap<SMTNode *, unsigned>::const_iterator i = Slots.find(N);
+	if (Witness < 0 || i == Slots.end())
+		return false;
+	Val = APInt(N->Width, Regs[i->second * Lanes + Witness]);
+	return true;
+}
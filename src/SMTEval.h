@@ -0,0 +1,57 @@
+#pragma once
+
+#include "SMTDag.h"
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/Support/DataTypes.h>
+#include <vector>
+
+// Concrete evaluation of queries (-smt-eval=N) before solving: the
+// nodes a query and the DAG's assumptions depend on are evaluated over
+// N inputs, boundary values first and then random ones, a batch of
+// lanes at a time.  A lane in which everything holds is a witness that
+// the query is sat; nothing is concluded otherwise.
+//
+// Variables defined by an assumed equality, e.g., reachability and
+// check indicators, are computed rather than guessed.  Lanes dividing
+// by zero or shifting by the width or more are dropped, and queries
+// with values wider than 64 bits are left to the solver.
+
+class SMTEval {
+public:
+	// N of -smt-eval, or 0.
+	static unsigned inputs();
+
+	SMTEval(SMTDag &DAG) : DAG(DAG), Witness(-1) { }
+
+	bool solve(SMTNode *Query);
+	// The value of N in the witness, if the query needed N.
+	bool eval(SMTNode *N, llvm::APInt &) const;
+
+	enum { Lanes = 64 };
+
+private:
+	SMTDag &DAG;
+
+	// Nodes in evaluation order, with operand slots; a variable takes
+	// the slot of its definition, or NoSlot if it is an input.
+	struct Step {
+		SMTNode *N;
+		unsigned Ops[3];
+	};
+	enum { NoSlot = ~0U };
+	std::vector<Step> Prog;
+	llvm::DenseMap<SMTNode *, unsigned> Slots;
+	llvm::DenseMap<SMTNode *, SMTNode *> Defs;
+	std::vector<uint64_t> Regs;	// Lanes values per slot
+	uint64_t Valid[Lanes];
+	int Witness;			// lane, or -1
+
+	bool compile(SMTNode *);
+	void setInputs(unsigned Round, uint64_t &Seed);
+	void run();
+	uint64_t *reg(unsigned Slot) { return &Regs[Slot * Lanes]; }
+
+	SMTEval(const SMTEval &);
+	void operator=(const SMTEval &);
+};
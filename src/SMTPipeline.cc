@@ -0,0 +1,106 @@
+#include "SMTPipeline.h"
+#include "SMTWorker.h"
+#include "Trace.h"
+#include <llvm/Support/CommandLine.h>
+#include <err.h>
+#include <errno.h>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+SMTThreads("smt-threads",
+           cl::desc("Solve queries on threads while encoding the next ones"),
+           cl::value_desc("N"));
+
+bool SMTPipeline::enabled() {
+	return SMTThreads && SMTSolver::backend();
+}
+
+SMTPipeline::SMTPipeline() : NextTicket(0), Stopping(false) {
+	pthread_mutex_init(&Lock, NULL);
+	pthread_cond_init(&Ready, NULL);
+	pthread_cond_init(&Finished, NULL);
+	// the first calls may fill in a static name and load plugins
+	SMTSolver::backend();
+	SMTWorker::portfolio();
+	Threads.resize(SMTThreads);
+	for (unsigned i = 0; i != Threads.size(); ++i)
+		if ((errno = pthread_create(&Threads[i], NULL, run, this)))
+			err(1, "pthread_create");
+}
+
+// Queued queries are still solved; nobody may be waiting for them.
+SMTPipeline::~SMTPipeline() {
+	pthread_mutex_lock(&Lock);
+	Stopping = true;
+	pthread_cond_broadcast(&Ready);
+	pthread_mutex_unlock(&Lock);
+	for (unsigned i = 0; i != Threads.size(); ++i)
+		pthread_join(Threads[i], NULL);
+	pthread_cond_destroy(&Finished);
+	pthread_cond_destroy(&Ready);
+	pthread_mutex_destroy(&Lock);
+}
+
+unsigned SMTPipeline::submit(const std::string &Text) {
+	pthread_mutex_lock(&Lock);
+	unsigned Ticket = NextTicket++;
+	Queue[Ticket] = Text;
+	pthread_cond_signal(&Ready);
+	pthread_mutex_unlock(&Lock);
+	return Ticket;
+}
+
+bool SMTPipeline::done(unsigned Ticket) {
+	pthread_mutex_lock(&Lock);
+	bool Done = Results.count(Ticket);
+	pthread_mutex_unlock(&Lock);
+	return Done;
+}
+
+SMTStatus SMTPipeline::wait(unsigned Ticket) {
+	TraceSpan Span("wait", "smt");
+	pthread_mutex_lock(&Lock);
+	std::map<unsigned, SMTStatus>::iterator i;
+	while ((i = Results.find(Ticket)) == Results.end())
+		pthread_cond_wait(&Finished, &Lock);
+	SMTStatus Res = i->second;
+	Results.erase(i);
+	pthread_mutex_unlock(&Lock);
+	return Res;
+}
+
+void *SMTPipeline::run(void *P) {
+	((SMTPipeline *)P)->serve();
+	return NULL;
+}
+
+// Oldest query first, so that results arrive roughly in the order the
+// caller reports them.
+void SMTPipeline::serve() {
+	SMTWorker Worker;
+	pthread_mutex_lock(&Lock);
+	for (;;) {
+		while (Queue.empty() && !Stopping)
+			pthread_cond_wait(&Ready, &Lock);
+		if (Queue.empty())
+			break;
+		unsigned Ticket = Queue.begin()->first;
+		std::string Text;
+		Text.swap(Queue.begin()->second);
+		Queue.erase(Queue.begin());
+		pthread_mutex_unlock(&Lock);
+
+		SMTStatus Res;
+		{
+			TraceSpan Span("solve", "smt");
+			Res = SMTSolver::queryText(Text, Worker);
+			Span.arg("status", Res);
+		}
+
+		pthread_mutex_lock(&Lock);
+		Results[Ticket] = Res;
+		pthread_cond_broadcast(&Finished);
+	}
+	pthread_mutex_unlock(&Lock);
+}
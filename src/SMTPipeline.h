@@ -0,0 +1,43 @@
+#pragma once
+
+#include "SMTSolver.h"
+#include <map>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+// Solve printed queries on -smt-threads threads, each with a fresh
+// solver context per query (or its own SMTWorker with -smt-fork), while
+// the caller goes on encoding.  Results are claimed by ticket, so the
+// caller decides the order in which they are reported.
+class SMTPipeline {
+public:
+	SMTPipeline();
+	~SMTPipeline();
+
+	// -smt-threads is set and the backend can print queries.
+	static bool enabled();
+
+	unsigned threads() const { return Threads.size(); }
+
+	unsigned submit(const std::string &Text);
+	bool done(unsigned Ticket);
+	// Block until the result is ready; each ticket is claimed once.
+	SMTStatus wait(unsigned Ticket);
+
+private:
+	std::vector<pthread_t> Threads;
+	pthread_mutex_t Lock;
+	pthread_cond_t Ready, Finished;
+	// queued texts by ticket, and results not yet claimed
+	std::map<unsigned, std::string> Queue;
+	std::map<unsigned, SMTStatus> Results;
+	unsigned NextTicket;
+	bool Stopping;
+
+	static void *run(void *);
+	void serve();
+
+	SMTPipeline(const SMTPipeline &);
+	void operator=(const SMTPipeline &);
+};
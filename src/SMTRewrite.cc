@@ -0,0 +1,262 @@
+#include "SMTRewrite.h"
+#include <llvm/Support/ErrorHandling.h>
+
+using namespace llvm;
+
+// Commutative operands in creation order, so that a op b and b op a
+// are one node.
+static void order(SMTNode *&L, SMTNode *&R) {
+	if (L->ID > R->ID)
+		std::swap(L, R);
+}
+
+SMTNode *SMTRewriter::ite(SMTNode *C, SMTNode *T, SMTNode *F) {
+	if (C->isConst())
+		return C->isTrue() ? T : F;
+	if (T == F)
+		return T;
+	// Boolean c ? 1 : 0 is c.
+	if (T->isConst() && F->isConst() && T->Width == 1)
+		return T->isTrue() ? C : bvnot(C);
+	return get(SMTNode::Ite, T->Width, C, T, F);
+}
+
+SMTNode *SMTRewriter::eq(SMTNode *L, SMTNode *R) {
+	if (L == R)
+		return bvtrue();
+	// Distinct constants are distinct nodes.
+	if (L->isConst() && R->isConst())
+		return bvfalse();
+	order(L, R);
+	return get(SMTNode::Eq, 1, L, R);
+}
+
+SMTNode *SMTRewriter::ne(SMTNode *L, SMTNode *R) {
+	if (L == R)
+		return bvfalse();
+	if (L->isConst() && R->isConst())
+		return bvtrue();
+	order(L, R);
+	return get(SMTNode::Ne, 1, L, R);
+}
+
+SMTNode *SMTRewriter::cmp(SMTNode::Kind K, SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst()) {
+		const APInt &LV = L->Val, &RV = R->Val;
+		switch (K) {
+		default: llvm_unreachable("Unknown comparison!");
+		case SMTNode::Slt: return boolean(LV.slt(RV));
+		case SMTNode::Sle: return boolean(LV.sle(RV));
+		case SMTNode::Sgt: return boolean(LV.sgt(RV));
+		case SMTNode::Sge: return boolean(LV.sge(RV));
+		case SMTNode::Ult: return boolean(LV.ult(RV));
+		case SMTNode::Ule: return boolean(LV.ule(RV));
+		case SMTNode::Ugt: return boolean(LV.ugt(RV));
+		case SMTNode::Uge: return boolean(LV.uge(RV));
+		}
+	}
+	if (L == R)
+		return boolean(K == SMTNode::Sle || K == SMTNode::Sge
+		               || K == SMTNode::Ule || K == SMTNode::Uge);
+	return get(K, 1, L, R);
+}
+
+SMTNode *SMTRewriter::extract(unsigned High, unsigned Low, SMTNode *N) {
+	if (Low == 0 && High + 1 == N->Width)
+		return N;
+	if (N->isConst())
+		return bvconst(N->Val.lshr(Low).trunc(High - Low + 1));
+	// Bits of an extension: from its source, or a shorter extension.
+	if (N->K == SMTNode::ZExt || N->K == SMTNode::SExt) {
+		SMTNode *Src = N->Ops[0];
+		if (High < Src->Width)
+			return extract(High, Low, Src);
+		if (Low == 0)
+			return extend(N->K == SMTNode::SExt, High + 1 - Src->Width, Src);
+	}
+	return get(SMTNode::Extract, High - Low + 1, N, NULL, NULL, High, Low);
+}
+
+SMTNode *SMTRewriter::extend(bool Signed, unsigned I, SMTNode *N) {
+	if (I == 0)
+		return N;
+	unsigned Width = N->Width + I;
+	if (N->isConst())
+		return bvconst(Signed ? N->Val.sext(Width) : N->Val.zext(Width));
+	// Merge nested extensions; a zero extension has a zero sign bit.
+	if (N->K == SMTNode::ZExt || (Signed && N->K == SMTNode::SExt)) {
+		SMTNode *Src = N->Ops[0];
+		return extend(N->K == SMTNode::SExt, Width - Src->Width, Src);
+	}
+	return get(Signed ? SMTNode::SExt : SMTNode::ZExt, Width, N,
+	           NULL, NULL, I);
+}
+
+SMTNode *SMTRewriter::bvnot(SMTNode *N) {
+	if (N->isConst())
+		return bvconst(~N->Val);
+	if (N->K == SMTNode::Not)
+		return N->Ops[0];
+	return get(SMTNode::Not, N->Width, N);
+}
+
+SMTNode *SMTRewriter::bvadd(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val + R->Val);
+	if (L->isConst() && !L->Val)
+		return R;
+	if (R->isConst() && !R->Val)
+		return L;
+	order(L, R);
+	return get(SMTNode::Add, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvsub(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val - R->Val);
+	if (R->isConst() && !R->Val)
+		return L;
+	if (L == R)
+		return zero(L);
+	return get(SMTNode::Sub, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvmul(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val * R->Val);
+	if (L->isConst())
+		std::swap(L, R);
+	if (R->isConst() && !R->Val)
+		return R;
+	if (R->isConst() && R->Val.isPowerOf2())
+		return shiftBy(SMTNode::Shl, L, R->Val.logBase2());
+	order(L, R);
+	return get(SMTNode::Mul, L->Width, L, R);
+}
+
+// Division by zero is left to the backend, which may define it.
+SMTNode *SMTRewriter::bvsdiv(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst() && !!R->Val
+	    && !(L->Val.isMinSignedValue() && R->Val.isAllOnesValue()))
+		return bvconst(L->Val.sdiv(R->Val));
+	return get(SMTNode::SDiv, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvudiv(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst() && !!R->Val)
+		return bvconst(L->Val.udiv(R->Val));
+	if (R->isConst() && R->Val.isPowerOf2())
+		return shiftBy(SMTNode::LShr, L, R->Val.logBase2());
+	return get(SMTNode::UDiv, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvsrem(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst() && !!R->Val
+	    && !(L->Val.isMinSignedValue() && R->Val.isAllOnesValue()))
+		return bvconst(L->Val.srem(R->Val));
+	return get(SMTNode::SRem, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvurem(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst() && !!R->Val)
+		return bvconst(L->Val.urem(R->Val));
+	if (R->isConst() && R->Val.isPowerOf2())
+		return bvand(L, bvconst(R->Val - 1));
+	return get(SMTNode::URem, L->Width, L, R);
+}
+
+// Shifting by the width or more is undefined in LLVM; leave it as is.
+SMTNode *SMTRewriter::shift(SMTNode::Kind K, SMTNode *L, SMTNode *R) {
+	if (R->isConst() && R->Val.ult(R->Width)) {
+		unsigned Amount = R->Val.getZExtValue();
+		if (L->isConst()) {
+			switch (K) {
+			default: llvm_unreachable("Unknown shift!");
+			case SMTNode::Shl:  return bvconst(L->Val.shl(Amount));
+			case SMTNode::LShr: return bvconst(L->Val.lshr(Amount));
+			case SMTNode::AShr: return bvconst(L->Val.ashr(Amount));
+			}
+		}
+		if (Amount == 0)
+			return L;
+	}
+	if (L->isConst() && !L->Val)
+		return L;
+	return get(K, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::shiftBy(SMTNode::Kind K, SMTNode *N, unsigned Amount) {
+	return shift(K, N, bvconst(APInt(N->Width, Amount)));
+}
+
+SMTNode *SMTRewriter::bvand(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val & R->Val);
+	if (L == R)
+		return L;
+	if (L->isConst())
+		std::swap(L, R);
+	if (R->isConst())
+		return !R->Val ? R : R->Val.isAllOnesValue() ? L
+		       : get(SMTNode::And, L->Width, L, R);
+	order(L, R);
+	return get(SMTNode::And, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvor(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val | R->Val);
+	if (L == R)
+		return L;
+	if (L->isConst())
+		std::swap(L, R);
+	if (R->isConst())
+		return !R->Val ? L : R->Val.isAllOnesValue() ? R
+		       : get(SMTNode::Or, L->Width, L, R);
+	order(L, R);
+	return get(SMTNode::Or, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::bvxor(SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst())
+		return bvconst(L->Val ^ R->Val);
+	if (L == R)
+		return zero(L);
+	if (L->isConst())
+		std::swap(L, R);
+	if (R->isConst())
+		return !R->Val ? L : R->Val.isAllOnesValue() ? bvnot(L)
+		       : get(SMTNode::Xor, L->Width, L, R);
+	order(L, R);
+	return get(SMTNode::Xor, L->Width, L, R);
+}
+
+SMTNode *SMTRewriter::ovf(SMTNode::Kind K, SMTNode *L, SMTNode *R) {
+	if (L->isConst() && R->isConst()) {
+		const APInt &LV = L->Val, &RV = R->Val;
+		bool Overflow = false;
+		switch (K) {
+		default: llvm_unreachable("Unknown overflow!");
+		case SMTNode::SAddO: LV.sadd_ov(RV, Overflow); break;
+		case SMTNode::UAddO: LV.uadd_ov(RV, Overflow); break;
+		case SMTNode::SSubO: LV.ssub_ov(RV, Overflow); break;
+		case SMTNode::USubO: LV.usub_ov(RV, Overflow); break;
+		case SMTNode::SMulO: LV.smul_ov(RV, Overflow); break;
+		case SMTNode::UMulO: LV.umul_ov(RV, Overflow); break;
+		case SMTNode::SDivO:
+			Overflow = LV.isMinSignedValue() && RV.isAllOnesValue();
+			break;
+		}
+		return boolean(Overflow);
+	}
+	bool Commutes = K == SMTNode::SAddO || K == SMTNode::UAddO
+	                || K == SMTNode::SMulO || K == SMTNode::UMulO;
+	// Adding, subtracting or multiplying by zero never overflows.
+	if (K != SMTNode::SDivO && R->isConst() && !R->Val)
+		return bvfalse();
+	if (Commutes && L->isConst() && !L->Val)
+		return bvfalse();
+	if (Commutes)
+		order(L, R);
+	return get(K, 1, L, R);
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/FoldingSet.h>
+
+// A node of the backend-neutral expression DAG.  Nodes are hash-consed,
+// so identical subterms are one node, and live as long as their SMTDag.
+struct SMTNode : llvm::FoldingSetNode {
+	enum Kind {
+		Const, Var, Ite,
+		Eq, Ne, Slt, Sle, Sgt, Sge, Ult, Ule, Ugt, Uge,
+		Extract, ZExt, SExt, Not,
+		Add, Sub, Mul, SDiv, UDiv, SRem, URem, Shl, LShr, AShr,
+		And, Or, Xor,
+		SAddO, UAddO, SSubO, USubO, SMulO, UMulO, SDivO,
+	};
+
+	Kind K;
+	unsigned Width;
+	unsigned ID;		// creation order
+	SMTNode *Ops[3];
+	unsigned X, Y;		// extract bounds, extension width
+	llvm::APInt Val;	// Const
+	const char *Name;	// Var
+
+	bool isConst() const { return K == Const; }
+	bool isTrue() const { return K == Const && Val.getBoolValue(); }
+	bool isFalse() const { return K == Const && !Val; }
+
+	void Profile(llvm::FoldingSetNodeID &) const;
+};
+
+// Simplifies expressions as they are built: folds constants, turns
+// multiplication and unsigned division by powers of two into shifts,
+// and collapses extract/extend chains and trivial guards.  The
+// interface follows SMTSolver's builders; the nodes themselves come
+// from the DAG (SMTDag), which uniques them.
+class SMTRewriter {
+public:
+	virtual ~SMTRewriter() { }
+
+	unsigned bvwidth(SMTNode *N) { return N->Width; }
+
+	SMTNode *bvfalse() { return bvconst(llvm::APInt(1, 0)); }
+	SMTNode *bvtrue() { return bvconst(llvm::APInt(1, 1)); }
+	virtual SMTNode *bvconst(const llvm::APInt &) = 0;
+	virtual SMTNode *bvvar(unsigned width, const char *name) = 0;
+
+	SMTNode *ite(SMTNode *, SMTNode *, SMTNode *);
+
+	SMTNode *eq(SMTNode *, SMTNode *);
+	SMTNode *ne(SMTNode *, SMTNode *);
+	SMTNode *bvslt(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Slt, L, R); }
+	SMTNode *bvsle(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Sle, L, R); }
+	SMTNode *bvsgt(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Sgt, L, R); }
+	SMTNode *bvsge(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Sge, L, R); }
+	SMTNode *bvult(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Ult, L, R); }
+	SMTNode *bvule(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Ule, L, R); }
+	SMTNode *bvugt(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Ugt, L, R); }
+	SMTNode *bvuge(SMTNode *L, SMTNode *R) { return cmp(SMTNode::Uge, L, R); }
+
+	SMTNode *extract(unsigned high, unsigned low, SMTNode *);
+	SMTNode *zero_extend(unsigned i, SMTNode *N) { return extend(false, i, N); }
+	SMTNode *sign_extend(unsigned i, SMTNode *N) { return extend(true, i, N); }
+
+	SMTNode *bvnot(SMTNode *);
+
+	SMTNode *bvadd(SMTNode *, SMTNode *);
+	SMTNode *bvsub(SMTNode *, SMTNode *);
+	SMTNode *bvmul(SMTNode *, SMTNode *);
+	SMTNode *bvsdiv(SMTNode *, SMTNode *);
+	SMTNode *bvudiv(SMTNode *, SMTNode *);
+	SMTNode *bvsrem(SMTNode *, SMTNode *);
+	SMTNode *bvurem(SMTNode *, SMTNode *);
+	SMTNode *bvshl(SMTNode *L, SMTNode *R) { return shift(SMTNode::Shl, L, R); }
+	SMTNode *bvlshr(SMTNode *L, SMTNode *R) { return shift(SMTNode::LShr, L, R); }
+	SMTNode *bvashr(SMTNode *L, SMTNode *R) { return shift(SMTNode::AShr, L, R); }
+	SMTNode *bvand(SMTNode *, SMTNode *);
+	SMTNode *bvor(SMTNode *, SMTNode *);
+	SMTNode *bvxor(SMTNode *, SMTNode *);
+
+	SMTNode *bvsadd_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::SAddO, L, R); }
+	SMTNode *bvuadd_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::UAddO, L, R); }
+	SMTNode *bvssub_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::SSubO, L, R); }
+	SMTNode *bvusub_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::USubO, L, R); }
+	SMTNode *bvsmul_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::SMulO, L, R); }
+	SMTNode *bvumul_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::UMulO, L, R); }
+	SMTNode *bvsdiv_overflow(SMTNode *L, SMTNode *R) { return ovf(SMTNode::SDivO, L, R); }
+
+protected:
+	SMTRewriter() { }
+
+	// The unique node of the given operator and operands.
+	virtual SMTNode *get(SMTNode::Kind, unsigned Width, SMTNode *A,
+	                     SMTNode *B = 0, SMTNode *C = 0,
+	                     unsigned X = 0, unsigned Y = 0) = 0;
+
+private:
+	SMTNode *boolean(bool B) { return B ? bvtrue() : bvfalse(); }
+	SMTNode *zero(SMTNode *N) {
+		return bvconst(llvm::APInt::getNullValue(N->Width));
+	}
+
+	SMTNode *cmp(SMTNode::Kind, SMTNode *, SMTNode *);
+	SMTNode *extend(bool Signed, unsigned i, SMTNode *);
+	SMTNode *shift(SMTNode::Kind, SMTNode *, SMTNode *);
+	SMTNode *shiftBy(SMTNode::Kind, SMTNode *, unsigned);
+	SMTNode *ovf(SMTNode::Kind, SMTNode *, SMTNode *);
+
+	SMTRewriter(const SMTRewriter &);
+	void operator=(const SMTRewriter &);
+};
@@ -1,7 +1,22 @@
+#include "SMTSolver.h"
+#include "SMTWorker.h"
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/ADT/STLExtras.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/ADT/StringSet.h>
 #include <llvm/Support/CommandLine.h>
-#include <sys/time.h>
-#include <sys/wait.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/system_error.h>
+#include <ctype.h>
+#include <dlfcn.h>
 #include <err.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <unistd.h>
 
 using namespace llvm;
@@ -11,35 +26,288 @@ SMTTimeoutOpt("smt-timeout",
               cl::desc("Specify a timeout for SMT solver"),
               cl::value_desc("milliseconds"));
 
-static pid_t pid;
+static cl::opt<bool>
+SMTForkOpt("smt-fork",
+           cl::desc("Solve queries in a worker process for crash safety"));
 
-int SMTFork()
-{
-	if (!SMTTimeoutOpt)
-		return 0;
-	pid = fork();
-	if (pid < 0)
-		err(1, "fork");
-	// Parent process.
-	if (pid)
-		return 1;
-	// Child process.
-	struct itimerval itv = {{0, 0}, {SMTTimeoutOpt / 1000, SMTTimeoutOpt % 1000 * 1000}};
-	setitimer(ITIMER_VIRTUAL, &itv, NULL);
-	return 0;
-}
-
-void SMTJoin(int *status)
+static cl::opt<std::string>
+SMTCacheDir("smt-cache",
+            cl::desc("Reuse query results across runs from a directory"),
+            cl::value_desc("directory"));
+
+static cl::opt<std::string>
+SMTBackendOpt("smt-backend",
+              cl::desc("SMT solver plugin, by name or file"),
+              cl::value_desc("boolector|z3|sonolar|path"),
+              cl::init("boolector"));
+
+static SMTWorker Worker;
+
+unsigned SMTTimeout()
 {
-	if (!SMTTimeoutOpt)
+	return SMTTimeoutOpt;
+}
+
+// Plugins named by -smt-backend or -smt-portfolio sit next to the
+// library linking this file, as libsmt-<name>.so.
+const SMTPlugin &SMTSolver::plugin(const std::string &Backend) {
+	std::string Path = Backend;
+	if (Path.find('/') == std::string::npos) {
+		Dl_info Info;
+		std::string Dir = ".";
+		if (dladdr((void *)&SMTSolver::plugin, &Info) && Info.dli_fname)
+			Dir = sys::path::parent_path(Info.dli_fname).str();
+		Path = Dir + "/libsmt-" + Path + ".so";
+	}
+	void *Handle = dlopen(Path.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!Handle)
+		errx(1, "%s", dlerror());
+	const SMTPlugin *P = (const SMTPlugin *)dlsym(Handle, SMT_PLUGIN_SYMBOL);
+	if (!P)
+		errx(1, "%s: not an SMT backend", Path.c_str());
+	if (P->Version != SMT_PLUGIN_VERSION)
+		errx(1, "%s: SMT backend version %u, expected %u", Path.c_str(),
+		     P->Version, SMT_PLUGIN_VERSION);
+	return *P;
+}
+
+// The first call must not race with others; SMTPipeline makes it before
+// starting threads.
+static const SMTPlugin &backendPlugin() {
+	static const SMTPlugin *Plugin;
+	if (!Plugin)
+		Plugin = &SMTSolver::plugin(SMTBackendOpt);
+	return *Plugin;
+}
+
+SMTSolver *SMTSolver::create(bool modelgen) {
+	return backendPlugin().create(modelgen);
+}
+
+const char *SMTSolver::backend() {
+	return backendPlugin().name();
+}
+
+SMTSolver::~SMTSolver() { }
+
+// Rename the symbols of a printed query in order of first occurrence:
+// the benchmark name, declared functions, let-bound names and ValueGen
+// variables (name@address).  The same formula then prints the same
+// across runs, however many nodes the solver created before.
+static std::string canonicalize(StringRef Text) {
+	SmallVector<StringRef, 256> Toks;
+	for (size_t i = 0, n = Text.size(); i < n; ) {
+		char c = Text[i];
+		if (isspace(c)) {
+			++i;
+			continue;
+		}
+		size_t j = i + 1;
+		if (c != '(' && c != ')')
+			while (j < n && !isspace(Text[j])
+			       && Text[j] != '(' && Text[j] != ')')
+				++j;
+		Toks.push_back(Text.slice(i, j));
+		i = j;
+	}
+
+	StringSet<> Syms;
+	for (unsigned i = 0; i + 1 < Toks.size(); ++i) {
+		StringRef T = Toks[i];
+		if (T != "benchmark" && T != ":extrafuns" && T != ":extrapreds"
+		    && T != "let" && T != "flet")
+			continue;
+		unsigned k = i + 1;
+		while (k < Toks.size() && Toks[k] == "(")
+			++k;
+		if (k < Toks.size())
+			Syms.insert(Toks[k]);
+	}
+
+	std::string S;
+	StringMap<unsigned> Names;
+	for (unsigned i = 0; i != Toks.size(); ++i) {
+		StringRef T = Toks[i];
+		if (Syms.count(T) || T.find('@') != StringRef::npos) {
+			unsigned &N = Names[T];
+			if (!N)
+				N = Names.size();
+			S += "s" + utostr(N);
+		} else
+			S += T;
+		S += ' ';
+	}
+	return S;
+}
+
+// 64-bit FNV-1a; collisions only cost a miss, as entries keep the key.
+static uint64_t hashKey(StringRef Key) {
+	uint64_t H = 14695981039346656037ULL;
+	for (size_t i = 0; i != Key.size(); ++i) {
+		H ^= (unsigned char)Key[i];
+		H *= 1099511628211ULL;
+	}
+	return H;
+}
+
+static const char *StatusNames[] = { "timeout", "undef", "unsat", "sat" };
+
+// An entry is the status on the first line, followed by the key.
+static bool cacheLookup(const std::string &Path, StringRef Key,
+                        SMTStatus &Res) {
+	OwningPtr<MemoryBuffer> MB;
+	if (MemoryBuffer::getFile(Path, MB))
+		return false;
+	StringRef Status, Rest;
+	tie(Status, Rest) = MB->getBuffer().split('\n');
+	if (Rest != Key)
+		return false;
+	for (unsigned i = 0; i != array_lengthof(StatusNames); ++i) {
+		if (Status == StatusNames[i]) {
+			Res = (SMTStatus)((int)i + SMT_TIMEOUT);
+			return true;
+		}
+	}
+	return false;
+}
+
+// Write a temporary file and rename it, so that concurrent runs and
+// threads never see a partial entry.
+static void cacheStore(const std::string &Path, StringRef Key,
+                       SMTStatus Res) {
+	bool Existed;
+	if (sys::fs::create_directories(sys::path::parent_path(Path), Existed))
+		return;
+	std::string Tmp = Path + ".tmp" + utostr(getpid()) + "."
+	                  + utostr((uintptr_t)pthread_self());
+	{
+		std::string Err;
+		raw_fd_ostream OS(Tmp.c_str(), Err, raw_fd_ostream::F_Binary);
+		if (!Err.empty())
+			return;
+		OS << StatusNames[Res - SMT_TIMEOUT] << '\n' << Key;
+	}
+	if (rename(Tmp.c_str(), Path.c_str()))
+		unlink(Tmp.c_str());
+}
+
+void SMTSolver::assume(SMTExpr E) {
+	constrain(E);
+	if (!Facts) {
+		incref(E);
+		Facts = E;
 		return;
-	// Child process.
-	if (pid == 0)
-		_exit(*status);
-	// Parent process.
-	waitpid(pid, status, 0);
-	if (WIFEXITED(*status))
-		*status = WEXITSTATUS(*status);
-	else
-		*status = -1;
+	}
+	SMTExpr And = bvand(Facts, E);
+	decref(Facts);
+	Facts = And;
+}
+
+void SMTSolver::serialize(SMTExpr E, std::string &Text) {
+	SMTExpr Q = Facts ? bvand(Facts, E) : E;
+	raw_string_ostream OS(Text);
+	print(Q, OS);
+	OS.flush();
+	if (Facts)
+		decref(Q);
+}
+
+// The -smt-cache entry of a printed query.
+static void cacheEntry(const std::string &Text, std::string &Key,
+                       std::string &Path) {
+	// a portfolio may solve what the backend alone times out on
+	Key = std::string(SMTSolver::backend())
+	      + (SMTWorker::portfolio() ? "+portfolio " : " ")
+	      + utostr(SMTTimeoutOpt) + "\n" + canonicalize(Text);
+	char Hash[17];
+	snprintf(Hash, sizeof(Hash), "%016llx",
+	         (unsigned long long)hashKey(Key));
+	Path = SMTCacheDir + "/" + std::string(Hash, 2) + "/" + (Hash + 2);
+}
+
+// Most queries finish quickly, so give the backend a head start in
+// process, in a fresh context since a timed-out one may stay unusable;
+// only queries that outlive it pay for the race.
+SMTStatus SMTSolver::raceText(const std::string &Text) {
+	unsigned Timeout = SMTTimeoutOpt;
+	unsigned After = SMTWorker::portfolioAfter();
+	if (!After)
+		return SMTWorker::portfolioSolve(Text, Timeout);
+	bool Last = Timeout && Timeout <= After;
+	SMTStatus Res;
+	{
+		OwningPtr<SMTSolver> SMT(create(false));
+		SMT->Limit = Last ? Timeout : After;
+		Res = SMT->solveText(Text);
+	}
+	if (Res != SMT_TIMEOUT || Last)
+		return Res;
+	return SMTWorker::portfolioSolve(Text, Timeout ? Timeout - After : 0);
+}
+
+SMTStatus SMTSolver::query(SMTExpr E, SMTModel *M) {
+	bool Cache = !SMTCacheDir.empty() && backend();
+	bool Race = SMTWorker::portfolio();
+	if (!Cache && !SMTForkOpt && !Race)
+		return solve(E, M);
+	if (!backend())
+		return SMTWorker::forkSolve(*this, E);
+
+	std::string Text, Key, Path;
+	serialize(E, Text);
+	SMTStatus Res;
+	if (Cache) {
+		cacheEntry(Text, Key, Path);
+		// a model needs the solver
+		if (cacheLookup(Path, Key, Res) && !(Res == SMT_SAT && M))
+			return Res;
+	}
+
+	if (SMTForkOpt || Race) {
+		if (Race)
+			Res = raceText(Text);
+		else
+			Res = Worker.solve(Text);
+		// the model comes from solving again in process; an external
+		// solver may have won where the backend times out
+		if (Res == SMT_SAT && M) {
+			SMTStatus Again = solve(E, M);
+			if (Again != SMT_SAT) {
+				*M = NULL;
+				if (!Race)
+					Res = Again;
+			}
+		}
+	} else
+		Res = solve(E, M);
+
+	// timeouts are measured on wall-clock time and may not recur
+	if (Cache && Res != SMT_TIMEOUT)
+		cacheStore(Path, Key, Res);
+	return Res;
+}
+
+SMTStatus SMTSolver::queryText(const std::string &Text, SMTWorker &W) {
+	bool Cache = !SMTCacheDir.empty();
+	std::string Key, Path;
+	SMTStatus Res;
+	if (Cache) {
+		cacheEntry(Text, Key, Path);
+		if (cacheLookup(Path, Key, Res))
+			return Res;
+	}
+
+	bool Race = SMTWorker::portfolio();
+	if (Race)
+		Res = raceText(Text);
+	else if (SMTForkOpt)
+		Res = W.solve(Text);
+	else {
+		OwningPtr<SMTSolver> SMT(create(false));
+		Res = SMT->solveText(Text);
+	}
+
+	if (Cache && Res != SMT_TIMEOUT)
+		cacheStore(Path, Key, Res);
+	return Res;
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <string>
+
 namespace llvm {
 	class APInt;
 	class raw_ostream;
@@ -16,82 +18,140 @@ typedef void *SMTContext;
 typedef void *SMTExpr;
 typedef void *SMTModel;
 
-int SMTFork();
-void SMTJoin(int *);
+class SMTWorker;
+struct SMTPlugin;
+
+// Milliseconds a query may run; 0 for no limit.
+unsigned SMTTimeout();
 
+// The interface each backend plugin implements; the common layer
+// (caching, workers, assumptions) calls into it.
 class SMTSolver {
 public:
-	SMTSolver(bool modelgen);
-	~SMTSolver();
+	// A solver from the plugin chosen with -smt-backend.
+	static SMTSolver *create(bool modelgen);
+	virtual ~SMTSolver();
 
 	void assume(SMTExpr);
 
+	// Check the -smt-cache first, if any, then solve, in an
+	// SMTWorker with -smt-fork.
 	SMTStatus query(SMTExpr, SMTModel * = 0);
-	void eval(SMTModel, SMTExpr, llvm::APInt &);
-	void release(SMTModel);
 
-	void dump(SMTExpr);
-	void print(SMTExpr, llvm::raw_ostream &);
+	// For solving on other threads (see SMTPipeline): the query text
+	// including the assumed constraints, and solving such text in a
+	// fresh context, or in the given worker with -smt-fork.
+	void serialize(SMTExpr, std::string &);
+	static SMTStatus queryText(const std::string &, SMTWorker &);
+	// The plugin's name(), loading it if needed; NULL if it cannot
+	// print queries.
+	static const char *backend();
+	// Load a plugin, by name or file as -smt-backend takes it; exits
+	// if it cannot be loaded.
+	static const SMTPlugin &plugin(const std::string &Backend);
+
+	virtual void eval(SMTModel, SMTExpr, llvm::APInt &) = 0;
+	virtual void release(SMTModel) = 0;
+
+	virtual void dump(SMTExpr) = 0;
+	virtual void print(SMTExpr, llvm::raw_ostream &) = 0;
 
-	void incref(SMTExpr);
-	void decref(SMTExpr);
+	virtual void incref(SMTExpr) = 0;
+	virtual void decref(SMTExpr) = 0;
 
-	unsigned bvwidth(SMTExpr);
+	virtual unsigned bvwidth(SMTExpr) = 0;
 
-	SMTExpr bvfalse();
-	SMTExpr bvtrue();
-	SMTExpr bvconst(const llvm::APInt &);
-	SMTExpr bvvar(unsigned width, const char *name);
+	virtual SMTExpr bvfalse() = 0;
+	virtual SMTExpr bvtrue() = 0;
+	virtual SMTExpr bvconst(const llvm::APInt &) = 0;
+	virtual SMTExpr bvvar(unsigned width, const char *name) = 0;
 
 	// If-else-then.
-	SMTExpr ite(SMTExpr, SMTExpr, SMTExpr);
+	virtual SMTExpr ite(SMTExpr, SMTExpr, SMTExpr) = 0;
 
 	// Comparison.
-	SMTExpr eq(SMTExpr, SMTExpr);
-	SMTExpr ne(SMTExpr, SMTExpr);
-	SMTExpr bvslt(SMTExpr, SMTExpr);
-	SMTExpr bvsle(SMTExpr, SMTExpr);
-	SMTExpr bvsgt(SMTExpr, SMTExpr);
-	SMTExpr bvsge(SMTExpr, SMTExpr);
-	SMTExpr bvult(SMTExpr, SMTExpr);
-	SMTExpr bvule(SMTExpr, SMTExpr);
-	SMTExpr bvugt(SMTExpr, SMTExpr);
-	SMTExpr bvuge(SMTExpr, SMTExpr);
-
-	SMTExpr extract(unsigned high, unsigned low, SMTExpr);
-	SMTExpr zero_extend(unsigned i, SMTExpr);
-	SMTExpr sign_extend(unsigned i, SMTExpr);
-
-	SMTExpr bvredand(SMTExpr);
-	SMTExpr bvredor(SMTExpr);
-	SMTExpr bvnot(SMTExpr);
-	SMTExpr bvneg(SMTExpr);
+	virtual SMTExpr eq(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr ne(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvslt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsle(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsgt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsge(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvult(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvule(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvugt(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvuge(SMTExpr, SMTExpr) = 0;
+
+	virtual SMTExpr extract(unsigned high, unsigned low, SMTExpr) = 0;
+	virtual SMTExpr zero_extend(unsigned i, SMTExpr) = 0;
+	virtual SMTExpr sign_extend(unsigned i, SMTExpr) = 0;
+
+	virtual SMTExpr bvredand(SMTExpr) = 0;
+	virtual SMTExpr bvredor(SMTExpr) = 0;
+	virtual SMTExpr bvnot(SMTExpr) = 0;
+	virtual SMTExpr bvneg(SMTExpr) = 0;
 
 	// Arithmetic operations.
-	SMTExpr bvadd(SMTExpr, SMTExpr);
-	SMTExpr bvsub(SMTExpr, SMTExpr);
-	SMTExpr bvmul(SMTExpr, SMTExpr);
-	SMTExpr bvsdiv(SMTExpr, SMTExpr);
-	SMTExpr bvudiv(SMTExpr, SMTExpr);
-	SMTExpr bvsrem(SMTExpr, SMTExpr);
-	SMTExpr bvurem(SMTExpr, SMTExpr);
-	SMTExpr bvshl(SMTExpr, SMTExpr);
-	SMTExpr bvlshr(SMTExpr, SMTExpr);
-	SMTExpr bvashr(SMTExpr, SMTExpr);
-	SMTExpr bvand(SMTExpr, SMTExpr);
-	SMTExpr bvor(SMTExpr, SMTExpr);
-	SMTExpr bvxor(SMTExpr, SMTExpr);
+	virtual SMTExpr bvadd(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsub(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvmul(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsdiv(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvudiv(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsrem(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvurem(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvshl(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvlshr(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvashr(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvand(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvor(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvxor(SMTExpr, SMTExpr) = 0;
 
 	// Overflow detection.
-	SMTExpr bvneg_overflow(SMTExpr);
-	SMTExpr bvsadd_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvuadd_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvssub_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvusub_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvsmul_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvumul_overflow(SMTExpr, SMTExpr);
-	SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr);
+	virtual SMTExpr bvneg_overflow(SMTExpr) = 0;
+	virtual SMTExpr bvsadd_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvuadd_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvssub_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvusub_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsmul_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvumul_overflow(SMTExpr, SMTExpr) = 0;
+	virtual SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr) = 0;
+
+protected:
+	SMTContext ctx_;
+	SMTExpr Facts;	// conjunction of assumed constraints, or NULL
+	unsigned Limit;	// milliseconds for solve(), if less than -smt-timeout
+
+	SMTSolver() : ctx_(NULL), Facts(NULL), Limit(0) { }
+
+	// The time limit backends apply to solve(); 0 for none.
+	unsigned timeout() const {
+		unsigned T = SMTTimeout();
+		return Limit && (!T || Limit < T) ? Limit : T;
+	}
+
+	virtual void constrain(SMTExpr) = 0;
+	virtual SMTStatus solve(SMTExpr, SMTModel *) = 0;
+	// Solve printed query text in this context.
+	virtual SMTStatus solveText(const std::string &) = 0;
+
+	friend class SMTWorker;
 
 private:
-	SMTContext ctx_;
+	static SMTStatus raceText(const std::string &);
+
+	SMTSolver(const SMTSolver &);
+	void operator=(const SMTSolver &);
+};
+
+// A backend plugin, libsmt-<name>.so, exports one SMTPlugin as
+// SMT_PLUGIN_SYMBOL.  Bump the version whenever SMTSolver's virtual
+// methods or members change.
+#define SMT_PLUGIN_VERSION 2
+#define SMT_PLUGIN_SYMBOL "kint_smt_plugin"
+
+struct SMTPlugin {
+	unsigned Version;
+	// Name and version for cache keys; NULL if queries cannot be
+	// printed faithfully.
+	const char *(*name)();
+	SMTSolver *(*create)(bool modelgen);
 };
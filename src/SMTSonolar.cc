@@ -7,27 +7,109 @@
 
 using namespace llvm;
 
+namespace {
+
+class SonolarSolver : public SMTSolver {
+public:
+	SonolarSolver(bool modelgen);
+	~SonolarSolver();
+
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+
+	void dump(SMTExpr);
+	void print(SMTExpr, llvm::raw_ostream &);
+
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+
+	unsigned bvwidth(SMTExpr);
+
+	SMTExpr bvfalse();
+	SMTExpr bvtrue();
+	SMTExpr bvconst(const llvm::APInt &);
+	SMTExpr bvvar(unsigned width, const char *name);
+
+	// If-else-then.
+	SMTExpr ite(SMTExpr, SMTExpr, SMTExpr);
+
+	// Comparison.
+	SMTExpr eq(SMTExpr, SMTExpr);
+	SMTExpr ne(SMTExpr, SMTExpr);
+	SMTExpr bvslt(SMTExpr, SMTExpr);
+	SMTExpr bvsle(SMTExpr, SMTExpr);
+	SMTExpr bvsgt(SMTExpr, SMTExpr);
+	SMTExpr bvsge(SMTExpr, SMTExpr);
+	SMTExpr bvult(SMTExpr, SMTExpr);
+	SMTExpr bvule(SMTExpr, SMTExpr);
+	SMTExpr bvugt(SMTExpr, SMTExpr);
+	SMTExpr bvuge(SMTExpr, SMTExpr);
+
+	SMTExpr extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr zero_extend(unsigned i, SMTExpr);
+	SMTExpr sign_extend(unsigned i, SMTExpr);
+
+	SMTExpr bvredand(SMTExpr);
+	SMTExpr bvredor(SMTExpr);
+	SMTExpr bvnot(SMTExpr);
+	SMTExpr bvneg(SMTExpr);
+
+	// Arithmetic operations.
+	SMTExpr bvadd(SMTExpr, SMTExpr);
+	SMTExpr bvsub(SMTExpr, SMTExpr);
+	SMTExpr bvmul(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr bvudiv(SMTExpr, SMTExpr);
+	SMTExpr bvsrem(SMTExpr, SMTExpr);
+	SMTExpr bvurem(SMTExpr, SMTExpr);
+	SMTExpr bvshl(SMTExpr, SMTExpr);
+	SMTExpr bvlshr(SMTExpr, SMTExpr);
+	SMTExpr bvashr(SMTExpr, SMTExpr);
+	SMTExpr bvand(SMTExpr, SMTExpr);
+	SMTExpr bvor(SMTExpr, SMTExpr);
+	SMTExpr bvxor(SMTExpr, SMTExpr);
+
+	// Overflow detection.
+	SMTExpr bvneg_overflow(SMTExpr);
+	SMTExpr bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	SMTStatus solveText(const std::string &);
+};
+
+} // anonymous namespace
+
 #define ctx ((sonolar_t)ctx_)
 #define m   ((sonolar_t *)m_)
 #define e   ((sonolar_term_t *)e_)
 #define lhs ((sonolar_term_t *)lhs_)
 #define rhs ((sonolar_term_t *)rhs_)
 
-SMTSolver::SMTSolver(bool /*modelgen*/) {
+SonolarSolver::SonolarSolver(bool /*modelgen*/) {
 	ctx_ = sonolar_create();
 	if (sonolar_set_sat_solver(ctx, SONOLAR_SAT_SOLVER_MINISAT))
 		assert(0 && "sonolar_set_sat_solver");
 }
 
-SMTSolver::~SMTSolver() {
+SonolarSolver::~SonolarSolver() {
+	if (Facts)
+		decref(Facts);
 	sonolar_destroy(ctx);
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+void SonolarSolver::constrain(SMTExpr e_) {
 	sonolar_assert_formula(ctx, e);
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+SMTStatus SonolarSolver::solve(SMTExpr e_, SMTModel *m_) {
 	if (sonolar_assume_formula(ctx, e))
 		assert(0 && "sonolar_assume_formula");
 	switch (sonolar_solve(ctx)) {
@@ -40,215 +122,233 @@ SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
 	return SMT_SAT;
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &) {
+SMTStatus SonolarSolver::solveText(const std::string &) {
 	assert(0 && "NOT SUPPORTED");
+	return SMT_UNDEF;
 }
 
-void SMTSolver::release(SMTModel m_) {}
+void SonolarSolver::eval(SMTModel m_, SMTExpr e_, APInt &) {
+	assert(0 && "NOT SUPPORTED");
+}
 
-void SMTSolver::dump(SMTExpr e_) {
+void SonolarSolver::release(SMTModel m_) {}
+
+void SonolarSolver::dump(SMTExpr e_) {
 	print(e, dbgs());
 	dbgs() << "\n";
 }
 
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
+void SonolarSolver::print(SMTExpr e_, raw_ostream &OS) {
 	OS << "NOT SUPPORTED";
 }
 
-void SMTSolver::incref(SMTExpr e_) {
+void SonolarSolver::incref(SMTExpr e_) {
 	sonolar_add_reference(ctx, e);
 }
 
-void SMTSolver::decref(SMTExpr e_) {
+void SonolarSolver::decref(SMTExpr e_) {
 	sonolar_remove_reference(ctx, e);
 }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned SonolarSolver::bvwidth(SMTExpr e_) {
 	size_t width;
 	if (sonolar_get_bitwidth(ctx, e, &width))
 		assert(0 && "sonolar_get_bitwidth");
 	return (unsigned)width;
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr SonolarSolver::bvfalse() {
 	return sonolar_make_constant_false(ctx);
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr SonolarSolver::bvtrue() {
 	return sonolar_make_constant_true(ctx);
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr SonolarSolver::bvconst(const APInt &Val) {
 	const void *data = Val.getRawData();
 	unsigned width = Val.getBitWidth();
 	return sonolar_make_constant_bytes(ctx, data, width, SONOLAR_BYTE_ORDER_NATIVE);
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr SonolarSolver::bvvar(unsigned width, const char *name) {
 	return sonolar_make_variable(ctx, width, name);
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_ite(ctx, e, lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_equal(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_distinct(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_slt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sle(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sgt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sge(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ult(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ule(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ugt(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_uge(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr SonolarSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
 	return sonolar_make_bv_extract(ctx, e, high, low);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr SonolarSolver::zero_extend(unsigned i, SMTExpr e_) {
 	return sonolar_make_bv_zero_extend(ctx, e, i);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr SonolarSolver::sign_extend(unsigned i, SMTExpr e_) {
 	return sonolar_make_bv_sign_extend(ctx, e, i);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
+SMTExpr SonolarSolver::bvredand(SMTExpr e_) {
 	SMTExpr neg = bvnot(e);
 	SMTExpr tmp = sonolar_make_is_zero(ctx, neg);
 	decref(neg);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr SonolarSolver::bvredor(SMTExpr e_) {
 	SMTExpr z = sonolar_make_is_zero(ctx, e);
 	SMTExpr nz = sonolar_make_not(ctx, z);
 	decref(z);
 	return nz;
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr SonolarSolver::bvnot(SMTExpr e_) {
 	return sonolar_make_bv_not(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr SonolarSolver::bvneg(SMTExpr e_) {
 	return sonolar_make_bv_neg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_add(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_mul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_udiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_srem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_urem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_shl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_lshr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ashr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_and(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_or(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_xor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
+SMTExpr SonolarSolver::bvneg_overflow(SMTExpr e_) {
 	SMTExpr zero = sonolar_make_constant_0_bits(ctx, bvwidth(e));
 	SMTExpr tmp = bvssub_overflow(zero, e);
 	decref(zero);
 	return tmp;
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sadd_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_uadd_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_ssub_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_usub_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_smul_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_umul_ovfl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr SonolarSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return sonolar_make_bv_sdiv_ovfl(ctx, lhs, rhs);
 }
+
+// No printing, no caching, and a fork per query for -smt-fork.
+static const char *name() {
+	return NULL;
+}
+
+static SMTSolver *create(bool modelgen) {
+	return new SonolarSolver(modelgen);
+}
+
+extern "C" const SMTPlugin kint_smt_plugin = {
+	SMT_PLUGIN_VERSION, name, create
+};
@@ -0,0 +1,369 @@
+#include "SMTWorker.h"
+#include "Trace.h"
+#include <llvm/ADT/OwningPtr.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/DataTypes.h>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+SMTMemLimitOpt("smt-memlimit",
+               cl::desc("Address space limit of -smt-fork workers"),
+               cl::value_desc("megabytes"));
+
+static cl::list<std::string>
+SMTPortfolioOpt("smt-portfolio",
+                cl::desc("Race another SMT solver plugin, by name or file"),
+                cl::value_desc("boolector|z3|path"));
+
+static cl::list<std::string>
+SMTPortfolioCmd("smt-portfolio-cmd",
+                cl::desc("Race a solver command that reads SMT-LIB on stdin"),
+                cl::value_desc("command"));
+
+static cl::opt<unsigned>
+SMTPortfolioAfter("smt-portfolio-after",
+                  cl::desc("Time the linked solver runs alone"),
+                  cl::value_desc("milliseconds"), cl::init(500));
+
+static bool readAll(int fd, void *Buf, size_t n) {
+	char *p = (char *)Buf;
+	while (n) {
+		ssize_t r = read(fd, p, n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+static bool writeAll(int fd, const void *Buf, size_t n) {
+	const char *p = (const char *)Buf;
+	while (n) {
+		ssize_t r = write(fd, p, n);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0)
+			return false;
+		p += r;
+		n -= r;
+	}
+	return true;
+}
+
+// CPU time limit of the calling process; 0 disarms.
+static void setTimer(unsigned ms) {
+	struct itimerval itv = {{0, 0}, {ms / 1000, ms % 1000 * 1000}};
+	setitimer(ITIMER_VIRTUAL, &itv, NULL);
+}
+
+SMTWorker::~SMTWorker() {
+	if (Pid)
+		stop();
+}
+
+// Runs in the child: a fresh solver for each query.  The in-process
+// timeout usually stops a query first; the timer catches the rest.
+void SMTWorker::serve(int In, int Out) {
+	if (SMTMemLimitOpt) {
+		struct rlimit rl;
+		rl.rlim_cur = rl.rlim_max = (rlim_t)SMTMemLimitOpt << 20;
+		setrlimit(RLIMIT_AS, &rl);
+	}
+	for (;;) {
+		uint32_t Len;
+		if (!readAll(In, &Len, sizeof(Len)))
+			break;
+		std::string Text(Len, '\0');
+		if (!readAll(In, &Text[0], Len))
+			break;
+		int32_t Res;
+		setTimer(SMTTimeout());
+		{
+			OwningPtr<SMTSolver> SMT(SMTSolver::create(false));
+			Res = SMT->solveText(Text);
+		}
+		setTimer(0);
+		if (!writeAll(Out, &Res, sizeof(Res)))
+			break;
+	}
+	_exit(0);
+}
+
+bool SMTWorker::start() {
+	int Down[2], Up[2];
+	if (pipe(Down))
+		return false;
+	if (pipe(Up)) {
+		close(Down[0]);
+		close(Down[1]);
+		return false;
+	}
+	// writing to a dead worker must fail rather than kill us
+	signal(SIGPIPE, SIG_IGN);
+	TraceSpan Span("spawn", "smt");
+	pid_t pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (pid == 0) {
+		close(Down[1]);
+		close(Up[0]);
+		serve(Down[0], Up[1]);
+	}
+	close(Down[0]);
+	close(Up[1]);
+	Pid = pid;
+	ToChild = Down[1];
+	FromChild = Up[0];
+	return true;
+}
+
+// Other workers may hold copies of the pipes, so EOF is not enough.
+void SMTWorker::stop() {
+	close(ToChild);
+	close(FromChild);
+	kill(Pid, SIGKILL);
+	waitpid(Pid, NULL, 0);
+	Pid = 0;
+}
+
+SMTStatus SMTWorker::solve(const std::string &Text) {
+	if (!Pid && !start())
+		return SMT_UNDEF;
+	TraceSpan Span("worker", "smt");
+	Span.arg("child", Pid);
+	uint32_t Len = Text.size();
+	int32_t Res;
+	if (writeAll(ToChild, &Len, sizeof(Len))
+	    && writeAll(ToChild, Text.data(), Len)
+	    && readAll(FromChild, &Res, sizeof(Res)))
+		return (SMTStatus)Res;
+	// killed by the timer or crashed
+	stop();
+	return SMT_TIMEOUT;
+}
+
+SMTStatus SMTWorker::forkSolve(SMTSolver &SMT, SMTExpr E) {
+	TraceSpan Span("fork", "smt");
+	pid_t pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (pid == 0) {
+		setTimer(SMTTimeout());
+		_exit(SMT.solve(E, NULL) - SMT_TIMEOUT);
+	}
+	int status;
+	waitpid(pid, &status, 0);
+	if (!WIFEXITED(status))
+		return SMT_TIMEOUT;
+	return (SMTStatus)(WEXITSTATUS(status) + SMT_TIMEOUT);
+}
+
+// The plugins of -smt-portfolio, in order.
+static std::vector<const SMTPlugin *> Rivals;
+
+// Plugins are loaded at the first call, which SMTPipeline makes before
+// starting threads: children forked later cannot safely dlopen().
+bool SMTWorker::portfolio() {
+	static bool Loaded;
+	if (!Loaded) {
+		Loaded = true;
+		for (unsigned i = 0; i != SMTPortfolioOpt.size(); ++i) {
+			const SMTPlugin &P = SMTSolver::plugin(SMTPortfolioOpt[i]);
+			// solveText() needs printed queries
+			if (!P.name())
+				errx(1, "%s: cannot solve printed queries",
+				     SMTPortfolioOpt[i].c_str());
+			Rivals.push_back(&P);
+		}
+	}
+	return (!Rivals.empty() || !SMTPortfolioCmd.empty())
+	       && SMTSolver::backend();
+}
+
+unsigned SMTWorker::portfolioAfter() {
+	return SMTPortfolioAfter;
+}
+
+static uint64_t nowMillis() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+namespace {
+
+// A solver process; its answer is the first word it prints.
+struct Contestant {
+	pid_t Pid;
+	int Out;
+	const char *Name;
+	std::string Answer;
+};
+
+} // anonymous namespace
+
+// Start a contestant: unless Cmd is given, a solver from Plugin, or
+// the linked backend if NULL, on Text.  Each leads a process group, so
+// that killing it also kills whatever a command starts.
+bool SMTWorker::spawn(pid_t &Pid, int &Out, const SMTPlugin *Plugin,
+                      const char *Cmd, const char *Input,
+                      const std::string *Text, unsigned Timeout) {
+	int Up[2];
+	if (pipe(Up))
+		return false;
+	pid_t pid = fork();
+	if (pid < 0)
+		err(1, "fork");
+	if (pid == 0) {
+		setpgid(0, 0);
+		close(Up[0]);
+		if (!Cmd) {
+			setTimer(Timeout);
+			SMTStatus Res;
+			{
+				OwningPtr<SMTSolver> SMT(Plugin
+					? Plugin->create(false)
+					: SMTSolver::create(false));
+				SMT->Limit = Timeout;
+				Res = SMT->solveText(*Text);
+			}
+			const char *S = Res == SMT_SAT ? "sat\n"
+			              : Res == SMT_UNSAT ? "unsat\n"
+			              : Res == SMT_TIMEOUT ? "timeout\n" : "unknown\n";
+			writeAll(Up[1], S, strlen(S));
+			_exit(0);
+		}
+		int In = open(Input, O_RDONLY);
+		if (In < 0 || dup2(In, 0) < 0 || dup2(Up[1], 1) < 0)
+			_exit(1);
+		execl("/bin/sh", "sh", "-c", Cmd, (char *)NULL);
+		_exit(1);
+	}
+	setpgid(pid, pid);
+	close(Up[1]);
+	Pid = pid;
+	Out = Up[0];
+	return true;
+}
+
+static SMTStatus answer(const std::string &Out) {
+	size_t i = Out.find_first_not_of(" \t\r\n");
+	if (i == std::string::npos)
+		return SMT_UNDEF;
+	size_t j = Out.find_first_of(" \t\r\n", i);
+	std::string Word = Out.substr(i, j == std::string::npos ? j : j - i);
+	if (Word == "sat")
+		return SMT_SAT;
+	if (Word == "unsat")
+		return SMT_UNSAT;
+	if (Word == "timeout")
+		return SMT_TIMEOUT;
+	return SMT_UNDEF;
+}
+
+// All solvers start at once, each plugin in a child of its own and the
+// commands reading the query from a temporary file; the race is bounded
+// in wall-clock time.  It ends in a timeout unless every solver that
+// dropped out gave up for another reason.
+SMTStatus SMTWorker::portfolioSolve(const std::string &Text,
+                                    unsigned Timeout) {
+	TraceSpan Span("portfolio", "smt");
+	signal(SIGPIPE, SIG_IGN);
+	std::vector<Contestant> Cs;
+	for (unsigned i = 0; i <= Rivals.size(); ++i) {
+		Contestant C;
+		const SMTPlugin *P = i ? Rivals[i - 1] : NULL;
+		C.Name = i ? SMTPortfolioOpt[i - 1].c_str() : "linked";
+		if (spawn(C.Pid, C.Out, P, NULL, NULL, &Text, Timeout))
+			Cs.push_back(C);
+	}
+	if (Cs.empty())
+		return SMT_UNDEF;
+	uint64_t Start = nowMillis();
+	char Input[] = "/tmp/kint-query.XXXXXX";
+	int fd = -1;
+	if (!SMTPortfolioCmd.empty())
+		fd = mkstemp(Input);
+	if (fd >= 0 && writeAll(fd, Text.data(), Text.size())) {
+		for (unsigned i = 0; i != SMTPortfolioCmd.size(); ++i) {
+			Contestant C;
+			C.Name = SMTPortfolioCmd[i].c_str();
+			if (spawn(C.Pid, C.Out, NULL, C.Name, Input, NULL, 0))
+				Cs.push_back(C);
+		}
+	}
+	if (fd >= 0)
+		close(fd);
+	SMTStatus Res = SMT_UNDEF;
+	bool TimedOut = false;
+	for (size_t Running = Cs.size(); Running; ) {
+		uint64_t Now = nowMillis();
+		if (Timeout && Now >= Start + Timeout) {
+			Res = SMT_TIMEOUT;
+			break;
+		}
+		// wake up for the deadline
+		int Wait = Timeout ? (int)(Start + Timeout - Now) : -1;
+		std::vector<struct pollfd> Fds;
+		for (unsigned i = 0; i != Cs.size(); ++i) {
+			struct pollfd P = {Cs[i].Out, POLLIN, 0};
+			Fds.push_back(P);
+		}
+		if (poll(&Fds[0], Fds.size(), Wait) < 0 && errno != EINTR)
+			err(1, "poll");
+		for (unsigned i = 0; i != Fds.size(); ++i) {
+			if (Cs[i].Out < 0 || !Fds[i].revents)
+				continue;
+			char Buf[256];
+			ssize_t n = read(Cs[i].Out, Buf, sizeof(Buf));
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n > 0 && Cs[i].Answer.size() < 4096) {
+				Cs[i].Answer.append(Buf, n);
+				continue;
+			}
+			// at EOF; any other answer drops out, and so does a
+			// solver killed by its timer, printing nothing
+			close(Cs[i].Out);
+			Cs[i].Out = -1;
+			--Running;
+			SMTStatus S = answer(Cs[i].Answer);
+			if (S == SMT_SAT || S == SMT_UNSAT) {
+				Res = S;
+				Span.arg("winner", Cs[i].Name);
+				break;
+			}
+			if (S == SMT_TIMEOUT || Cs[i].Answer.empty())
+				TimedOut = true;
+		}
+		if (Res != SMT_UNDEF)
+			break;
+	}
+	if (Res == SMT_UNDEF && TimedOut)
+		Res = SMT_TIMEOUT;
+	for (unsigned i = 0; i != Cs.size(); ++i) {
+		if (Cs[i].Out >= 0)
+			close(Cs[i].Out);
+		kill(-Cs[i].Pid, SIGKILL);
+		waitpid(Cs[i].Pid, NULL, 0);
+	}
+	if (fd >= 0)
+		unlink(Input);
+	return Res;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "SMTSolver.h"
+#include <string>
+#include <sys/types.h>
+
+// A long-lived child process that solves serialized queries (-smt-fork),
+// under the -smt-timeout CPU time and -smt-memlimit address space limits.
+// A worker that dies, e.g., killed by the timer, is started again at the
+// next query.
+class SMTWorker {
+public:
+	SMTWorker() : Pid(0) { }
+	~SMTWorker();
+
+	SMTStatus solve(const std::string &Text);
+
+	// For backends that cannot serialize queries: solve in a child
+	// forked for this query alone.
+	static SMTStatus forkSolve(SMTSolver &, SMTExpr);
+
+	// Portfolio solving (-smt-portfolio): race the linked backend
+	// against other plugins, each in a child process, and any
+	// -smt-portfolio-cmd commands for at most Timeout milliseconds (0
+	// for no limit); the first sat or unsat wins.  Queries get there
+	// once the backend alone has not solved them in portfolioAfter().
+	static bool portfolio();
+	static unsigned portfolioAfter();
+	static SMTStatus portfolioSolve(const std::string &Text,
+	                                unsigned Timeout);
+
+private:
+	pid_t Pid;
+	int ToChild, FromChild;
+
+	bool start();
+	void stop();
+	static void serve(int In, int Out);
+	static bool spawn(pid_t &, int &Out, const SMTPlugin *,
+	                  const char *Cmd, const char *Input,
+	                  const std::string *Text, unsigned Timeout);
+};
@@ -4,14 +4,173 @@
 #include <llvm/Support/Debug.h>
 #include <llvm/Support/raw_ostream.h>
 #include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/time.h>
 #include <z3.h>
 
 using namespace llvm;
 
+namespace {
+
+class Z3Solver : public SMTSolver {
+public:
+	Z3Solver(bool modelgen);
+	~Z3Solver();
+
+	void eval(SMTModel, SMTExpr, llvm::APInt &);
+	void release(SMTModel);
+
+	void dump(SMTExpr);
+	void print(SMTExpr, llvm::raw_ostream &);
+
+	void incref(SMTExpr);
+	void decref(SMTExpr);
+
+	unsigned bvwidth(SMTExpr);
+
+	SMTExpr bvfalse();
+	SMTExpr bvtrue();
+	SMTExpr bvconst(const llvm::APInt &);
+	SMTExpr bvvar(unsigned width, const char *name);
+
+	// If-else-then.
+	SMTExpr ite(SMTExpr, SMTExpr, SMTExpr);
+
+	// Comparison.
+	SMTExpr eq(SMTExpr, SMTExpr);
+	SMTExpr ne(SMTExpr, SMTExpr);
+	SMTExpr bvslt(SMTExpr, SMTExpr);
+	SMTExpr bvsle(SMTExpr, SMTExpr);
+	SMTExpr bvsgt(SMTExpr, SMTExpr);
+	SMTExpr bvsge(SMTExpr, SMTExpr);
+	SMTExpr bvult(SMTExpr, SMTExpr);
+	SMTExpr bvule(SMTExpr, SMTExpr);
+	SMTExpr bvugt(SMTExpr, SMTExpr);
+	SMTExpr bvuge(SMTExpr, SMTExpr);
+
+	SMTExpr extract(unsigned high, unsigned low, SMTExpr);
+	SMTExpr zero_extend(unsigned i, SMTExpr);
+	SMTExpr sign_extend(unsigned i, SMTExpr);
+
+	SMTExpr bvredand(SMTExpr);
+	SMTExpr bvredor(SMTExpr);
+	SMTExpr bvnot(SMTExpr);
+	SMTExpr bvneg(SMTExpr);
+
+	// Arithmetic operations.
+	SMTExpr bvadd(SMTExpr, SMTExpr);
+	SMTExpr bvsub(SMTExpr, SMTExpr);
+	SMTExpr bvmul(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv(SMTExpr, SMTExpr);
+	SMTExpr bvudiv(SMTExpr, SMTExpr);
+	SMTExpr bvsrem(SMTExpr, SMTExpr);
+	SMTExpr bvurem(SMTExpr, SMTExpr);
+	SMTExpr bvshl(SMTExpr, SMTExpr);
+	SMTExpr bvlshr(SMTExpr, SMTExpr);
+	SMTExpr bvashr(SMTExpr, SMTExpr);
+	SMTExpr bvand(SMTExpr, SMTExpr);
+	SMTExpr bvor(SMTExpr, SMTExpr);
+	SMTExpr bvxor(SMTExpr, SMTExpr);
+
+	// Overflow detection.
+	SMTExpr bvneg_overflow(SMTExpr);
+	SMTExpr bvsadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvuadd_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvssub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvusub_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsmul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvumul_overflow(SMTExpr, SMTExpr);
+	SMTExpr bvsdiv_overflow(SMTExpr, SMTExpr);
+
+private:
+	void constrain(SMTExpr);
+	SMTStatus solve(SMTExpr, SMTModel *);
+	SMTStatus solveText(const std::string &);
+};
+
+} // anonymous namespace
+
+namespace {
+
+// Interrupts Z3 when an armed query runs past its deadline.  One thread
+// per solver waits between queries, rather than one per query.
+class Watchdog {
+public:
+	Watchdog(Z3_context c_) : c(c_), Armed(false), Fired(false), Quit(false) {
+		pthread_mutex_init(&Lock, NULL);
+		pthread_cond_init(&Cond, NULL);
+		pthread_create(&Thread, NULL, run, this);
+	}
+
+	~Watchdog() {
+		pthread_mutex_lock(&Lock);
+		Quit = true;
+		pthread_cond_signal(&Cond);
+		pthread_mutex_unlock(&Lock);
+		pthread_join(Thread, NULL);
+		pthread_cond_destroy(&Cond);
+		pthread_mutex_destroy(&Lock);
+	}
+
+	void arm(unsigned ms) {
+		struct timeval now;
+		gettimeofday(&now, NULL);
+		uint64_t us = now.tv_usec + (uint64_t)ms * 1000;
+		pthread_mutex_lock(&Lock);
+		Deadline.tv_sec = now.tv_sec + us / 1000000;
+		Deadline.tv_nsec = us % 1000000 * 1000;
+		Armed = true;
+		Fired = false;
+		pthread_cond_signal(&Cond);
+		pthread_mutex_unlock(&Lock);
+	}
+
+	// Returns whether the query was interrupted.
+	bool disarm() {
+		pthread_mutex_lock(&Lock);
+		Armed = false;
+		bool F = Fired;
+		pthread_mutex_unlock(&Lock);
+		return F;
+	}
+
+private:
+	Z3_context c;
+	struct timespec Deadline;
+	pthread_t Thread;
+	pthread_mutex_t Lock;
+	pthread_cond_t Cond;
+	bool Armed, Fired, Quit;
+
+	static void *run(void *p) {
+		Watchdog *W = (Watchdog *)p;
+		pthread_mutex_lock(&W->Lock);
+		while (!W->Quit) {
+			if (!W->Armed) {
+				pthread_cond_wait(&W->Cond, &W->Lock);
+				continue;
+			}
+			if (pthread_cond_timedwait(&W->Cond, &W->Lock, &W->Deadline)
+			    == ETIMEDOUT && W->Armed) {
+				Z3_interrupt(W->c);
+				W->Fired = true;
+				W->Armed = false;
+			}
+		}
+		pthread_mutex_unlock(&W->Lock);
+		return NULL;
+	}
+};
+
+} // anonymous namespace
+
 struct SMTContextImpl {
 	Z3_context c;
 	Z3_ast bvfalse;
 	Z3_ast bvtrue;
+	Watchdog *Dog;		// for -smt-timeout, created on demand
 };
 
 #define imp ((SMTContextImpl *)ctx_)
@@ -32,8 +191,9 @@ static inline Z3_ast bool2bv_(SMTContextImpl *ctx_, Z3_ast e0) {
 #define bv2bool(x) bv2bool_(imp, x)
 #define bool2bv(x) bool2bv_(imp, x)
 
-SMTSolver::SMTSolver(bool modelgen) {
+Z3Solver::Z3Solver(bool modelgen) {
 	ctx_ = new SMTContextImpl;
+	imp->Dog = NULL;
 	Z3_config cfg = Z3_mk_config();
 	// Enable model construction.
 	if (modelgen)
@@ -46,28 +206,49 @@ SMTSolver::SMTSolver(bool modelgen) {
 	imp->bvtrue = Z3_mk_int(ctx, 1, sort);
 }
 
-SMTSolver::~SMTSolver() {
+Z3Solver::~Z3Solver() {
+	delete imp->Dog;
 	Z3_del_context(ctx);
 	delete imp;
 }
 
-void SMTSolver::assume(SMTExpr e_) {
+void Z3Solver::constrain(SMTExpr e_) {
 	Z3_assert_cnstr(ctx, bv2bool(e));
 }
 
-SMTStatus SMTSolver::query(SMTExpr e_, SMTModel *m_) {
+SMTStatus Z3Solver::solve(SMTExpr e_, SMTModel *m_) {
 	Z3_push(ctx);
 	Z3_assert_cnstr(ctx, bv2bool(e));
+	unsigned Timeout = timeout();
+	if (Timeout) {
+		if (!imp->Dog)
+			imp->Dog = new Watchdog(ctx);
+		imp->Dog->arm(Timeout);
+	}
 	Z3_lbool res = Z3_check_and_get_model(ctx, (Z3_model *)m_);
+	bool Interrupted = Timeout && imp->Dog->disarm();
 	Z3_pop(ctx, 1);
 	switch (res) {
-	default:         return SMT_UNDEF;
+	default:         return Interrupted ? SMT_TIMEOUT : SMT_UNDEF;
 	case Z3_L_FALSE: return SMT_UNSAT;
 	case Z3_L_TRUE:  return SMT_SAT;
 	}
 }
 
-void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &r) {
+SMTStatus Z3Solver::solveText(const std::string &Text) {
+	Z3_parse_smtlib_string(ctx, Text.c_str(), 0, NULL, NULL, 0, NULL, NULL);
+	unsigned n = Z3_get_smtlib_num_formulas(ctx);
+	if (n == 0)
+		return SMT_UNDEF;
+	Z3_ast f = Z3_get_smtlib_formula(ctx, 0);
+	for (unsigned i = 1; i < n; ++i) {
+		Z3_ast args[2] = { f, Z3_get_smtlib_formula(ctx, i) };
+		f = Z3_mk_and(ctx, 2, args);
+	}
+	return solve(bool2bv(f), NULL);
+}
+
+void Z3Solver::eval(SMTModel m_, SMTExpr e_, APInt &r) {
 	Z3_ast v = 0;
 	Z3_bool ret = Z3_model_eval(ctx, m, e, Z3_TRUE, &v);
 	assert(ret);
@@ -90,36 +271,38 @@ void SMTSolver::eval(SMTModel m_, SMTExpr e_, APInt &r) {
 	assert(0);
 }
 
-void SMTSolver::release(SMTModel m_) {
+void Z3Solver::release(SMTModel m_) {
 	Z3_del_model(ctx, m);
 }
 
-void SMTSolver::dump(SMTExpr e_) {
+void Z3Solver::dump(SMTExpr e_) {
 	print(e, dbgs());
 	dbgs() << "\n";
 }
 
-void SMTSolver::print(SMTExpr e_, raw_ostream &OS) {
-	OS << Z3_ast_to_string(ctx, Z3_simplify(ctx, e));
+// An SMT-LIB benchmark, as solveText() reads it.
+void Z3Solver::print(SMTExpr e_, raw_ostream &OS) {
+	OS << Z3_benchmark_to_smtlib_string(ctx, "query", "QF_BV", "unknown",
+	                                    "", 0, NULL, bv2bool(e));
 }
 
 // Managed by Z3, no reference counting.
-void SMTSolver::incref(SMTExpr) { }
-void SMTSolver::decref(SMTExpr) { }
+void Z3Solver::incref(SMTExpr) { }
+void Z3Solver::decref(SMTExpr) { }
 
-unsigned SMTSolver::bvwidth(SMTExpr e_) {
+unsigned Z3Solver::bvwidth(SMTExpr e_) {
 	return Z3_get_bv_sort_size(ctx, Z3_get_sort(ctx, e));
 }
 
-SMTExpr SMTSolver::bvfalse() {
+SMTExpr Z3Solver::bvfalse() {
 	return imp->bvfalse;
 }
 
-SMTExpr SMTSolver::bvtrue() {
+SMTExpr Z3Solver::bvtrue() {
 	return imp->bvtrue;
 }
 
-SMTExpr SMTSolver::bvconst(const APInt &Val) {
+SMTExpr Z3Solver::bvconst(const APInt &Val) {
 	unsigned width = Val.getBitWidth();
 	Z3_sort t = Z3_mk_bv_sort(ctx, width);
 	if (width <= 64)
@@ -129,171 +312,190 @@ SMTExpr SMTSolver::bvconst(const APInt &Val) {
 	return Z3_mk_numeral(ctx, s.c_str(), t);
 }
 
-SMTExpr SMTSolver::bvvar(unsigned width, const char *name) {
+SMTExpr Z3Solver::bvvar(unsigned width, const char *name) {
 	return Z3_mk_const(ctx, Z3_mk_string_symbol(ctx, name), Z3_mk_bv_sort(ctx, width));
 }
 
-SMTExpr SMTSolver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::ite(SMTExpr e_, SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_ite(ctx, bv2bool(e), lhs, rhs);
 }
 
-SMTExpr SMTSolver::eq(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::eq(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_eq(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::ne(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::ne(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvnot(eq(lhs_, rhs_));
 }
 
-SMTExpr SMTSolver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvslt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvslt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsle(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsle(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsgt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsgt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsge(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvsge(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvult(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvult(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvule(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvule(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvugt(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvugt(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvuge(SMTExpr lhs_, SMTExpr rhs_) {
 	return bool2bv(Z3_mk_bvuge(ctx, lhs, rhs));
 }
 
-SMTExpr SMTSolver::extract(unsigned high, unsigned low, SMTExpr e_) {
+SMTExpr Z3Solver::extract(unsigned high, unsigned low, SMTExpr e_) {
 	return Z3_mk_extract(ctx, high, low, e);
 }
 
-SMTExpr SMTSolver::zero_extend(unsigned i, SMTExpr e_) {
+SMTExpr Z3Solver::zero_extend(unsigned i, SMTExpr e_) {
 	return Z3_mk_zero_ext(ctx, i, e);
 }
 
-SMTExpr SMTSolver::sign_extend(unsigned i, SMTExpr e_) {
+SMTExpr Z3Solver::sign_extend(unsigned i, SMTExpr e_) {
 	return Z3_mk_sign_ext(ctx, i, e);
 }
 
-SMTExpr SMTSolver::bvredand(SMTExpr e_) {
+SMTExpr Z3Solver::bvredand(SMTExpr e_) {
 	return Z3_mk_bvredand(ctx, e);
 }
 
-SMTExpr SMTSolver::bvredor(SMTExpr e_) {
+SMTExpr Z3Solver::bvredor(SMTExpr e_) {
 	return Z3_mk_bvredor(ctx, e);
 }
 
-SMTExpr SMTSolver::bvnot(SMTExpr e_) {
+SMTExpr Z3Solver::bvnot(SMTExpr e_) {
 	return Z3_mk_bvnot(ctx, e);
 }
 
-SMTExpr SMTSolver::bvneg(SMTExpr e_) {
+SMTExpr Z3Solver::bvneg(SMTExpr e_) {
 	return Z3_mk_bvneg(ctx, e);
 }
 
-SMTExpr SMTSolver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvadd(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvadd(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsub(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsub(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvmul(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvmul(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsdiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsdiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvudiv(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvudiv(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsrem(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvsrem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvurem(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvurem(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvshl(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvshl(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvlshr(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvlshr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvashr(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvashr(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvand(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvand(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvor(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvxor(SMTExpr lhs_, SMTExpr rhs_) {
 	return Z3_mk_bvxor(ctx, lhs, rhs);
 }
 
-SMTExpr SMTSolver::bvneg_overflow(SMTExpr e_) {
+SMTExpr Z3Solver::bvneg_overflow(SMTExpr e_) {
 	return bvnot(bool2bv(Z3_mk_bvneg_no_overflow(ctx, e)));
 }
 
-SMTExpr SMTSolver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvor(
 		bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
 		bvnot(bool2bv(Z3_mk_bvadd_no_underflow(ctx, lhs, rhs)))
 	);
 }
 
-SMTExpr SMTSolver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvuadd_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvnot(bool2bv(Z3_mk_bvadd_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvssub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvor(
 		bvnot(bool2bv(Z3_mk_bvsub_no_overflow(ctx, lhs, rhs))),
 		bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_TRUE)))
 	);
 }
 
-SMTExpr SMTSolver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvusub_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvnot(bool2bv(Z3_mk_bvsub_no_underflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsmul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvor(
 		bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_TRUE))),
 		bvnot(bool2bv(Z3_mk_bvmul_no_underflow(ctx, lhs, rhs)))
 	);
 }
 
-SMTExpr SMTSolver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvumul_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvnot(bool2bv(Z3_mk_bvmul_no_overflow(ctx, lhs, rhs, Z3_FALSE)));
 }
 
-SMTExpr SMTSolver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
+SMTExpr Z3Solver::bvsdiv_overflow(SMTExpr lhs_, SMTExpr rhs_) {
 	return bvnot(bool2bv(Z3_mk_bvsdiv_no_overflow(ctx, lhs, rhs)));
 }
+
+static const char *name() {
+	static char Name[64];
+	if (!Name[0]) {
+		unsigned major, minor, build, revision;
+		Z3_get_version(&major, &minor, &build, &revision);
+		snprintf(Name, sizeof(Name), "z3-%u.%u.%u.%u",
+		         major, minor, build, revision);
+	}
+	return Name;
+}
+
+static SMTSolver *create(bool modelgen) {
+	return new Z3Solver(modelgen);
+}
+
+extern "C" const SMTPlugin kint_smt_plugin = {
+	SMT_PLUGIN_VERSION, name, create
+};
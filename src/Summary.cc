@@ -0,0 +1,312 @@
+#include <llvm/Constants.h>
+#include <llvm/Instructions.h>
+#include <llvm/Module.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/InstIterator.h>
+
+#include "Annotation.h"
+#include "Summary.h"
+
+using namespace llvm;
+
+// Nodes of a range expression before it is cut off as a full set.
+static const unsigned MaxRangeExpr = 64;
+
+static inline StringRef asString(MDNode *MD) {
+	if (MDString *S = dyn_cast_or_null<MDString>(MD->getOperand(0)))
+		return S->getString();
+	return "";
+}
+
+std::string SummaryWriter::getSite(CallInst *CI) {
+	std::pair<DenseMap<CallInst *, unsigned>::iterator, bool> R =
+		Sites.insert(std::make_pair(CI, (unsigned)Sites.size()));
+	return "@" + utostr(R.first->second);
+}
+
+// taint sources without a global ID get a module-local one
+std::string SummaryWriter::getTaintId(Instruction *I) {
+	std::string sID = getValueId(I);
+	if (!sID.empty() || !I->getMetadata(MD_TaintSrc))
+		return sID;
+	std::string &Local = SourceIDs[I];
+	if (Local.empty())
+		Local = "taint._" + sys::path::stem(M->getModuleIdentifier()).str()
+		        + "." + utostr(SourceIDs.size());
+	return Local;
+}
+
+void SummaryWriter::getFuncSources(Value *V, Tokens &Srcs) {
+	CallGraphPass::FuncSource Src;
+	CG->findSources(V, Src);
+	for (unsigned i = 0; i != Src.Funcs.size(); ++i)
+		Srcs.push_back("&" + getScopeName(Src.Funcs[i]));
+	for (unsigned i = 0; i != Src.IDs.size(); ++i)
+		Srcs.push_back(Ctx.IDs.str(Src.IDs[i]));
+}
+
+// IDs whose taint flows into V, as TaintPass propagates it
+void SummaryWriter::getTaintSources(Value *V, Tokens &Srcs) {
+	SmallPtrSet<Value *, 16> Visited;
+	SmallVector<Value *, 16> Worklist;
+	Worklist.push_back(V);
+	while (!Worklist.empty()) {
+		Value *V = Worklist.pop_back_val();
+		if (!(isa<Instruction>(V) || isa<Argument>(V)) || !Visited.insert(V))
+			continue;
+		Instruction *I = dyn_cast<Instruction>(V);
+		std::string sID = I ? getTaintId(I) : getValueId(V);
+		if (!sID.empty())
+			Srcs.push_back(sID);
+		if (CallInst *CI = dyn_cast<CallInst>(V)) {
+			// taint of all possible callees' return values
+			if (CI->isInlineAsm())
+				continue;
+			if (Function *CF = CI->getCalledFunction()) {
+				std::string RetID = getRetId(CF);
+				if (RetID != sID)
+					Srcs.push_back(RetID);
+			} else
+				Srcs.push_back(getSite(CI));
+			continue;
+		}
+		if (I)
+			for (unsigned i = 0; i < I->getNumOperands(); ++i)
+				Worklist.push_back(I->getOperand(i));
+	}
+}
+
+void SummaryWriter::writeFlow(StringRef Kind, StringRef Dst,
+                              const Tokens &Srcs) {
+	if (Dst.empty() || Srcs.empty())
+		return;
+	OS << Kind << " " << Dst;
+	for (unsigned i = 0; i != Srcs.size(); ++i)
+		OS << " " << Srcs[i];
+	OS << "\n";
+}
+
+void SummaryWriter::writeRange(const CRange &R) {
+	unsigned Width = R.getBitWidth();
+	if (R.isEmptySet())
+		OS << " e " << Width;
+	else if (R.isFullSet())
+		OS << " f " << Width;
+	else
+		OS << " k " << Width << " " << R.getLower().toString(10, false)
+		   << " " << R.getUpper().toString(10, false);
+}
+
+// The range of V as RangePass computes it, minus branch conditions.
+// Values on a cycle are unconstrained.
+void SummaryWriter::writeRange(Value *V, SmallPtrSet<Value *, 16> &OnStack,
+                               unsigned &Budget) {
+	unsigned Width = cast<IntegerType>(V->getType())->getBitWidth();
+	if (ConstantInt *C = dyn_cast<ConstantInt>(V))
+		return writeRange(CRange(C->getValue()));
+	if (!Budget || OnStack.count(V)) {
+		OS << " f " << Width;
+		return;
+	}
+	--Budget;
+
+	if (Argument *A = dyn_cast<Argument>(V)) {
+		OS << " g " << Width << " " << getArgId(A);
+		return;
+	}
+	Instruction *I = dyn_cast<Instruction>(V);
+	if (!I) {
+		OS << " e " << Width;
+		return;
+	}
+	if (isa<LoadInst>(I)) {
+		std::string sID = getValueId(I);
+		if (sID.empty())
+			OS << " e " << Width;
+		else
+			OS << " g " << Width << " " << sID;
+		return;
+	}
+	if (CallInst *CI = dyn_cast<CallInst>(I)) {
+		if (CI->isInlineAsm())
+			OS << " e " << Width;
+		else if (Function *CF = CI->getCalledFunction())
+			OS << " g " << Width << " " << getRetId(CF);
+		else
+			OS << " g " << Width << " " << getSite(CI);
+		return;
+	}
+
+	OnStack.insert(V);
+	if (BinaryOperator *BO = dyn_cast<BinaryOperator>(I)) {
+		OS << " " << BO->getOpcodeName();
+		writeRange(BO->getOperand(0), OnStack, Budget);
+		writeRange(BO->getOperand(1), OnStack, Budget);
+	} else if (CastInst *CI = dyn_cast<CastInst>(I)) {
+		switch (CI->getOpcode()) {
+		case CastInst::Trunc:
+		case CastInst::ZExt:
+		case CastInst::SExt:
+			OS << " " << CI->getOpcodeName() << " " << Width;
+			writeRange(CI->getOperand(0), OnStack, Budget);
+			break;
+		case CastInst::BitCast:
+			writeRange(CI->getOperand(0), OnStack, Budget);
+			break;
+		default:
+			OS << " f " << Width;
+			break;
+		}
+	} else if (SelectInst *SI = dyn_cast<SelectInst>(I)) {
+		OS << " u";
+		writeRange(SI->getTrueValue(), OnStack, Budget);
+		writeRange(SI->getFalseValue(), OnStack, Budget);
+	} else if (PHINode *PHI = dyn_cast<PHINode>(I)) {
+		unsigned n = PHI->getNumIncomingValues();
+		if (n == 0)
+			OS << " e " << Width;
+		for (unsigned i = 1; i < n; ++i)
+			OS << " u";
+		for (unsigned i = 0; i < n; ++i)
+			writeRange(PHI->getIncomingValue(i), OnStack, Budget);
+	} else {
+		OS << " f " << Width;
+	}
+	OnStack.erase(V);
+}
+
+void SummaryWriter::writeRange(StringRef Dst, Value *V) {
+	if (Dst.empty() || !V->getType()->isIntegerTy())
+		return;
+	SmallPtrSet<Value *, 16> OnStack;
+	unsigned Budget = MaxRangeExpr;
+	OS << "range " << Dst;
+	writeRange(V, OnStack, Budget);
+	OS << "\n";
+}
+
+void SummaryWriter::runOnCall(CallInst *CI) {
+	Function *CF = CI->getCalledFunction();
+	if (CI->isInlineAsm() || (CF && CF->isIntrinsic()))
+		return;
+
+	std::string Site;
+	if (!CF) {
+		Tokens Srcs;
+		getFuncSources(CI->getCalledValue(), Srcs);
+		Site = getSite(CI);
+		OS << "call " << Site;
+		for (unsigned i = 0; i != Srcs.size(); ++i)
+			OS << " " << Srcs[i];
+		OS << "\n";
+	}
+
+	// skip vaarg and builtin functions
+	bool Skip = CF && (CF->isVarArg()
+	                   || CF->getName().find('.') != StringRef::npos);
+	for (unsigned no = 0; no != CI->getNumArgOperands(); ++no) {
+		Value *V = CI->getArgOperand(no);
+		std::string Dst = CF ? getArgId(CF, no) : Site + "/" + utostr(no);
+		if (isFunctionPointer(V->getType())) {
+			Tokens Srcs;
+			getFuncSources(V, Srcs);
+			writeFlow("fp", Dst, Srcs);
+		}
+		if (Skip)
+			continue;
+		writeRange(Dst, V);
+		Tokens Srcs;
+		getTaintSources(V, Srcs);
+		writeFlow("taint", Dst, Srcs);
+	}
+
+	// the call site's own return ID, merged from all callees
+	if (!CF) {
+		writeRange(getRetId(CI), CI);
+		Tokens Srcs(1, Site);
+		writeFlow("taint", getRetId(CI), Srcs);
+	}
+}
+
+void SummaryWriter::runOnFunction(Function *F) {
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		Instruction *I = &*i;
+
+		if (MDNode *MD = I->getMetadata(MD_TaintSrc)) {
+			StringRef Desc = asString(MD);
+			OS << "source " << getTaintId(I) << " " << Desc << "\n";
+			// all struct members are tainted as well
+			if (PointerType *PTy = dyn_cast<PointerType>(I->getType()))
+				if (StructType *STy = dyn_cast<StructType>(PTy->getElementType()))
+					for (unsigned j = 0; j < STy->getNumElements(); ++j) {
+						std::string sID = getStructId(STy, M, j);
+						if (!sID.empty())
+							OS << "source " << sID << " " << Desc << "\n";
+					}
+		}
+
+		std::string Dst;
+		Value *V = NULL;
+		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
+			Dst = getValueId(SI);
+			V = SI->getValueOperand();
+		} else if (ReturnInst *RI = dyn_cast<ReturnInst>(I)) {
+			Dst = getRetId(F);
+			V = RI->getReturnValue();
+		} else if (CallInst *CI = dyn_cast<CallInst>(I)) {
+			runOnCall(CI);
+		}
+		if (Dst.empty() || !V)
+			continue;
+
+		Tokens Srcs;
+		if (isFunctionPointer(V->getType())) {
+			getFuncSources(V, Srcs);
+			writeFlow("fp", Dst, Srcs);
+			Srcs.clear();
+		}
+		writeRange(Dst, V);
+		// taint flows from all operands, as in TaintPass
+		for (unsigned j = 0; j < I->getNumOperands(); ++j)
+			getTaintSources(I->getOperand(j), Srcs);
+		writeFlow("taint", Dst, Srcs);
+	}
+}
+
+void SummaryWriter::run(Module *M_) {
+	M = M_;
+	// reuse the initializer handling of both passes on this module alone
+	CallGraphPass CGPass(&Ctx);
+	CGPass.doInitialization(M);
+	RangePass RPass(&Ctx);
+	RPass.doInitialization(M);
+	CG = &CGPass;
+
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i) {
+		bool Skip = i->isVarArg()
+		            || i->getName().find('.') != StringRef::npos;
+		OS << "func " << getScopeName(&*i) << " "
+		   << (i->isVarArg() ? "v" : Skip ? "b" : "-") << "\n";
+	}
+
+	for (FuncPtrMap::iterator i = Ctx.FuncPtrs.begin(),
+	     e = Ctx.FuncPtrs.end(); i != e; ++i) {
+		Tokens Srcs;
+		for (FuncSet::iterator j = i->second.begin(), je = i->second.end();
+		     j != je; ++j)
+			Srcs.push_back("&" + getScopeName(*j));
+		writeFlow("fp", i->first, Srcs);
+	}
+	for (RangeMap::iterator i = Ctx.IntRanges.begin(),
+	     e = Ctx.IntRanges.end(); i != e; ++i) {
+		OS << "range " << i->first;
+		writeRange(i->second);
+		OS << "\n";
+	}
+
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
+		if (!i->empty())
+			runOnFunction(&*i);
+	CG = NULL;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/raw_ostream.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "IntGlobal.h"
+
+// Per-module summary of the facts intglobal propagates across modules,
+// written by `intglobal -emit-summary` and solved by `intglobal -link`.
+//
+// One record per line, fields separated by spaces:
+//
+//   func   <scope> <flags>   function; flags: v (vararg), b (builtin), -
+//   call   <site> <src>...   possible callees of an indirect call site
+//   fp     <dst> <src>...    function pointers flow from <src> to <dst>
+//   taint  <dst> <src>...    taint flows from <src> to <dst>
+//   range  <dst> <expr>      range of <dst> includes <expr>
+//   source <ID> <desc>       taint source; <desc> extends to end of line
+//
+// A <dst> is a global ID, or @<n>/<no> for the no-th argument of all
+// callees of call site @<n>.  A <src> is a global ID, a call site @<n>
+// for the return values of its callees, or &<scope> for a function.
+// An <expr> is in prefix notation:
+//
+//   e <width> | f <width> | k <width> <lo> <hi>   empty, full, [lo, hi)
+//   g <width> <src>                               range of a global ID
+//   u <expr> <expr>                               union
+//   <binop> <expr> <expr>                         add, sub, mul, ...
+//   trunc|zext|sext <width> <expr>                casts
+
+class SummaryWriter {
+public:
+	SummaryWriter(llvm::raw_ostream &OS_) : OS(OS_) { }
+	void run(llvm::Module *);
+
+private:
+	llvm::raw_ostream &OS;
+	GlobalContext Ctx;
+	CallGraphPass *CG;
+	llvm::Module *M;
+	llvm::DenseMap<llvm::CallInst *, unsigned> Sites;
+	llvm::DenseMap<llvm::Instruction *, std::string> SourceIDs;
+
+	typedef std::vector<std::string> Tokens;
+
+	std::string getSite(llvm::CallInst *);
+	std::string getTaintId(llvm::Instruction *);
+	void getFuncSources(llvm::Value *, Tokens &);
+	void getTaintSources(llvm::Value *, Tokens &);
+	void writeFlow(llvm::StringRef Kind, llvm::StringRef Dst, const Tokens &);
+	void writeRange(llvm::StringRef Dst, llvm::Value *);
+	void writeRange(llvm::Value *, llvm::SmallPtrSet<llvm::Value *, 16> &,
+	                unsigned &Budget);
+	void writeRange(const CRange &);
+	void runOnCall(llvm::CallInst *);
+	void runOnFunction(llvm::Function *);
+};
+
+class SummaryLinker {
+public:
+	SummaryLinker(GlobalContext *Ctx_) : Ctx(Ctx_), MaxIterations(5) { }
+	// Add the records of a summary; a file with a bad record adds none.
+	bool read(llvm::StringRef Filename, std::string &Err);
+	void link();
+
+private:
+	GlobalContext *Ctx;
+	const unsigned MaxIterations;
+
+	typedef std::vector<std::string> Tokens;
+	struct Flow {
+		std::string Dst;
+		Tokens Srcs;
+	};
+	typedef std::set<unsigned> FuncIdxSet;
+
+	// functions by scope name, and whether arguments are skipped
+	std::map<std::string, unsigned> FuncIdx;
+	std::vector<std::string> FuncNames;
+	std::vector<bool> FuncSkip;
+
+	std::vector<Tokens> SiteSrcs;
+	std::vector<FuncIdxSet> SiteCallees;
+
+	std::vector<Flow> FuncPtrFlows, TaintFlows, RangeFlows;
+	std::map<std::string, FuncIdxSet> FuncPtrs;
+	std::set<std::string> Descs;
+	std::set<std::string> Changes;
+
+	unsigned getFunc(llvm::StringRef Scope);
+	void getDsts(const std::string &Dst, bool Skip, Tokens &Out);
+	void getRets(const std::string &Site, Tokens &Out);
+	bool resolve(const Tokens &Srcs, FuncIdxSet &S);
+	bool unionTaint(const std::string &ID, const DescSet &D);
+	bool unionRange(const std::string &ID, const CRange &R);
+	CRange getRange(unsigned Width, const std::string &Src);
+	CRange evalRange(const Tokens &Expr, unsigned &i);
+
+	void linkFuncPtrs();
+	void linkTaints();
+	void linkRanges();
+};
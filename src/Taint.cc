@@ -33,74 +33,101 @@ static inline MDString *toMDString(LLVMContext &VMCtx, DescSet *D) {
 	return MDString::get(VMCtx, s);
 }
 
+bool TaintPass::isTaintSource(const std::string &sID) {
+	return TM.isSource(sID);
+}
+
+uint32_t TaintPass::internTaint(const DescSet &D) {
+	std::map<DescSet, uint32_t>::iterator i = TaintSetIDs.find(D);
+	if (i != TaintSetIDs.end())
+		return i->second;
+	uint32_t T = TaintSets.size();
+	TaintSets.push_back(D);
+	TaintSetIDs.insert(std::make_pair(D, T));
+	return T;
+}
+
+uint32_t TaintPass::mergeTaint(uint32_t T, const DescSet &D) {
+	DescSet U = TaintSets[T];
+	size_t n = U.size();
+	U.insert(D.begin(), D.end());
+	if (U.size() == n)
+		return T;
+	return internTaint(U);
+}
+
 // Check both local taint and global sources
-DescSet * TaintPass::getTaint(Value *V) {
-	if (DescSet *DS = TM.get(V))
-		return DS;
-	if (DescSet *DS = TM.get(V->stripPointerCasts()))
-		return DS;
+uint32_t TaintPass::getTaint(TaintFunction &TF, uint32_t Slot) {
+	if (uint32_t T = TF.Taint[Slot])
+		return T;
+	if (uint32_t T = TF.Taint[TF.Strip[Slot]])
+		return T;
 	
 	// if value is not taint, check global taint.
-	// For call, taint if any possible callee could return taint
-	if (CallInst *CI = dyn_cast<CallInst>(V)) {
-		if (!CI->isInlineAsm() && Ctx->Callees.count(CI)) {
-			FuncSet &CEEs = Ctx->Callees[CI];
-			for (FuncSet::iterator i = CEEs.begin(), e = CEEs.end();
-				 i != e; ++i) {
-				if (DescSet *DS = TM.get(getRetId(*i)))
-					TM.add(CI, *DS);
-			}
-		}
+	// For call, taint if any possible callee could return taint;
+	// for arguments and loads, taint of their IDs
+	uint32_t T = 0;
+	for (uint32_t i = TF.GlobalBegin[Slot], e = TF.GlobalBegin[Slot + 1];
+		 i != e; ++i) {
+		if (DescSet *DS = TM.get(Ctx->IDs.str(TF.GlobalIDs[i])))
+			T = mergeTaint(T, *DS);
 	}
-	// For arguments and loads
-	if (DescSet *DS = TM.get(getValueId(V)))
-		TM.add(V, *DS);
-	return TM.get(V);
+	TF.Taint[Slot] = T;
+	return T;
 }
 
-bool TaintPass::isTaintSource(const std::string &sID) {
-	return TM.isSource(sID);
+bool TaintPass::markTaint(uint32_t ID, uint32_t T, bool isSource) {
+	// with -demand, only taint sources and demanded IDs are kept
+	if (!ID || (!isSource && !Ctx->isDemanded(Ctx->IDs.str(ID))))
+		return false;
+	return TM.add(Ctx->IDs.str(ID), TaintSets[T], isSource);
 }
 
-// find and mark taint source
-bool TaintPass::checkTaintSource(Instruction *I)
-{
-	Module *M = I->getParent()->getParent()->getParent();
-	bool changed = false;
+// Ops of a lowered function.  Slot i is the i-th instruction.
+enum {
+	T_Source,	// [T_Source, slot, desc, ID, #IDs, struct field ID...]
+	T_Call,		// [T_Call, #args, (arg slot, callee arg ID)...]
+	T_Inst,		// [T_Inst, slot, store/ret ID, #operands, operand slot...]
+};
 
-	if (MDNode *MD = I->getMetadata(MD_TaintSrc)) {
-		TM.add(I, asString(MD));
-		DescSet &D = *TM.get(I);
-		changed |= TM.add(getValueId(I), D, true);
-		// mark all struct members as taint
-		if (PointerType *PTy = dyn_cast<PointerType>(I->getType())) {
-			if (StructType *STy = dyn_cast<StructType>(PTy->getElementType())) {
-				for (unsigned i = 0; i < STy->getNumElements(); ++i)
-					changed |= TM.add(getStructId(STy, M, i), D, true);
-			}
-		}
-	}
-	return changed;
+static inline bool mayBeTainted(Value *V) {
+	return isa<Instruction>(V) || isa<Argument>(V);
 }
 
-// Propagate taint within a function
-bool TaintPass::runOnFunction(Function *F)
-{
-	bool changed = false;
+void TaintPass::lower(Function *F, TaintFunction &TF) {
+	Module *M = F->getParent();
+	FactBuilder B(TF);
+	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i)
+		B.slot(&*i);
 
 	for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
 		Instruction *I = &*i;
-		
+
 		// find and mark taint sources
-		changed |= checkTaintSource(I);
+		if (MDNode *MD = I->getMetadata(MD_TaintSrc)) {
+			B.emit(T_Source);
+			B.emit(B.slot(I));
+			B.emit(Descs.size());
+			Descs.push_back(asString(MD));
+			B.emit(Ctx->IDs.get(getValueId(I)));
+			// mark all struct members as taint
+			StructType *STy = NULL;
+			if (PointerType *PTy = dyn_cast<PointerType>(I->getType()))
+				STy = dyn_cast<StructType>(PTy->getElementType());
+			B.emit(STy ? STy->getNumElements() : 0);
+			for (unsigned j = 0; STy && j < STy->getNumElements(); ++j)
+				B.emit(Ctx->IDs.get(getStructId(STy, M, j)));
+		}
 
 		// for call instruction, propagate taint to arguments instead
 		// of from arguments
 		if (CallInst *CI = dyn_cast<CallInst>(I)) {
-			if (CI->isInlineAsm() || !Ctx->Callees.count(CI))
+			CalleeMap::iterator ci = Ctx->Callees.find(CI);
+			if (CI->isInlineAsm() || ci == Ctx->Callees.end())
 				continue;
 
-			FuncSet &CEEs = Ctx->Callees[CI];
+			SmallVector<std::pair<uint32_t, uint32_t>, 8> Args;
+			FuncSet &CEEs = ci->second;
 			for (FuncSet::iterator j = CEEs.begin(), je = CEEs.end();
 				 j != je; ++j) {
 				// skip vaarg and builtin functions
@@ -110,28 +137,106 @@ bool TaintPass::runOnFunction(Function *F)
 				
 				// mark corresponding args tainted on all possible callees
 				for (unsigned a = 0; a < CI->getNumArgOperands(); ++a) {
-					if (DescSet *DS = getTaint(CI->getArgOperand(a)))
-						changed |= TM.add(getArgId(*j, a), *DS);
+					Value *V = CI->getArgOperand(a);
+					if (mayBeTainted(V))
+						Args.push_back(std::make_pair(B.slot(V),
+							Ctx->IDs.get(getArgId(*j, a))));
 				}
 			}
+			B.emit(T_Call);
+			B.emit(Args.size());
+			for (unsigned j = 0; j != Args.size(); ++j) {
+				B.emit(Args[j].first);
+				B.emit(Args[j].second);
+			}
 			continue;
 		}
 
-		// check if any operand is taint
-		DescSet D;
+		// taint of any operand, propagated to value and global
+		SmallVector<uint32_t, 4> Ops;
 		for (unsigned j = 0; j < I->getNumOperands(); ++j)
-			if (DescSet *DS = getTaint(I->getOperand(j)))
-				D.insert(DS->begin(), DS->end());
-		if (D.empty())
+			if (mayBeTainted(I->getOperand(j)))
+				Ops.push_back(B.slot(I->getOperand(j)));
+		if (Ops.empty())
 			continue;
-
-		// propagate value and global taint
-		TM.add(I, D);
+		uint32_t ID = 0;
 		if (StoreInst *SI = dyn_cast<StoreInst>(I)) {
-			if (MDNode *ID = SI->getMetadata(MD_ID))
-				changed |= TM.add(asString(ID), D);
+			if (MDNode *MD = SI->getMetadata(MD_ID))
+				ID = Ctx->IDs.get(asString(MD));
 		} else if (isa<ReturnInst>(I)) {
-			changed |= TM.add(getRetId(F), D);
+			ID = Ctx->IDs.get(getRetId(F));
+		}
+		B.emit(T_Inst);
+		B.emit(B.slot(I));
+		B.emit(ID);
+		B.emit(Ops.size());
+		TF.Ops.insert(TF.Ops.end(), Ops.begin(), Ops.end());
+	}
+
+	// where to look for global taint of each slot
+	unsigned n = TF.Slots.size();
+	TF.Strip.resize(n);
+	TF.GlobalBegin.resize(n + 1);
+	TF.Taint.assign(n, 0);
+	for (unsigned i = 0; i != n; ++i) {
+		Value *V = TF.Slots[i];
+		Value *SV = V->stripPointerCasts();
+		TF.Strip[i] = B.hasSlot(SV) ? B.slot(SV) : i;
+		TF.GlobalBegin[i] = TF.GlobalIDs.size();
+		if (CallInst *CI = dyn_cast<CallInst>(V)) {
+			CalleeMap::iterator ci = Ctx->Callees.find(CI);
+			if (!CI->isInlineAsm() && ci != Ctx->Callees.end()) {
+				FuncSet &CEEs = ci->second;
+				for (FuncSet::iterator j = CEEs.begin(), je = CEEs.end();
+					 j != je; ++j)
+					TF.GlobalIDs.push_back(Ctx->IDs.get(getRetId(*j)));
+			}
+		}
+		if (uint32_t ID = Ctx->IDs.get(getValueId(V)))
+			TF.GlobalIDs.push_back(ID);
+	}
+	TF.GlobalBegin[n] = TF.GlobalIDs.size();
+}
+
+// Propagate taint within a function
+bool TaintPass::runOnFacts(TaintFunction &TF)
+{
+	bool changed = false;
+	const std::vector<uint32_t> &Ops = TF.Ops;
+
+	for (unsigned i = 0, n = Ops.size(); i < n; ) {
+		switch (Ops[i++]) {
+		case T_Source: {
+			uint32_t Slot = Ops[i++];
+			DescSet D;
+			D.insert(Descs[Ops[i++]]);
+			uint32_t T = TF.Taint[Slot] = mergeTaint(TF.Taint[Slot], D);
+			changed |= markTaint(Ops[i++], T, true);
+			for (unsigned k = Ops[i++]; k; --k)
+				changed |= markTaint(Ops[i++], T, true);
+			break;
+		}
+		case T_Call:
+			for (unsigned k = Ops[i++]; k; --k, i += 2)
+				if (uint32_t T = getTaint(TF, Ops[i]))
+					changed |= markTaint(Ops[i + 1], T);
+			break;
+		case T_Inst: {
+			uint32_t Slot = Ops[i++], ID = Ops[i++];
+			uint32_t T = 0;
+			for (unsigned k = Ops[i++]; k; --k) {
+				uint32_t OT = getTaint(TF, Ops[i++]);
+				if (OT && OT != T)
+					T = T ? mergeTaint(T, DescSet(TaintSets[OT])) : OT;
+			}
+			if (!T)
+				break;
+			TF.Taint[Slot] = mergeTaint(TF.Taint[Slot], DescSet(TaintSets[T]));
+			changed |= markTaint(ID, T);
+			break;
+		}
+		default:
+			llvm_unreachable("Unknown taint op!");
 		}
 	}
 	return changed;
@@ -142,25 +247,45 @@ bool TaintPass::doFinalization(Module *M) {
 	LLVMContext &VMCtx = M->getContext();
 	for (Module::iterator f = M->begin(), fe = M->end(); f != fe; ++f) {
 		Function *F = &*f;
-		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e; ++i) {
+		FactMap::iterator it = Facts.find(F);
+		if (it == Facts.end())
+			continue;
+		TaintFunction &TF = it->second;
+		uint32_t Slot = 0;
+		for (inst_iterator i = inst_begin(F), e = inst_end(F); i != e;
+			 ++i, ++Slot) {
 			Instruction *I = &*i;
-			if (DescSet *DS = getTaint(I)) {
-				MDNode *MD = MDNode::get(VMCtx, toMDString(VMCtx, DS));
+			if (uint32_t T = getTaint(TF, Slot)) {
+				MDNode *MD = MDNode::get(VMCtx, toMDString(VMCtx, &TaintSets[T]));
 				I->setMetadata(MD_Taint, MD);
 			} else
 				I->setMetadata(MD_Taint, NULL);
 		}
+		Facts.erase(it);
 	}
 	return true;
 }
 
 bool TaintPass::doModulePass(Module *M) {
+	// lower functions on first visit
+	std::vector<TaintFunction *> TFs;
+	for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i) {
+		if (i->empty())
+			continue;
+		FactMap::iterator it = Facts.find(&*i);
+		if (it == Facts.end()) {
+			it = Facts.insert(std::make_pair(&*i, TaintFunction())).first;
+			lower(&*i, it->second);
+		}
+		TFs.push_back(&it->second);
+	}
+
 	bool changed = true, ret = false;
 
 	while (changed) {
 		changed = false;
-		for (Module::iterator i = M->begin(), e = M->end(); i != e; ++i)
-			changed |= runOnFunction(&*i);
+		for (unsigned i = 0; i != TFs.size(); ++i)
+			changed |= runOnFacts(*TFs[i]);
 		ret |= changed;
 	}
 	return ret;
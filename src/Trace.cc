@@ -0,0 +1,117 @@
+#include "Trace.h"
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/Support/CommandLine.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+using namespace llvm;
+
+static cl::opt<std::string>
+TraceFile("trace", cl::desc("Append a timeline in trace-event JSON"),
+          cl::value_desc("filename"));
+
+static int TraceFD = -1;
+
+static void openTrace() {
+	static bool Opened;
+	if (Opened)
+		return;
+	Opened = true;
+	const char *Path = TraceFile.c_str();
+	// whoever creates the file starts the event array
+	TraceFD = open(Path, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0644);
+	if (TraceFD >= 0) {
+		if (write(TraceFD, "[\n", 2) != 2)
+			perror(Path);
+		return;
+	}
+	TraceFD = open(Path, O_WRONLY | O_APPEND);
+	if (TraceFD < 0)
+		perror(Path);
+}
+
+static uint64_t now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// -smt-threads solves queries on other threads of the process.
+static int threadID() {
+#ifdef SYS_gettid
+	return syscall(SYS_gettid);
+#else
+	return getpid();
+#endif
+}
+
+static void appendString(std::string &S, StringRef Str) {
+	S += '"';
+	for (StringRef::iterator i = Str.begin(), e = Str.end(); i != e; ++i) {
+		unsigned char c = *i;
+		if (c == '"' || c == '\\') {
+			S += '\\';
+			S += c;
+		} else if (c < 0x20) {
+			S += "\\u00";
+			S += hexdigit(c >> 4, true);
+			S += hexdigit(c & 0xf, true);
+		} else
+			S += c;
+	}
+	S += '"';
+}
+
+bool TraceSpan::enabled() {
+	if (TraceFile.empty())
+		return false;
+	openTrace();
+	return TraceFD >= 0;
+}
+
+TraceSpan::TraceSpan(const char *Name_, const char *Cat_)
+	: Name(Name_), Cat(Cat_), Start(enabled() ? now() : 0), Pid(getpid())
+{ }
+
+void TraceSpan::arg(const char *Key, StringRef Val) {
+	if (!Start)
+		return;
+	if (!Args.empty())
+		Args += ',';
+	appendString(Args, Key);
+	Args += ':';
+	appendString(Args, Val);
+}
+
+void TraceSpan::arg(const char *Key, int64_t Val) {
+	if (!Start)
+		return;
+	if (!Args.empty())
+		Args += ',';
+	appendString(Args, Key);
+	Args += ':';
+	Args += itostr(Val);
+}
+
+// The closing bracket is left out, which viewers accept.
+TraceSpan::~TraceSpan() {
+	if (!Start || getpid() != Pid)
+		return;
+	uint64_t End = now();
+	std::string S = "{\"name\":";
+	appendString(S, Name);
+	S += ",\"cat\":";
+	appendString(S, Cat);
+	S += ",\"ph\":\"X\",\"ts\":" + utostr(Start)
+	     + ",\"dur\":" + utostr(End - Start)
+	     + ",\"pid\":" + itostr(Pid)
+	     + ",\"tid\":" + itostr(threadID())
+	     + ",\"args\":{" + Args + "}},\n";
+	if (write(TraceFD, S.data(), S.size()) != (ssize_t)S.size())
+		perror(TraceFile.c_str());
+}
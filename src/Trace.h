@@ -0,0 +1,32 @@
+#pragma once
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/DataTypes.h>
+#include <string>
+
+// Timeline tracing (-trace=<file>) in Chrome's trace-event JSON format,
+// for chrome://tracing or Perfetto.
+//
+// The file is appended to, one complete event per write, so that all
+// processes of a pintck run, including forked queries, share one
+// timeline; remove it before a new run.
+
+class TraceSpan {
+public:
+	TraceSpan(const char *Name, const char *Cat);
+	~TraceSpan();
+
+	static bool enabled();
+
+	void arg(const char *Key, llvm::StringRef Val);
+	void arg(const char *Key, int64_t Val);
+
+private:
+	const char *Name, *Cat;
+	uint64_t Start;		// 0 if tracing is off
+	int Pid;		// spans do not end in forked children
+	std::string Args;
+
+	TraceSpan(const TraceSpan &);
+	void operator=(const TraceSpan &);
+};
@@ -1,28 +1,33 @@
+#define DEBUG_TYPE "value-gen"
 #include "ValueGen.h"
 #include <llvm/Constants.h>
 #include <llvm/InstVisitor.h>
 #include <llvm/IntrinsicInst.h>
 #include <llvm/Operator.h>
 #include <llvm/ADT/APInt.h>
+#include <llvm/ADT/Statistic.h>
 #include <llvm/Assembly/Writer.h>
 #include <llvm/Support/GetElementPtrTypeIterator.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Support/raw_ostream.h>
 #include <assert.h>
 
 using namespace llvm;
 
-static void addRangeConstraints(SMTSolver &, SMTExpr, MDNode *);
+STATISTIC(NumValueIters, "Number of values in unrolled loops");
+
+static void addRangeConstraints(SMTDag &, SMTNode *, MDNode *);
 
 namespace {
 
-#define SMT    VG.SMT
+#define DAG    VG.DAG
 #define TD     VG.TD
 
-struct ValueVisitor : InstVisitor<ValueVisitor, SMTExpr> {
-	ValueVisitor(ValueGen &VG)
-		: VG(VG) {}
+struct ValueVisitor : InstVisitor<ValueVisitor, SMTNode *> {
+	ValueVisitor(ValueGen &VG, BasicBlock *BB = NULL, unsigned Iter = 0)
+		: VG(VG), BB(BB), Iter(Iter) {}
 
-	SMTExpr analyze(Value *V) {
+	SMTNode *analyze(Value *V) {
 		if (!ValueGen::isAnalyzable(V)) {
 			V->dump();
 			assert(0 && "Unknown type!");
@@ -34,93 +39,93 @@ struct ValueVisitor : InstVisitor<ValueVisitor, SMTExpr> {
 		return mk_fresh(V);
 	}
 
-	SMTExpr visitInstruction(Instruction &I) {
-		SMTExpr E = mk_fresh(&I);
+	SMTNode *visitInstruction(Instruction &I) {
+		SMTNode *E = mk_fresh(&I);
 		// Ranges are constants, so don't worry about recursion.
 		if (MDNode *MD = I.getMetadata("intrange"))
-			addRangeConstraints(SMT, E, MD);
+			addRangeConstraints(DAG, E, MD);
 		return E;
 	}
 
-	SMTExpr visitConstant(Constant *C) {
+	SMTNode *visitConstant(Constant *C) {
 		if (ConstantInt *CI = dyn_cast<ConstantInt>(C))
-			return SMT.bvconst(CI->getValue());
+			return DAG.bvconst(CI->getValue());
 		if (isa<ConstantPointerNull>(C))
-			return SMT.bvconst(APInt::getNullValue(getBitWidth(C)));
+			return DAG.bvconst(APInt::getNullValue(getBitWidth(C)));
 		if (GEPOperator *GEP = dyn_cast<GEPOperator>(C))
 			return visitGEPOperator(*GEP);
 		return mk_fresh(C);
 	}
 
-	SMTExpr visitTruncInst(TruncInst &I) {
+	SMTNode *visitTruncInst(TruncInst &I) {
 		unsigned DstWidth = getBitWidth(I.getDestTy());
-		return SMT.extract(DstWidth - 1, 0, get(I.getOperand(0)));
+		return DAG.extract(DstWidth - 1, 0, get(I.getOperand(0)));
 	}
 
-	SMTExpr visitZExtInst(ZExtInst &I) {
+	SMTNode *visitZExtInst(ZExtInst &I) {
 		unsigned DstWidth = getBitWidth(I.getDestTy());
 		unsigned SrcWidth = getBitWidth(I.getSrcTy());
-		return SMT.zero_extend(DstWidth - SrcWidth, get(I.getOperand(0)));
+		return DAG.zero_extend(DstWidth - SrcWidth, get(I.getOperand(0)));
 	}
 
-	SMTExpr visitSExtInst(SExtInst &I) {
+	SMTNode *visitSExtInst(SExtInst &I) {
 		unsigned DstWidth = getBitWidth(I.getDestTy());
 		unsigned SrcWidth = getBitWidth(I.getSrcTy());
-		return SMT.sign_extend(DstWidth - SrcWidth, get(I.getOperand(0)));
+		return DAG.sign_extend(DstWidth - SrcWidth, get(I.getOperand(0)));
 	}
 
-	SMTExpr visitBinaryOperator(BinaryOperator &I) {
-		SMTExpr L = get(I.getOperand(0)), R = get(I.getOperand(1));
+	SMTNode *visitBinaryOperator(BinaryOperator &I) {
+		SMTNode *L = get(I.getOperand(0)), *R = get(I.getOperand(1));
 		switch (I.getOpcode()) {
 		default: assert(0);
-		case Instruction::Add:  return SMT.bvadd(L, R);
-		case Instruction::Sub:  return SMT.bvsub(L, R);
-		case Instruction::Mul:  return SMT.bvmul(L, R);
-		case Instruction::UDiv: return SMT.bvudiv(L, R);
-		case Instruction::SDiv: return SMT.bvsdiv(L, R);
-		case Instruction::URem: return SMT.bvurem(L, R);
-		case Instruction::SRem: return SMT.bvsrem(L, R);
-		case Instruction::Shl:  return SMT.bvshl(L, R);
-		case Instruction::LShr: return SMT.bvlshr(L, R);
-		case Instruction::AShr: return SMT.bvashr(L, R);
-		case Instruction::And:  return SMT.bvand(L, R);
-		case Instruction::Or:   return SMT.bvor(L, R);
-		case Instruction::Xor:  return SMT.bvxor(L, R);
+		case Instruction::Add:  return DAG.bvadd(L, R);
+		case Instruction::Sub:  return DAG.bvsub(L, R);
+		case Instruction::Mul:  return DAG.bvmul(L, R);
+		case Instruction::UDiv: return DAG.bvudiv(L, R);
+		case Instruction::SDiv: return DAG.bvsdiv(L, R);
+		case Instruction::URem: return DAG.bvurem(L, R);
+		case Instruction::SRem: return DAG.bvsrem(L, R);
+		case Instruction::Shl:  return DAG.bvshl(L, R);
+		case Instruction::LShr: return DAG.bvlshr(L, R);
+		case Instruction::AShr: return DAG.bvashr(L, R);
+		case Instruction::And:  return DAG.bvand(L, R);
+		case Instruction::Or:   return DAG.bvor(L, R);
+		case Instruction::Xor:  return DAG.bvxor(L, R);
 		}
 	}
 
-	SMTExpr visitICmpInst(ICmpInst &I) {
-		SMTExpr L = get(I.getOperand(0)), R = get(I.getOperand(1));
+	SMTNode *visitICmpInst(ICmpInst &I) {
+		SMTNode *L = get(I.getOperand(0)), *R = get(I.getOperand(1));
 		switch (I.getPredicate()) {
 		default: assert(0);
-		case CmpInst::ICMP_EQ:  return SMT.eq(L, R); break;
-		case CmpInst::ICMP_NE:  return SMT.ne(L, R); break;
-		case CmpInst::ICMP_SGE: return SMT.bvsge(L, R); break;
-		case CmpInst::ICMP_SGT: return SMT.bvsgt(L, R); break;
-		case CmpInst::ICMP_SLE: return SMT.bvsle(L, R); break;
-		case CmpInst::ICMP_SLT: return SMT.bvslt(L, R); break;
-		case CmpInst::ICMP_UGE: return SMT.bvuge(L, R); break;
-		case CmpInst::ICMP_UGT: return SMT.bvugt(L, R); break;
-		case CmpInst::ICMP_ULE: return SMT.bvule(L, R); break;
-		case CmpInst::ICMP_ULT: return SMT.bvult(L, R); break;
+		case CmpInst::ICMP_EQ:  return DAG.eq(L, R); break;
+		case CmpInst::ICMP_NE:  return DAG.ne(L, R); break;
+		case CmpInst::ICMP_SGE: return DAG.bvsge(L, R); break;
+		case CmpInst::ICMP_SGT: return DAG.bvsgt(L, R); break;
+		case CmpInst::ICMP_SLE: return DAG.bvsle(L, R); break;
+		case CmpInst::ICMP_SLT: return DAG.bvslt(L, R); break;
+		case CmpInst::ICMP_UGE: return DAG.bvuge(L, R); break;
+		case CmpInst::ICMP_UGT: return DAG.bvugt(L, R); break;
+		case CmpInst::ICMP_ULE: return DAG.bvule(L, R); break;
+		case CmpInst::ICMP_ULT: return DAG.bvult(L, R); break;
 		}
 	}
 
-	SMTExpr visitSelectInst(SelectInst &I) {
-		return SMT.ite(
+	SMTNode *visitSelectInst(SelectInst &I) {
+		return DAG.ite(
 			get(I.getCondition()),
 			get(I.getTrueValue()),
 			get(I.getFalseValue())
 		);
 	}
 
-	SMTExpr visitExtractValueInst(ExtractValueInst &I) {
+	SMTNode *visitExtractValueInst(ExtractValueInst &I) {
 		IntrinsicInst *II = dyn_cast<IntrinsicInst>(I.getAggregateOperand());
 		if (!II || II->getCalledFunction()->getName().find(".with.overflow.")
 				== StringRef::npos)
 			return mk_fresh(&I);
-		SMTExpr L = get(II->getArgOperand(0));
-		SMTExpr R = get(II->getArgOperand(1));
+		SMTNode *L = get(II->getArgOperand(0));
+		SMTNode *R = get(II->getArgOperand(1));
 		assert(I.getNumIndices() == 1);
 		switch (I.getIndices()[0]) {
 		default: II->dump(); assert(0 && "Unknown overflow!");
@@ -129,45 +134,43 @@ struct ValueVisitor : InstVisitor<ValueVisitor, SMTExpr> {
 			default: II->dump(); assert(0 && "Unknown overflow!");
 			case Intrinsic::sadd_with_overflow:
 			case Intrinsic::uadd_with_overflow:
-				return SMT.bvadd(L, R);
+				return DAG.bvadd(L, R);
 			case Intrinsic::ssub_with_overflow:
 			case Intrinsic::usub_with_overflow:
-				return SMT.bvsub(L, R);
+				return DAG.bvsub(L, R);
 			case Intrinsic::smul_with_overflow:
 			case Intrinsic::umul_with_overflow:
-				return SMT.bvmul(L, R);
+				return DAG.bvmul(L, R);
 			}
 		case 1:
 			switch (II->getIntrinsicID()) {
 			default: II->dump(); assert(0 && "Unknown overflow!");
 			case Intrinsic::sadd_with_overflow:
-				return SMT.bvsadd_overflow(L, R);
+				return DAG.bvsadd_overflow(L, R);
 			case Intrinsic::uadd_with_overflow:
-				return SMT.bvuadd_overflow(L, R);
+				return DAG.bvuadd_overflow(L, R);
 			case Intrinsic::ssub_with_overflow:
-				return SMT.bvssub_overflow(L, R);
+				return DAG.bvssub_overflow(L, R);
 			case Intrinsic::usub_with_overflow:
-				return SMT.bvusub_overflow(L, R);
+				return DAG.bvusub_overflow(L, R);
 			case Intrinsic::smul_with_overflow:
-				return SMT.bvsmul_overflow(L, R);
+				return DAG.bvsmul_overflow(L, R);
 			case Intrinsic::umul_with_overflow:
-				return SMT.bvumul_overflow(L, R);
+				return DAG.bvumul_overflow(L, R);
 			}
 		}
 		assert(I.getIndices()[0] == 1 && "FIXME!");
 
 	}
 
-	SMTExpr visitGetElementPtrInst(GetElementPtrInst &I) {
+	SMTNode *visitGetElementPtrInst(GetElementPtrInst &I) {
 		return visitGEPOperator(cast<GEPOperator>(I));
 	}
 
-	SMTExpr visitGEPOperator(GEPOperator &GEP) {
+	SMTNode *visitGEPOperator(GEPOperator &GEP) {
 		unsigned PtrSize = TD.getPointerSizeInBits(/*GEP.getPointerAddressSpace()*/);
 		// Start from base.
-		SMTExpr Offset = get(GEP.getPointerOperand());
-		// Increase refcnt.
-		SMT.incref(Offset);
+		SMTNode *Offset = get(GEP.getPointerOperand());
 		APInt ConstOffset = APInt::getNullValue(PtrSize);
 
 		gep_type_iterator GTI = gep_type_begin(GEP);
@@ -192,69 +195,51 @@ struct ValueVisitor : InstVisitor<ValueVisitor, SMTExpr> {
 				ConstOffset += ElemSize * C->getValue().sextOrTrunc(PtrSize);
 				continue;
 			}
-			SMTExpr SIdx = get(V);
-			unsigned IdxSize = SMT.bvwidth(SIdx);
+			SMTNode *SIdx = get(V);
+			unsigned IdxSize = DAG.bvwidth(SIdx);
 			// Sometimes a 64-bit GEP's index is 32-bit.
-			if (IdxSize != PtrSize) {
-				SMTExpr Tmp;
-				if (IdxSize < PtrSize)
-					Tmp = SMT.sign_extend(PtrSize - IdxSize, SIdx);
-				else
-					Tmp = SMT.extract(PtrSize - 1, 0, SIdx);
-				SIdx = Tmp;
-			} else {
-				SMT.incref(SIdx);
-			}
-			SMTExpr SElemSize = SMT.bvconst(ElemSize);
-			SMTExpr LocalOffset = SMT.bvmul(SIdx, SElemSize);
-			SMTExpr Tmp = SMT.bvadd(Offset, LocalOffset);
-			SMT.decref(SIdx);
-			SMT.decref(SElemSize);
-			SMT.decref(Offset);
-			SMT.decref(LocalOffset);
-			Offset = Tmp;
+			if (IdxSize < PtrSize)
+				SIdx = DAG.sign_extend(PtrSize - IdxSize, SIdx);
+			else if (IdxSize > PtrSize)
+				SIdx = DAG.extract(PtrSize - 1, 0, SIdx);
+			SMTNode *LocalOffset = DAG.bvmul(SIdx, DAG.bvconst(ElemSize));
+			Offset = DAG.bvadd(Offset, LocalOffset);
 		}
 
-		if (!ConstOffset)
-			return Offset;
-
 		// Merge constant offset.
-		SMTExpr SConstOffset = SMT.bvconst(ConstOffset);
-		SMTExpr Tmp = SMT.bvadd(Offset, SConstOffset);
-		SMT.decref(Offset);
-		SMT.decref(SConstOffset);
-		return Tmp;
+		return DAG.bvadd(Offset, DAG.bvconst(ConstOffset));
 	}
 
-	SMTExpr visitBitCastInst(BitCastInst &I) {
+	SMTNode *visitBitCastInst(BitCastInst &I) {
 		Value *V = I.getOperand(0);
 		// V can be floating point.
 		if (!VG.isAnalyzable(V))
 			return mk_fresh(&I);
-		SMTExpr E = get(V);
-		SMT.incref(E);
-		return E;
+		return get(V);
 	}
 
-	SMTExpr visitPtrToIntInst(PtrToIntInst &I) {
+	SMTNode *visitPtrToIntInst(PtrToIntInst &I) {
 		Value *V = I.getOperand(0);
-		SMTExpr E = get(V);
+		SMTNode *E = get(V);
 		unsigned PtrSize = getBitWidth(V);
 		unsigned IntSize = getBitWidth(&I);
 		if (IntSize > PtrSize)
-			return SMT.zero_extend(IntSize - PtrSize, E);
+			return DAG.zero_extend(IntSize - PtrSize, E);
 		if (IntSize < PtrSize)
-			return SMT.extract(IntSize - 1, 0, E);
+			return DAG.extract(IntSize - 1, 0, E);
 		// IntSize == PtrSize.
-		SMT.incref(E);
 		return E;
 	}
 
 private:
 	ValueGen &VG;
+	// Block and iteration of the instance being built, if in an
+	// unrolled loop.
+	BasicBlock *BB;
+	unsigned Iter;
 
-	SMTExpr get(Value *V) {
-		return VG.get(V);
+	SMTNode *get(Value *V) {
+		return VG.get(V, BB, Iter);
 	}
 
 	unsigned getBitWidth(Type *T) const {
@@ -265,31 +250,28 @@ private:
 		return getBitWidth(V->getType());
 	}
 
-	SMTExpr mk_fresh(Value *V) {
+	SMTNode *mk_fresh(Value *V) {
 		std::string Name;
 		{
 			raw_string_ostream OS(Name);
 			WriteAsOperand(OS, V, false);
 			// Make name unique, e.g., undef.
 			OS << "@" << V;
+			if (Iter)
+				OS << "#" << Iter;
 		}
-		return SMT.bvvar(getBitWidth(V), Name.c_str());
+		return DAG.bvvar(getBitWidth(V), Name.c_str());
 	}
 
 };
 
-#undef SMT
+#undef DAG
 #undef TD
 
 } // anonymous namespace
 
 ValueGen::ValueGen(DataLayout &TD, SMTSolver &SMT)
-	: TD(TD), SMT(SMT) {}
-
-ValueGen::~ValueGen() {
-	for (iterator i = Cache.begin(), e = Cache.end(); i != e; ++i)
-		SMT.decref(i->second);
-}
+	: TD(TD), DAG(SMT), Unroll(0) {}
 
 bool ValueGen::isAnalyzable(Value *V) {
 	return isAnalyzable(V->getType());
@@ -301,20 +283,63 @@ bool ValueGen::isAnalyzable(Type *T) {
 		|| T->isFunctionTy();
 }
 
-SMTExpr ValueGen::get(Value *V) {
+SMTNode *ValueGen::get(Value *V) {
 	// Don't use something like
-	//   SMTExpr &E = ValueCache[S]
+	//   SMTNode *&E = ValueCache[S]
 	// to update (S, E).  During visit the location may become invalid.
-	SMTExpr E = Cache.lookup(V);
+	SMTNode *E = Cache.lookup(V);
 	if (!E) {
-		E = ValueVisitor(*this).analyze(V);
+		if (BasicBlock *Header = getLoop(V)) {
+			// Select the instance of the exit iteration.
+			BasicBlock *BB = cast<Instruction>(V)->getParent();
+			SMTNode *N = exitIter(Header);
+			E = get(V, BB, 0);
+			for (unsigned i = 1; i != Unroll; ++i) {
+				SMTNode *C = DAG.eq(N, DAG.bvconst(APInt(N->Width, i)));
+				E = DAG.ite(C, get(V, BB, i), E);
+			}
+		} else {
+			E = ValueVisitor(*this).analyze(V);
+		}
 		Cache[V] = E;
 	}
 	assert(E);
 	return E;
 }
 
-void addRangeConstraints(SMTSolver &SMT, SMTExpr E, MDNode *MD) {
+SMTNode *ValueGen::get(Value *V, BasicBlock *BB, unsigned Iter) {
+	BasicBlock *Header = getLoop(V);
+	if (!Header || !BB || Loops.lookup(BB) != Header)
+		return get(V);
+	ValueIter Key(V, Iter);
+	SMTNode *E = Iters.lookup(Key);
+	if (!E) {
+		BasicBlock *DefBB = cast<Instruction>(V)->getParent();
+		E = ValueVisitor(*this, DefBB, Iter).analyze(V);
+		Iters[Key] = E;
+		++NumValueIters;
+	}
+	return E;
+}
+
+SMTNode *ValueGen::exitIter(BasicBlock *Header) {
+	std::string Name;
+	{
+		raw_string_ostream OS(Name);
+		OS << "exit@" << Header;
+	}
+	return DAG.bvvar(std::max(Log2_32_Ceil(Unroll), 1U), Name.c_str());
+}
+
+BasicBlock *ValueGen::getLoop(Value *V) {
+	if (Loops.empty())
+		return NULL;
+	if (Instruction *I = dyn_cast<Instruction>(V))
+		return Loops.lookup(I->getParent());
+	return NULL;
+}
+
+void addRangeConstraints(SMTDag &DAG, SMTNode *E, MDNode *MD) {
 	// !range comes in pairs.
 	unsigned n = MD->getNumOperands();
 	assert(n % 2 == 0);
@@ -324,33 +349,24 @@ void addRangeConstraints(SMTSolver &SMT, SMTExpr E, MDNode *MD) {
 		// Ignore empty or full set.
 		if (Lo == Hi)
 			continue;
-		SMTExpr Cmp0 = NULL, Cmp1 = NULL, Cond;
+		SMTNode *Cmp0 = NULL, *Cmp1 = NULL, *Cond;
 		// Ignore >= 0.
-		if (!!Lo) {
-			SMTExpr Tmp = SMT.bvconst(Lo);
-			Cmp0 = SMT.bvuge(E, Tmp);
-			SMT.decref(Tmp);
-		}
+		if (!!Lo)
+			Cmp0 = DAG.bvuge(E, DAG.bvconst(Lo));
 		// Note that (< Hi) is not always correct.  Need to
 		// ignore Hi == 0 (i.e., <= UMAX) or use (<= Hi - 1).
-		if (!!Hi) {
-			SMTExpr Tmp = SMT.bvconst(Hi);
-			Cmp1 = SMT.bvult(E, Tmp);
-			SMT.decref(Tmp);
-		}
+		if (!!Hi)
+			Cmp1 = DAG.bvult(E, DAG.bvconst(Hi));
 		if (!Cmp0) {
 			Cond = Cmp1;
 		} else if (!Cmp1) {
 			Cond = Cmp0;
 		} else {
 			if (Lo.ule(Hi))	// [Lo, Hi).
-				Cond = SMT.bvand(Cmp0, Cmp1);
+				Cond = DAG.bvand(Cmp0, Cmp1);
 			else		// Wrap: [Lo, UMAX] union [0, Hi).
-				Cond = SMT.bvor(Cmp0, Cmp1);
-			SMT.decref(Cmp0);
-			SMT.decref(Cmp1);
+				Cond = DAG.bvor(Cmp0, Cmp1);
 		}
-		SMT.assume(Cond);
-		SMT.decref(Cond);
+		DAG.assume(Cond);
 	}
 }
@@ -2,24 +2,45 @@
 
 #include <llvm/DataLayout.h>
 #include <llvm/ADT/DenseMap.h>
-#include "SMTSolver.h"
+#include "SMTDag.h"
+
+namespace llvm {
+	class BasicBlock;
+} // namespace llvm
 
 class ValueGen {
 public:
 	llvm::DataLayout &TD;
-	SMTSolver &SMT;
+	// Values are encoded as DAG nodes, lowered to the solver by queries.
+	SMTDag DAG;
 
-	typedef llvm::DenseMap<llvm::Value *, SMTExpr> ValueExprMap;
+	typedef llvm::DenseMap<llvm::Value *, SMTNode *> ValueExprMap;
 	typedef ValueExprMap::iterator iterator;
 	ValueExprMap Cache;
 
+	// Loops unrolled by PathGen (-unroll): blocks map to their headers.
+	// Values defined there have one instance per iteration; after the
+	// loop they are those of the iteration it exited in.
+	typedef llvm::DenseMap<llvm::BasicBlock *, llvm::BasicBlock *> LoopMap;
+	LoopMap Loops;
+	unsigned Unroll;
+
 	ValueGen(llvm::DataLayout &, SMTSolver &);
-	~ValueGen();
 
 	static bool isAnalyzable(llvm::Value *);
 	static bool isAnalyzable(llvm::Type *);
-	SMTExpr get(llvm::Value *);
+	SMTNode *get(llvm::Value *);
+	// V as used in BB in the given iteration of BB's loop.
+	SMTNode *get(llvm::Value *V, llvm::BasicBlock *BB, unsigned Iter);
+	// The iteration in which an unrolled loop exits.
+	SMTNode *exitIter(llvm::BasicBlock *Header);
 
 	iterator begin() { return Cache.begin(); }
 	iterator end() { return Cache.end(); }
+
+private:
+	typedef std::pair<llvm::Value *, unsigned> ValueIter;
+	llvm::DenseMap<ValueIter, SMTNode *> Iters;
+
+	llvm::BasicBlock *getLoop(llvm::Value *);
 };
@@ -0,0 +1,16 @@
+// RUN: %cc %s | cmpck -unroll=2 | diagdiff %s
+//
+// cmpck keeps over-approximating loops with -unroll: the comparisons
+// below are only true after more than two iterations.
+
+int find(int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (i == 5)
+			return i;
+	if (i > 10)
+		return -1;
+	return 0;
+}
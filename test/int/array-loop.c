@@ -0,0 +1,22 @@
+// RUN: %cc %s -o %t.ll && intglobal %t.ll && intck %t.ll | diagdiff %s --prefix=exp
+//
+// Ranges of loop indices from intglobal leave out later iterations;
+// they must not drop the bounds check of an index running past the end.
+
+int a[10];
+
+void clear(void)
+{
+	int i;
+
+	for (i = 0; i < 16; ++i)
+		a[i] = 0; // exp: {{array}}
+}
+
+void clear_ok(void)
+{
+	int i;
+
+	for (i = 0; i < 10; ++i)
+		a[i] = 0;
+}
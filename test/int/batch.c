@@ -0,0 +1,21 @@
+// RUN: %cc %s | intck -int-batch | diagdiff %s --prefix=exp
+//
+// Checking all sites of a function at once must report each sat check
+// and discharge the unsat ones.
+
+int mix(int x, int y)
+{
+	int s = x + y; // exp: {{sadd}}
+
+	if (x < 0 || x > 100 || y < 0 || y > 100)
+		return s;
+	return x * y + x - y;
+}
+
+int twice(int x, int y)
+{
+	int a = x * 2; // exp: {{smul}}
+	int b = y * 3; // exp: {{smul}}
+
+	return a ^ b;
+}
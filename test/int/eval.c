@@ -0,0 +1,21 @@
+// RUN: %cc %s | intck -smt-eval=256 | diagdiff %s --prefix=exp
+//
+// Concrete inputs find witnesses for sat checks; the solver still
+// decides the rest, including shifts the inputs would over-shift.
+
+int inc(int x)
+{
+	return x + 1; // exp: {{sadd}}
+}
+
+int shift(int x, int n)
+{
+	return x << n; // exp: {{shl}}
+}
+
+int shift_ok(int x, int n)
+{
+	if (n < 0 || n >= 32)
+		return 0;
+	return x << n;
+}
@@ -0,0 +1,18 @@
+// RUN: rm -rf %t.cache && %cc %s -o %t.ll
+// RUN: intck -int-cache=%t.cache %t.ll > %t.1
+// RUN: intck -int-cache=%t.cache %t.ll > %t.2
+// RUN: diff %t.1 %t.2 && diagdiff %s --prefix=exp < %t.2
+//
+// The second run replays the reports of each function from the cache.
+
+int scale(int x)
+{
+	return x * 1000; // exp: {{smul}}
+}
+
+int scale_ok(int x)
+{
+	if (x < 0 || x > 100)
+		return -1;
+	return x * 1000;
+}
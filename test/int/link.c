@@ -0,0 +1,31 @@
+// RUN: %cc %s -o %t.ll && intglobal -emit-summary %t.ll
+// RUN: intglobal -link -index=%t.idx %t.ll.sum
+// RUN: intck -global-index=%t.idx %t.ll | diagdiff %s --prefix=exp
+// RUN: (cat %t.ll.sum; echo 'range var.shift k 32 99 100'; echo 'bad') > %t.bad.sum
+// RUN: intglobal -link -index=%t.idx %t.bad.sum %t.ll.sum
+// RUN: intck -global-index=%t.idx %t.ll | diagdiff %s --prefix=exp
+//
+// The global facts solved from the summaries alone bound shift by the
+// values stored to it.  A summary with a bad record is skipped as a
+// whole: the range record before it would let shift reach 99.
+
+int shift;
+
+void init(int fast)
+{
+	shift = fast ? 3 : 1;
+}
+
+int scale(int x)
+{
+	if (x < 0 || x > 1000)
+		return -1;
+	return x << shift;
+}
+
+int scale_by(int x, int n)
+{
+	if (x < 0 || x > 1000)
+		return -1;
+	return x << n; // exp: {{shl}}
+}
@@ -0,0 +1,20 @@
+// RUN: %cc %s | intck -slice-paths | diagdiff %s --prefix=exp
+//
+// Slicing drops branches unrelated to the checked value, but must keep
+// those that bound it.
+
+int scale(int x, int flag)
+{
+	if (flag)
+		return 0;
+	return x * 1000; // exp: {{smul}}
+}
+
+int scale_ok(int x, int flag)
+{
+	if (flag)
+		return 0;
+	if (x < 0 || x > 100)
+		return -1;
+	return x * 1000;
+}
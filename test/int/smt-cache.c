@@ -0,0 +1,21 @@
+// RUN: rm -rf %t.cache && %cc %s -o %t.ll
+// RUN: intck -smt-cache=%t.cache %t.ll > %t.1
+// RUN: intck -smt-cache=%t.cache %t.ll > %t.2
+// RUN: diff %t.1 %t.2 && diagdiff %s --prefix=exp < %t.2
+//
+// The second run answers its queries from the cache, with the same
+// reports as the first.
+
+#include <stdlib.h>
+
+void *alloc(size_t n, size_t size)
+{
+	return malloc(n * size); // exp: {{umul}}
+}
+
+void *alloc_ok(size_t n)
+{
+	if (n > 1024)
+		return NULL;
+	return malloc(n * 16);
+}
@@ -0,0 +1,21 @@
+// RUN: %cc %s | intck -unroll=2 | diagdiff %s --prefix=exp
+//
+// Unrolling loops in path conditions must keep the reports of checks
+// on loop-carried values, and bound the loop counter as before.
+
+int sum(const int *a, int n)
+{
+	int i, s = 0;
+
+	for (i = 0; i < n; ++i)
+		s += a[i]; // exp: {{sadd}}
+	return s;
+}
+
+void fill(int *a, int n)
+{
+	int i;
+
+	for (i = 0; i < n; ++i)
+		a[i] = i;
+}